@@ -27,7 +27,12 @@
 #include "ppcg.h"
 #include "ppcg_options.h"
 #include "cpu.h"
+#include "gpu_array_tile.h"
+#include "hybrid.h"
+#include "machine.h"
 #include "print.h"
+#include "profile.h"
+#include "reduction.h"
 #include "schedule.h"
 #include "util.h"
 
@@ -56,6 +61,270 @@ static void ppcg_stmt_free(void *user)
 	free(stmt);
 }
 
+/* The names of the marks that are introduced by insert_tasks
+ * around and inside the tile loops of a band
+ * with tiles that are executed as OpenMP tasks.
+ */
+static const char *task_region_name = "ppcg_task_region";
+static const char *task_name = "ppcg_task";
+
+/* The name of the array that is used to express the dependences
+ * between the tasks.
+ */
+static const char *task_deps_name = "ppcg_task_deps";
+
+/* Information about a tiled band, the tiles of which are executed
+ * as OpenMP tasks.
+ *
+ * "n" is the number of tile loops.
+ * "scale" contains the factor by which each tile loop iterator
+ * is divided to obtain the index of the tile, which is the tile size
+ * if the tile loops are scaled by the tile sizes and 1 otherwise.
+ * "n_dist" is the number of distinct non-zero distances
+ * between tiles that are connected by a dependence and
+ * "dist" contains these distances, with "n" elements per distance.
+ * All these elements are non-negative.
+ * "pad" contains the maximal distance in each of the "n" dimensions.
+ * "lower" contains lower bounds on the tile loop iterators and
+ * "size" contains the size of the array of dependence objects
+ * in each dimension, both expressed in terms of the parameters.
+ * The array of dependence objects is indexed by the tile indices,
+ * shifted by the lower bound and the padding.
+ * The distances and bounds are all expressed in terms of tile indices.
+ */
+struct cpu_task_band {
+	int n;
+	int *scale;
+	int n_dist;
+	int *dist;
+	int *pad;
+	isl_pw_aff_list *lower;
+	isl_pw_aff_list *size;
+};
+
+static void cpu_task_band_free(void *user)
+{
+	struct cpu_task_band *band = user;
+
+	if (!band)
+		return;
+
+	free(band->scale);
+	free(band->dist);
+	free(band->pad);
+	isl_pw_aff_list_free(band->lower);
+	isl_pw_aff_list_free(band->size);
+	free(band);
+}
+
+/* An AST node that replaces one of the marks introduced by insert_tasks.
+ *
+ * If "region" is set, then the node represents the tile loops
+ * of a band with tiles that are executed as tasks.
+ * The tasks are created by a single thread inside an OpenMP parallel
+ * region and "size" contains AST expressions for the sizes
+ * of the array of dependence objects in each of the "n" dimensions.
+ * Otherwise, the node represents a single task and "index" contains
+ * AST expressions for the tile indices, shifted by
+ * the padding minus each of the distances in turn, starting with
+ * a zero distance, "n" expressions per distance.
+ * "lower" contains AST expressions for the lower bounds
+ * on the tile indices.
+ * "tree" is the AST of the tile loops or of the task.
+ */
+struct cpu_ast_task {
+	int region;
+	int n;
+	isl_ast_node *tree;
+	isl_ast_expr_list *lower;
+	isl_ast_expr_list *size;
+	isl_ast_expr_list *index;
+};
+
+static void cpu_ast_task_free(void *user)
+{
+	struct cpu_ast_task *task = user;
+
+	if (!task)
+		return;
+
+	isl_ast_node_free(task->tree);
+	isl_ast_expr_list_free(task->lower);
+	isl_ast_expr_list_free(task->size);
+	isl_ast_expr_list_free(task->index);
+	free(task);
+}
+
+/* The name of the mark that is introduced by pack_arrays
+ * above the point band of a tiled band with packed arrays,
+ * the name of the mark that is introduced by replace_scalars
+ * above an innermost loop with array elements that are kept
+ * in local variables and the name of the copy statements
+ * between the local buffers and the original arrays.
+ */
+static const char *pack_name = "ppcg_pack";
+static const char *private_name = "ppcg_private";
+static const char *pack_copy_name = "ppcg_pack_copy";
+
+/* An array of which the elements accessed inside a subtree
+ * of the schedule are copied into a local buffer.
+ *
+ * "array" is the original array.
+ * "access" contains the elements of the array that are accessed
+ * inside the subtree for given values of the outer schedule dimensions,
+ * in the form
+ *
+ *	{ D[i] -> A[a] }
+ *
+ * where D represents the outer schedule dimensions.
+ * "write" contains the elements that are written, in the same form,
+ * or is NULL if the array is not written inside the subtree.
+ * "tile" describes the local buffer, with tile->tiling of the form
+ *
+ *	{ [D[i] -> A[a]] -> T[t] }
+ *
+ * where T is the local buffer.
+ */
+struct cpu_packed_array {
+	struct pet_array *array;
+	isl_map *access;
+	isl_map *write;
+	struct gpu_array_tile *tile;
+};
+
+/* The arrays that are copied into local buffers
+ * inside a subtree of the schedule,
+ * either the tiles of a tiled band (by pack_arrays) or
+ * an innermost loop (by replace_scalars).
+ *
+ * "depth" is the number of outer schedule dimensions
+ * on which the local buffers depend.
+ * "n" is the number of elements in "array".
+ */
+struct cpu_pack {
+	int depth;
+	int n;
+	struct cpu_packed_array *array;
+};
+
+static void cpu_pack_free(void *user)
+{
+	int i;
+	struct cpu_pack *pack = user;
+
+	if (!pack)
+		return;
+
+	for (i = 0; i < pack->n; ++i) {
+		isl_map_free(pack->array[i].access);
+		isl_map_free(pack->array[i].write);
+		gpu_array_tile_free(pack->array[i].tile);
+	}
+	free(pack->array);
+	free(pack);
+}
+
+/* An AST node that replaces a mark introduced by pack_arrays
+ * or replace_scalars.
+ *
+ * "id" is the identifier of the mark, which keeps "pack" alive.
+ * "copy" contains the ASTs for copying the elements of each
+ * of the arrays in "pack" into its local buffer.
+ * "copy_out" contains the ASTs for copying the written elements
+ * back to the arrays.
+ * "tree" is the AST of the child of the mark.
+ */
+struct cpu_ast_pack {
+	isl_id *id;
+	struct cpu_pack *pack;
+	isl_ast_node_list *copy;
+	isl_ast_node_list *copy_out;
+	isl_ast_node *tree;
+};
+
+static void cpu_ast_pack_free(void *user)
+{
+	struct cpu_ast_pack *pack = user;
+
+	if (!pack)
+		return;
+
+	isl_id_free(pack->id);
+	isl_ast_node_list_free(pack->copy);
+	isl_ast_node_list_free(pack->copy_out);
+	isl_ast_node_free(pack->tree);
+	free(pack);
+}
+
+/* A statement that copies an element of an array
+ * into its local buffer (if "read" is set) or back (if "read" is not set).
+ *
+ * "local" is the AST expression for the element of the local buffer and
+ * "global" is the AST expression for the element of the original array.
+ */
+struct cpu_pack_copy {
+	int read;
+	isl_ast_expr *local;
+	isl_ast_expr *global;
+};
+
+static void cpu_pack_copy_free(void *user)
+{
+	struct cpu_pack_copy *copy = user;
+
+	if (!copy)
+		return;
+
+	isl_ast_expr_free(copy->local);
+	isl_ast_expr_free(copy->global);
+	free(copy);
+}
+
+/* Return the user pointer of the annotation of "node"
+ * if this annotation is called "name", or NULL otherwise.
+ */
+static void *get_annotation_user(__isl_keep isl_ast_node *node,
+	const char *name)
+{
+	isl_id *id;
+	const char *id_name;
+	void *user = NULL;
+
+	id = isl_ast_node_get_annotation(node);
+	if (!id)
+		return NULL;
+	id_name = isl_id_get_name(id);
+	if (id_name && !strcmp(id_name, name))
+		user = isl_id_get_user(id);
+	isl_id_free(id);
+
+	return user;
+}
+
+/* Return the task information attached to the user node "node"
+ * by ast_build_after_mark, or NULL if there is no such information.
+ */
+static struct cpu_ast_task *get_ast_task(__isl_keep isl_ast_node *node)
+{
+	return get_annotation_user(node, task_name);
+}
+
+/* Return the local buffer information attached to the user node "node"
+ * by ast_build_after_mark, or NULL if there is no such information.
+ */
+static struct cpu_ast_pack *get_ast_pack(__isl_keep isl_ast_node *node)
+{
+	return get_annotation_user(node, pack_name);
+}
+
+/* Return the copy statement attached to the user node "node"
+ * by at_each_pack_copy, or NULL if there is no such statement.
+ */
+static struct cpu_pack_copy *get_pack_copy(__isl_keep isl_ast_node *node)
+{
+	return get_annotation_user(node, pack_copy_name);
+}
+
 /* Derive the output file name from the input file name.
  * 'input' is the entire path of the input file. The output
  * is the file name plus the additional extension.
@@ -94,6 +363,51 @@ static FILE *get_output_file(const char *input, const char *output)
 struct ast_node_userinfo {
 	/* The for node is an openmp parallel for node. */
 	int is_openmp;
+	/* The for node does not carry any dependences.
+	 * Only set for openmp parallel for nodes and for candidates
+	 * for being collapsed into an openmp parallel for node.
+	 */
+	int is_parallel;
+	/* The schedule dimension of the for node. */
+	int depth;
+	/* The statement instances executed by an openmp parallel for node. */
+	isl_union_set *domain;
+
+	/* The for node is part of a sequence of openmp for nodes
+	 * that are executed inside a single openmp parallel region and
+	 * whether it starts or ends this sequence.
+	 */
+	int in_region;
+	int region_start;
+	int region_end;
+	/* The threads do not need to wait for each other
+	 * at the end of this openmp for node.
+	 */
+	int nowait;
+	/* The for node is not an openmp for node, but it is executed
+	 * as a whole inside an openmp parallel region.
+	 */
+	int hoisted;
+	/* The for node is an innermost for node that can be executed
+	 * as an openmp simd loop.  If "safelen" is positive, then
+	 * the for node carries dependences and at most "safelen"
+	 * consecutive iterations may be executed concurrently.
+	 */
+	int simd;
+	int safelen;
+
+	/* If not NULL, "reduction[i]" is set if the for node carries
+	 * dependences of reduction group i of build_info->reductions.
+	 */
+	int *reduction;
+};
+
+/* Dependences between statement instances in "domain"
+ * that are scheduled together by a given number of outer schedule dimensions.
+ */
+struct ast_build_active_deps {
+	isl_union_set *domain;
+	isl_union_map *deps;
 };
 
 /* Information used while building the ast.
@@ -104,11 +418,154 @@ struct ast_build_userinfo {
 
 	/* Are we currently in a parallel for loop? */
 	int in_parallel_for;
+	/* The schedule dimension of the innermost for loop
+	 * in the chain of parallel for loops starting at the current
+	 * openmp parallel for loop.  Only valid if in_parallel_for is set.
+	 */
+	int collapse_depth;
 
 	/* The contraction of the entire schedule tree. */
 	isl_union_pw_multi_aff *contraction;
+
+	/* The reduction groups of the scop, if any. */
+	struct ppcg_reductions *reductions;
+	/* The dependences that need to be respected by parallel loops.
+	 * These do not include the dependences between the instances
+	 * of the reduction groups in "reductions".
+	 */
+	isl_union_map *deps;
+	/* "active[d]" contains the elements of "deps" that are scheduled
+	 * together by the first d schedule dimensions, restricted
+	 * to the statement instances in the subtree of the AST for which
+	 * it was last computed.  "n_active" is the size of "active".
+	 */
+	int n_active;
+	struct ast_build_active_deps *active;
+
+	/* The band with tiles that are executed as OpenMP tasks
+	 * that is currently being constructed, if any.
+	 */
+	struct cpu_task_band *task_band;
+	/* The arrays that are packed inside the tiles
+	 * that are currently being constructed, if any.
+	 */
+	struct cpu_pack *pack;
+	/* The arrays with elements that are kept in local variables
+	 * inside the innermost loop that is currently being constructed,
+	 * if any.
+	 */
+	struct cpu_pack *private_pack;
+
+	/* The innermost for node of the collapsed loops
+	 * of the openmp parallel for node that is currently being printed,
+	 * if it has been marked as a simd loop.  This mark is handled
+	 * by the pragma of the openmp parallel for node, so print_for
+	 * should not print it again.
+	 */
+	isl_ast_node *collapsed_simd;
 };
 
+/* Store "deps" in build_info->active[depth] as the dependences
+ * between the statement instances in "domain" that are scheduled
+ * together by the first "depth" schedule dimensions.
+ */
+static isl_stat set_active_deps(struct ast_build_userinfo *build_info,
+	int depth, __isl_take isl_union_set *domain,
+	__isl_take isl_union_map *deps)
+{
+	struct ast_build_active_deps *active;
+
+	if (depth >= build_info->n_active) {
+		isl_ctx *ctx = isl_union_set_get_ctx(domain);
+		int i, n = depth + 1;
+
+		active = isl_realloc_array(ctx, build_info->active,
+					struct ast_build_active_deps, n);
+		if (!active)
+			goto error;
+		for (i = build_info->n_active; i < n; ++i) {
+			active[i].domain = NULL;
+			active[i].deps = NULL;
+		}
+		build_info->active = active;
+		build_info->n_active = n;
+	}
+
+	active = &build_info->active[depth];
+	isl_union_set_free(active->domain);
+	isl_union_map_free(active->deps);
+	active->domain = domain;
+	active->deps = deps;
+
+	return isl_stat_ok;
+error:
+	isl_union_set_free(domain);
+	isl_union_map_free(deps);
+	return isl_stat_error;
+}
+
+/* Restrict "deps" to the pairs of statement instances
+ * that are scheduled together by dimension "pos" of "prefix".
+ */
+static __isl_give isl_union_map *eq_at_dim(__isl_take isl_union_map *deps,
+	__isl_keep isl_multi_union_pw_aff *prefix, int pos)
+{
+	isl_union_pw_aff *upa;
+	isl_multi_union_pw_aff *mupa;
+
+	upa = isl_multi_union_pw_aff_get_union_pw_aff(prefix, pos);
+	mupa = isl_multi_union_pw_aff_from_union_pw_aff(upa);
+	return isl_union_map_eq_at_multi_union_pw_aff(deps, mupa);
+}
+
+/* Return the dependences between the statement instances in "domain"
+ * that are scheduled together by the first "depth" dimensions
+ * of "prefix".
+ *
+ * Start from the deepest cached set of dependences at depth
+ * at most "depth" that was computed for a subtree of the AST
+ * that contains "domain".  Since each of these dependences
+ * has already been restricted to pairs of instances that
+ * are scheduled together by the outer dimensions of that subtree and
+ * since these outer dimensions also appear in "prefix",
+ * only the remaining dimensions need to be considered.
+ * If there is no such cached set, then start from all dependences.
+ */
+static __isl_give isl_union_map *get_active_deps(
+	struct ast_build_userinfo *build_info, __isl_keep isl_union_set *domain,
+	__isl_keep isl_multi_union_pw_aff *prefix, int depth)
+{
+	int d;
+	isl_union_map *deps;
+
+	for (d = depth; d > 0; --d) {
+		struct ast_build_active_deps *active;
+		isl_bool subset;
+
+		if (d >= build_info->n_active)
+			continue;
+		active = &build_info->active[d];
+		if (!active->domain)
+			continue;
+		subset = isl_union_set_is_subset(domain, active->domain);
+		if (subset < 0)
+			return NULL;
+		if (subset)
+			break;
+	}
+
+	if (d > 0)
+		deps = isl_union_map_copy(build_info->active[d].deps);
+	else
+		deps = isl_union_map_copy(build_info->deps);
+	deps = isl_union_map_intersect_domain(deps, isl_union_set_copy(domain));
+	deps = isl_union_map_intersect_range(deps, isl_union_set_copy(domain));
+	for (; d < depth; ++d)
+		deps = eq_at_dim(deps, prefix, d);
+
+	return deps;
+}
+
 /* Check if the current scheduling dimension is parallel.
  *
  * We check for parallelism by verifying that the loop does not carry any
@@ -127,79 +584,373 @@ struct ast_build_userinfo {
  * Note that if the schedule tree does not contain any expansions,
  * then the contraction is an identity function.
  *
- * If the live_range_reordering option is set, then this currently
- * includes the order dependences.  In principle, non-zero order dependences
- * could be allowed, but this would require privatization and/or expansion.
+ * The dependences are collected in build_info->deps by init_build_info.
  *
  * Parallelism test: if the distance is zero in all outer dimensions, then it
  * has to be zero in the current dimension as well.
- * Implementation: first, translate dependences into time space, then force
- * outer dimensions to be equal.  If the distance is zero in the current
- * dimension, then the loop is parallel.
- * The distance is zero in the current dimension if it is a subset of a map
- * with equal values for the current dimension.
+ * Implementation: first, restrict the dependences to those that are
+ * scheduled together by the outer dimensions.  If they are also
+ * scheduled together by the current dimension, then the loop is parallel.
+ * The dependences that are scheduled together by the outer dimensions
+ * are obtained from get_active_deps, which reuses the result
+ * of previous calls for enclosing loops.  The dependences that are
+ * also scheduled together by the current dimension are stored in turn
+ * for use by loops nested inside the current loop.
+ * Each call therefore only needs to consider a single schedule dimension.
  */
 static int ast_schedule_dim_is_parallel(__isl_keep isl_ast_build *build,
 	struct ast_build_userinfo *build_info)
 {
-	struct ppcg_scop *scop = build_info->scop;
-	isl_union_map *schedule, *deps;
-	isl_map *schedule_deps, *test;
+	isl_union_map *schedule, *deps, *test;
+	isl_union_set *domain;
+	isl_multi_union_pw_aff *prefix;
 	isl_space *schedule_space;
-	unsigned i, dimension, is_parallel;
+	int dimension, is_parallel;
 
 	schedule = isl_ast_build_get_schedule(build);
 	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
 		isl_union_pw_multi_aff_copy(build_info->contraction));
 	schedule_space = isl_ast_build_get_schedule_space(build);
-
 	dimension = isl_space_dim(schedule_space, isl_dim_out) - 1;
+	isl_space_free(schedule_space);
 
-	deps = isl_union_map_copy(scop->dep_flow);
-	deps = isl_union_map_union(deps, isl_union_map_copy(scop->dep_false));
-	if (scop->options->live_range_reordering) {
-		isl_union_map *order = isl_union_map_copy(scop->dep_order);
-		deps = isl_union_map_union(deps, order);
+	domain = isl_union_map_domain(isl_union_map_copy(schedule));
+	if (isl_union_set_is_empty(domain)) {
+		isl_union_set_free(domain);
+		isl_union_map_free(schedule);
+		return 1;
 	}
-	deps = isl_union_map_apply_range(deps, isl_union_map_copy(schedule));
-	deps = isl_union_map_apply_domain(deps, schedule);
+	prefix = isl_multi_union_pw_aff_from_union_map(schedule);
 
-	if (isl_union_map_is_empty(deps)) {
-		isl_union_map_free(deps);
-		isl_space_free(schedule_space);
-		return 1;
+	deps = get_active_deps(build_info, domain, prefix, dimension);
+	test = eq_at_dim(isl_union_map_copy(deps), prefix, dimension);
+	isl_multi_union_pw_aff_free(prefix);
+	is_parallel = isl_union_map_is_subset(deps, test);
+	isl_union_map_free(deps);
+
+	if (set_active_deps(build_info, dimension + 1, domain, test) < 0)
+		return -1;
+
+	return is_parallel;
+}
+
+/* Return the statement instances scheduled by "build",
+ * in terms of the expanded domains.
+ */
+static __isl_give isl_union_set *build_domain(__isl_keep isl_ast_build *build,
+	struct ast_build_userinfo *build_info)
+{
+	isl_union_map *schedule;
+
+	schedule = isl_ast_build_get_schedule(build);
+	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
+		isl_union_pw_multi_aff_copy(build_info->contraction));
+	return isl_union_map_domain(schedule);
+}
+
+/* Does the current for node carry any of the dependences
+ * in "group", restricted to the instances in "domain" and
+ * to pairs of instances that are scheduled together
+ * by the outer dimensions of "prefix"?
+ * The current for node corresponds to dimension "depth".
+ */
+static isl_bool carries_reduction(struct ppcg_reduction *group,
+	__isl_keep isl_union_set *domain,
+	__isl_keep isl_multi_union_pw_aff *prefix, int depth)
+{
+	isl_union_map *deps, *test;
+	isl_bool carried;
+	int d;
+
+	deps = isl_union_map_copy(group->deps);
+	deps = isl_union_map_intersect_domain(deps, isl_union_set_copy(domain));
+	deps = isl_union_map_intersect_range(deps, isl_union_set_copy(domain));
+	for (d = 0; d < depth; ++d)
+		deps = eq_at_dim(deps, prefix, d);
+	test = eq_at_dim(isl_union_map_copy(deps), prefix, depth);
+	carried = isl_bool_not(isl_union_map_is_subset(deps, test));
+	isl_union_map_free(deps);
+	isl_union_map_free(test);
+
+	return carried;
+}
+
+/* Mark the reduction groups that have dependences carried
+ * by the current for node in node_info->reduction.
+ * The current for node has been determined to be parallel
+ * without taking into account the dependences of the reduction groups,
+ * so it can be executed in parallel provided the marked reductions
+ * are performed on private copies of the updated arrays.
+ */
+static isl_stat mark_carried_reductions(__isl_keep isl_ast_build *build,
+	struct ast_build_userinfo *build_info,
+	struct ast_node_userinfo *node_info)
+{
+	struct ppcg_reductions *reductions = build_info->reductions;
+	isl_union_map *schedule;
+	isl_union_set *domain;
+	isl_multi_union_pw_aff *prefix;
+	int i;
+
+	if (!reductions || reductions->n == 0)
+		return isl_stat_ok;
+
+	schedule = isl_ast_build_get_schedule(build);
+	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
+		isl_union_pw_multi_aff_copy(build_info->contraction));
+	domain = isl_union_map_domain(isl_union_map_copy(schedule));
+	prefix = isl_multi_union_pw_aff_from_union_map(schedule);
+
+	for (i = 0; i < reductions->n; ++i) {
+		isl_bool carried;
+
+		carried = carries_reduction(&reductions->group[i], domain,
+					prefix, node_info->depth);
+		if (carried < 0)
+			break;
+		if (!carried)
+			continue;
+		if (!node_info->reduction)
+			node_info->reduction = isl_calloc_array(
+					isl_ast_build_get_ctx(build), int,
+					reductions->n);
+		if (!node_info->reduction)
+			break;
+		node_info->reduction[i] = 1;
+	}
+
+	isl_union_set_free(domain);
+	isl_multi_union_pw_aff_free(prefix);
+
+	return i < reductions->n ? isl_stat_error : isl_stat_ok;
+}
+
+/* Check whether the elements of "deltas", the differences
+ * between the array elements written in consecutive iterations
+ * of the current for node, are all zero, except possibly
+ * for the final element, which is either zero or one.
+ * Clear *user if this is not the case.
+ */
+static isl_stat check_unit_stride(__isl_take isl_set *deltas, void *user)
+{
+	int *unit = user;
+	int i, n;
+	isl_set *allowed;
+	isl_bool subset;
+
+	n = isl_set_dim(deltas, isl_dim_set);
+	allowed = isl_set_universe(isl_set_get_space(deltas));
+	for (i = 0; i + 1 < n; ++i)
+		allowed = isl_set_fix_si(allowed, isl_dim_set, i, 0);
+	if (n > 0) {
+		allowed = isl_set_lower_bound_si(allowed, isl_dim_set, i, 0);
+		allowed = isl_set_upper_bound_si(allowed, isl_dim_set, i, 1);
 	}
+	subset = isl_set_is_subset(deltas, allowed);
+	isl_set_free(deltas);
+	isl_set_free(allowed);
+
+	if (subset < 0)
+		return isl_stat_error;
+	if (!subset)
+		*unit = 0;
+	return isl_stat_ok;
+}
 
-	schedule_deps = isl_map_from_union_map(deps);
+/* Do the writes performed by the statement instances scheduled
+ * by "build" access consecutive array elements (or the same element)
+ * in consecutive iterations of the current for node?
+ * "schedule" is the schedule of "build", in terms of the expanded domains.
+ *
+ * Compute the pairs of array elements written in iterations
+ * that only differ by one in the current schedule dimension and
+ * check that they only differ by zero or one in the final array index.
+ * Pairs of elements of different arrays are ignored.
+ */
+static isl_bool has_unit_stride_writes(__isl_keep isl_union_map *schedule,
+	__isl_keep isl_space *schedule_space, struct ppcg_scop *scop)
+{
+	int dim, unit = 1;
+	isl_union_map *writes, *next;
+	isl_union_set *deltas;
+	isl_multi_aff *ma;
+	isl_aff *aff;
+	isl_stat r;
+
+	dim = isl_space_dim(schedule_space, isl_dim_set) - 1;
+	ma = isl_multi_aff_identity(isl_space_map_from_set(
+					isl_space_copy(schedule_space)));
+	aff = isl_multi_aff_get_aff(ma, dim);
+	aff = isl_aff_add_constant_si(aff, 1);
+	ma = isl_multi_aff_set_aff(ma, dim, aff);
+	next = isl_union_map_from_map(isl_map_from_multi_aff(ma));
+
+	writes = isl_union_map_copy(scop->may_writes);
+	writes = isl_union_map_apply_domain(writes,
+					isl_union_map_copy(schedule));
+	next = isl_union_map_apply_range(next, isl_union_map_copy(writes));
+	next = isl_union_map_apply_range(isl_union_map_reverse(writes), next);
+	deltas = isl_union_map_deltas(next);
+	r = isl_union_set_foreach_set(deltas, &check_unit_stride, &unit);
+	isl_union_set_free(deltas);
+
+	if (r < 0)
+		return isl_bool_error;
+	return unit ? isl_bool_true : isl_bool_false;
+}
 
-	for (i = 0; i < dimension; i++)
-		schedule_deps = isl_map_equate(schedule_deps, isl_dim_out, i,
-					       isl_dim_in, i);
+/* Compute the minimal distance in dimension "dim" of "prefix"
+ * of the dependences in "carried", which are all carried
+ * by this dimension.
+ * Return 1 if there is no fixed minimal distance greater than one.
+ */
+static int min_carried_distance(__isl_take isl_union_map *carried,
+	__isl_keep isl_multi_union_pw_aff *prefix, int dim)
+{
+	isl_union_map *map;
+	isl_union_set *deltas;
+	isl_space *space;
+	isl_set *set;
+	isl_val *v;
+	int n_param, distance = 1;
+
+	map = isl_union_map_from_multi_union_pw_aff(
+					isl_multi_union_pw_aff_copy(prefix));
+	carried = isl_union_map_apply_domain(carried,
+					isl_union_map_copy(map));
+	carried = isl_union_map_apply_range(carried, map);
+	deltas = isl_union_map_deltas(carried);
+	space = isl_multi_union_pw_aff_get_space(prefix);
+	set = isl_union_set_extract_set(deltas, space);
+	isl_union_set_free(deltas);
+	n_param = isl_set_dim(set, isl_dim_param);
+	set = isl_set_project_out(set, isl_dim_param, 0, n_param);
+	set = isl_set_project_out(set, isl_dim_set, 0, dim);
+	set = isl_set_lexmin(set);
+	v = isl_set_plain_get_val_if_fixed(set, isl_dim_set, 0);
+	if (v && isl_val_is_int(v) && isl_val_cmp_si(v, 1) > 0 &&
+	    isl_val_cmp_si(v, INT_MAX) < 0)
+		distance = isl_val_get_num_si(v);
+	isl_val_free(v);
+	isl_set_free(set);
+
+	return distance;
+}
 
-	test = isl_map_universe(isl_map_get_space(schedule_deps));
-	test = isl_map_equate(test, isl_dim_out, dimension, isl_dim_in,
-			      dimension);
-	is_parallel = isl_map_is_subset(schedule_deps, test);
+/* Check if the current for node can be executed as an openmp simd loop
+ * and, if so, mark it as such in "node_info".
+ * The for node is only kept marked by ast_build_after_for
+ * if it turns out to be an innermost for node.
+ *
+ * Vectorization is only considered profitable if the writes
+ * inside the for node are performed with unit stride.
+ * If the for node has been determined to be parallel
+ * by mark_openmp_parallel, then it can clearly be executed as a simd loop.
+ * Otherwise, perform the same test as ast_schedule_dim_is_parallel,
+ * also reusing and storing the dependences scheduled together
+ * by the outer dimensions, and compute the minimal distance
+ * of the dependences carried by the for node, if any.
+ * If this distance is greater than one, then consecutive iterations
+ * up to this distance can still be executed concurrently
+ * by specifying a "safelen" clause.
+ * The reduction groups carried by the for node, if any,
+ * are handled through reduction clauses, as in mark_openmp_parallel.
+ */
+static isl_stat mark_simd(__isl_keep isl_ast_build *build,
+	struct ast_build_userinfo *build_info,
+	struct ast_node_userinfo *node_info)
+{
+	isl_union_map *schedule, *deps, *test;
+	isl_union_set *domain;
+	isl_multi_union_pw_aff *prefix;
+	isl_space *schedule_space;
+	isl_bool unit, parallel;
+	int distance;
 
+	schedule = isl_ast_build_get_schedule(build);
+	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
+		isl_union_pw_multi_aff_copy(build_info->contraction));
+	schedule_space = isl_ast_build_get_schedule_space(build);
+	unit = has_unit_stride_writes(schedule, schedule_space,
+					build_info->scop);
 	isl_space_free(schedule_space);
-	isl_map_free(test);
-	isl_map_free(schedule_deps);
+	if (unit != isl_bool_true || node_info->is_parallel) {
+		isl_union_map_free(schedule);
+		node_info->simd = unit == isl_bool_true;
+		return unit < 0 ? isl_stat_error : isl_stat_ok;
+	}
 
-	return is_parallel;
+	domain = isl_union_map_domain(isl_union_map_copy(schedule));
+	prefix = isl_multi_union_pw_aff_from_union_map(schedule);
+	deps = get_active_deps(build_info, domain, prefix, node_info->depth);
+	test = eq_at_dim(isl_union_map_copy(deps), prefix, node_info->depth);
+	parallel = isl_union_map_is_subset(deps, test);
+	if (parallel == isl_bool_false) {
+		deps = isl_union_map_subtract(deps, isl_union_map_copy(test));
+		distance = min_carried_distance(deps, prefix, node_info->depth);
+	} else {
+		isl_union_map_free(deps);
+		distance = 0;
+	}
+	isl_multi_union_pw_aff_free(prefix);
+	if (set_active_deps(build_info, node_info->depth + 1,
+				domain, test) < 0 || parallel < 0)
+		return isl_stat_error;
+	if (distance == 1)
+		return isl_stat_ok;
+
+	node_info->simd = 1;
+	node_info->safelen = distance;
+	return mark_carried_reductions(build, build_info, node_info);
 }
 
 /* Mark a for node openmp parallel, if it is the outermost parallel for node.
+ *
+ * Inside an openmp parallel for node, also keep track of
+ * the chain of directly nested parallel for nodes such that
+ * they can be collapsed into the openmp parallel for node
+ * if they turn out to be perfectly nested.
+ * That is, only check whether a for node inside an openmp parallel
+ * for node is parallel if it is nested directly inside the innermost
+ * parallel for node of the chain.
+ *
+ * If a parallel for node is only parallel because the dependences
+ * of the reduction groups were not taken into account,
+ * then keep track of the reduction groups that need to be
+ * turned into reduction clauses.
  */
 static void mark_openmp_parallel(__isl_keep isl_ast_build *build,
 	struct ast_build_userinfo *build_info,
 	struct ast_node_userinfo *node_info)
 {
-	if (build_info->in_parallel_for)
+	isl_space *space;
+
+	space = isl_ast_build_get_schedule_space(build);
+	node_info->depth = isl_space_dim(space, isl_dim_out) - 1;
+	isl_space_free(space);
+
+	if (build_info->task_band)
+		return;
+
+	if (build_info->in_parallel_for) {
+		if (node_info->depth != build_info->collapse_depth + 1)
+			return;
+		if (ast_schedule_dim_is_parallel(build, build_info) > 0 &&
+		    mark_carried_reductions(build, build_info,
+					    node_info) >= 0) {
+			node_info->is_parallel = 1;
+			build_info->collapse_depth = node_info->depth;
+		}
 		return;
+	}
 
-	if (ast_schedule_dim_is_parallel(build, build_info)) {
+	if (ast_schedule_dim_is_parallel(build, build_info) > 0 &&
+	    mark_carried_reductions(build, build_info, node_info) >= 0) {
 		build_info->in_parallel_for = 1;
+		build_info->collapse_depth = node_info->depth;
 		node_info->is_openmp = 1;
+		node_info->is_parallel = 1;
+		node_info->domain = build_domain(build, build_info);
 	}
 }
 
@@ -209,8 +960,7 @@ static struct ast_node_userinfo *allocate_ast_node_userinfo()
 {
 	struct ast_node_userinfo *node_info;
 	node_info = (struct ast_node_userinfo *)
-		malloc(sizeof(struct ast_node_userinfo));
-	node_info->is_openmp = 0;
+		calloc(1, sizeof(struct ast_node_userinfo));
 	return node_info;
 }
 
@@ -220,6 +970,10 @@ static void free_ast_node_userinfo(void *ptr)
 {
 	struct ast_node_userinfo *info;
 	info = (struct ast_node_userinfo *) ptr;
+	if (info) {
+		isl_union_set_free(info->domain);
+		free(info->reduction);
+	}
 	free(info);
 }
 
@@ -243,16 +997,54 @@ static __isl_give isl_id *ast_build_before_for(
 	id = isl_id_set_free_user(id, free_ast_node_userinfo);
 
 	mark_openmp_parallel(build, build_info, node_info);
+	if (build_info->scop->options->openmp_simd &&
+	    mark_simd(build, build_info, node_info) < 0)
+		return isl_id_free(id);
 
 	return id;
 }
 
+/* Set *user if "node" is a for node or a user node introduced
+ * by ast_build_after_mark, which contains for nodes.
+ */
+static isl_bool find_for(__isl_keep isl_ast_node *node, void *user)
+{
+	isl_bool *found = user;
+
+	if (isl_ast_node_get_type(node) == isl_ast_node_for ||
+	    get_ast_task(node) || get_ast_pack(node))
+		*found = isl_bool_true;
+
+	return *found ? isl_bool_false : isl_bool_true;
+}
+
+/* Is the for node "node" an innermost for node?
+ */
+static isl_bool is_innermost_for(__isl_keep isl_ast_node *node)
+{
+	isl_ast_node *body;
+	isl_bool found = isl_bool_false;
+	isl_stat r;
+
+	body = isl_ast_node_for_get_body(node);
+	r = isl_ast_node_foreach_descendant_top_down(body, &find_for, &found);
+	isl_ast_node_free(body);
+
+	if (r < 0)
+		return isl_bool_error;
+	return isl_bool_not(found);
+}
+
 /* This method is executed after the construction of a for node.
  *
  * It performs the following actions:
  *
  * 	- Reset the 'in_parallel_for' flag, as soon as we leave a for node,
  * 	  that is marked as openmp parallel.
+ * 	- Remove a for node from the chain of parallel for nodes
+ * 	  inside an openmp parallel for node when we leave it.
+ * 	- Only keep a for node marked as a simd loop
+ * 	  if it is an innermost for node.
  *
  */
 static __isl_give isl_ast_node *ast_build_after_for(
@@ -265,10 +1057,18 @@ static __isl_give isl_ast_node *ast_build_after_for(
 
 	id = isl_ast_node_get_annotation(node);
 	info = isl_id_get_user(id);
+	build_info = (struct ast_build_userinfo *) user;
 
-	if (info && info->is_openmp) {
-		build_info = (struct ast_build_userinfo *) user;
+	if (info && info->is_openmp)
 		build_info->in_parallel_for = 0;
+	else if (info && info->is_parallel)
+		build_info->collapse_depth = info->depth - 1;
+	if (info && info->simd) {
+		isl_bool inner = is_innermost_for(node);
+		if (inner < 0)
+			node = isl_ast_node_free(node);
+		if (inner != isl_bool_true)
+			info->simd = 0;
 	}
 
 	isl_id_free(id);
@@ -276,361 +1076,3801 @@ static __isl_give isl_ast_node *ast_build_after_for(
 	return node;
 }
 
-/* Find the element in scop->stmts that has the given "id".
+/* This method is executed before the construction of the AST
+ * for the child of a mark node.
+ *
+ * If the mark was introduced by insert_tasks around the tile loops
+ * of a band with tiles that are executed as OpenMP tasks,
+ * then keep track of the band.  The tile loops are executed
+ * by a single thread, while the tasks are executed sequentially,
+ * so no openmp parallel for loops are introduced inside them.
+ *
+ * If the mark was introduced by pack_arrays or replace_scalars,
+ * then keep track of the arrays such that at_each_domain can make
+ * the accesses inside the subtree refer to the local buffers.
  */
-static struct pet_stmt *find_stmt(struct ppcg_scop *scop, __isl_keep isl_id *id)
+static isl_stat ast_build_before_mark(__isl_keep isl_id *mark,
+	__isl_keep isl_ast_build *build, void *user)
 {
-	int i;
+	struct ast_build_userinfo *build_info = user;
+	const char *name;
+
+	name = isl_id_get_name(mark);
+	if (name && !strcmp(name, task_region_name))
+		build_info->task_band = isl_id_get_user(mark);
+	if (name && !strcmp(name, pack_name))
+		build_info->pack = isl_id_get_user(mark);
+	if (name && !strcmp(name, private_name))
+		build_info->private_pack = isl_id_get_user(mark);
+
+	return isl_stat_ok;
+}
 
-	for (i = 0; i < scop->pet->n_stmt; ++i) {
-		struct pet_stmt *stmt = scop->pet->stmts[i];
-		isl_id *id_i;
+/* Construct AST expressions for the elements of "list"
+ * using the AST build "build".
+ */
+static __isl_give isl_ast_expr_list *expr_list_from_pw_aff_list(
+	__isl_keep isl_ast_build *build, __isl_keep isl_pw_aff_list *list)
+{
+	int i, n;
+	isl_ast_expr_list *expr_list;
 
-		id_i = isl_set_get_tuple_id(stmt->domain);
-		isl_id_free(id_i);
+	if (!list)
+		return NULL;
 
-		if (id_i == id)
-			return stmt;
+	n = isl_pw_aff_list_n_pw_aff(list);
+	expr_list = isl_ast_expr_list_alloc(isl_ast_build_get_ctx(build), n);
+	for (i = 0; i < n; ++i) {
+		isl_pw_aff *pa;
+		isl_ast_expr *expr;
+
+		pa = isl_pw_aff_list_get_pw_aff(list, i);
+		expr = isl_ast_build_expr_from_pw_aff(build, pa);
+		expr_list = isl_ast_expr_list_add(expr_list, expr);
 	}
 
-	isl_die(isl_id_get_ctx(id), isl_error_internal,
-		"statement not found", return NULL);
+	return expr_list;
 }
 
-/* Print a user statement in the generated AST.
- * The ppcg_stmt has been attached to the node in at_each_domain.
+/* Construct AST expressions for the tile indices of the band "band",
+ * derived from the tile loop iterators, which are the innermost
+ * schedule dimensions of "build", shifted by the padding minus
+ * each of the distances of "band" in turn, starting with a zero distance.
  */
-static __isl_give isl_printer *print_user(__isl_take isl_printer *p,
-	__isl_take isl_ast_print_options *print_options,
-	__isl_keep isl_ast_node *node, void *user)
+static __isl_give isl_ast_expr_list *task_index(
+	__isl_keep isl_ast_build *build, struct cpu_task_band *band)
 {
-	struct ppcg_stmt *stmt;
-	isl_id *id;
+	int i, k, depth;
+	isl_space *space;
+	isl_local_space *ls;
+	isl_ast_expr_list *list;
+
+	space = isl_ast_build_get_schedule_space(build);
+	depth = isl_space_dim(space, isl_dim_out);
+	ls = isl_local_space_from_space(space);
+	list = isl_ast_expr_list_alloc(isl_ast_build_get_ctx(build),
+					(1 + band->n_dist) * band->n);
+	for (k = 0; k <= band->n_dist; ++k) {
+		for (i = 0; i < band->n; ++i) {
+			isl_aff *aff;
+			isl_ast_expr *expr;
+			int d;
+
+			d = k == 0 ? 0 : band->dist[(k - 1) * band->n + i];
+			aff = isl_aff_var_on_domain(isl_local_space_copy(ls),
+					isl_dim_set, depth - band->n + i);
+			if (band->scale[i] != 1) {
+				aff = isl_aff_scale_down_ui(aff,
+							band->scale[i]);
+				aff = isl_aff_floor(aff);
+			}
+			aff = isl_aff_add_constant_si(aff, band->pad[i] - d);
+			expr = isl_ast_build_expr_from_pw_aff(build,
+						isl_pw_aff_from_aff(aff));
+			list = isl_ast_expr_list_add(list, expr);
+		}
+	}
+	isl_local_space_free(ls);
 
-	id = isl_ast_node_get_annotation(node);
-	stmt = isl_id_get_user(id);
-	isl_id_free(id);
+	return list;
+}
+
+/* This function is called for each statement node in the AST
+ * for copying the elements of an array into its local buffer or back.
+ * Attach a cpu_pack_copy representing the copy statement to the node.
+ * The statement name is "read" or "write", depending on whether
+ * the elements are copied into the local buffer or back.
+ *
+ * The schedule is of the form
+ *
+ *	type[D -> A] -> L
+ *
+ * where "type" refers to the cpu_packed_array,
+ * D corresponds to the outer schedule dimensions on which
+ * the local buffer depends,
+ * A to the original array and L to the generated AST schedule.
+ * Compute the inverse and strip off the name of the domain, resulting in
+ *
+ *	L -> [D -> A]
+ *
+ * and combine this mapping with on the one hand the projection
+ *
+ *	[D -> A] -> A
+ *
+ * and on the other hand the tiling
+ *
+ *	[D -> A] -> T
+ *
+ * to obtain the AST expressions for the elements of the original array
+ * and of the local buffer.
+ */
+static __isl_give isl_ast_node *at_each_pack_copy(
+	__isl_take isl_ast_node *node, __isl_keep isl_ast_build *build,
+	void *user)
+{
+	struct cpu_packed_array *array;
+	struct cpu_pack_copy *copy;
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_space *space;
+	isl_map *access;
+	isl_pw_multi_aff *pma, *pma2;
+	const char *type;
+
+	ctx = isl_ast_node_get_ctx(node);
+	copy = isl_calloc_type(ctx, struct cpu_pack_copy);
+	if (!copy)
+		return isl_ast_node_free(node);
+
+	access = isl_map_from_union_map(isl_ast_build_get_schedule(build));
+	id = isl_map_get_tuple_id(access, isl_dim_in);
+	type = isl_id_get_name(id);
+	copy->read = type && !strcmp(type, "read");
+	array = isl_id_get_user(id);
+	isl_id_free(id);
+	access = isl_map_reverse(access);
+	pma = isl_pw_multi_aff_from_map(access);
+	pma = isl_pw_multi_aff_reset_tuple_id(pma, isl_dim_out);
+
+	space = isl_space_range(isl_pw_multi_aff_get_space(pma));
+	space = isl_space_unwrap(space);
+	pma2 = isl_pw_multi_aff_range_map(space);
+	pma2 = isl_pw_multi_aff_pullback_pw_multi_aff(pma2,
+						isl_pw_multi_aff_copy(pma));
+	copy->global = isl_ast_build_access_from_pw_multi_aff(build, pma2);
+
+	pma2 = isl_pw_multi_aff_from_multi_aff(
+				isl_multi_aff_copy(array->tile->tiling));
+	pma2 = isl_pw_multi_aff_pullback_pw_multi_aff(pma2, pma);
+	copy->local = isl_ast_build_access_from_pw_multi_aff(build, pma2);
+
+	id = isl_id_alloc(ctx, pack_copy_name, copy);
+	id = isl_id_set_free_user(id, &cpu_pack_copy_free);
+	if (!copy->global || !copy->local)
+		node = isl_ast_node_free(node);
+	return isl_ast_node_set_annotation(node, id);
+}
+
+/* Construct an AST for copying the elements of "array"
+ * that are accessed inside the subtree of a mark introduced
+ * by pack_arrays or replace_scalars into its local buffer
+ * (if "read" is set) or for copying the written elements back
+ * (if "read" is not set), using the AST build "build" of the mark.
+ *
+ * The copy statements are of the form
+ *
+ *	type[D -> A]
+ *
+ * where "type" refers to "array", and they are scheduled
+ * by the outer schedule dimensions D, which are those of "build",
+ * followed by the array indices.
+ * The statements are handled by at_each_pack_copy.
+ * The callbacks for the for nodes are removed since the copy loops
+ * are not considered for parallelization or vectorization.
+ */
+static __isl_give isl_ast_node *build_pack_copy(
+	__isl_keep isl_ast_build *build, struct cpu_packed_array *array,
+	int read)
+{
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_set *domain;
+	isl_map *schedule;
+	isl_ast_node *tree;
+
+	ctx = isl_ast_build_get_ctx(build);
+	domain = isl_map_wrap(isl_map_copy(read ? array->access :
+							array->write));
+	id = isl_id_alloc(ctx, read ? "read" : "write", array);
+	domain = isl_set_set_tuple_id(domain, id);
+	schedule = isl_set_flatten_map(domain);
+	schedule = isl_map_reset_tuple_id(schedule, isl_dim_out);
+
+	build = isl_ast_build_copy(build);
+	build = isl_ast_build_set_at_each_domain(build,
+						&at_each_pack_copy, NULL);
+	build = isl_ast_build_set_before_each_for(build, NULL, NULL);
+	build = isl_ast_build_set_after_each_for(build, NULL, NULL);
+	tree = isl_ast_build_node_from_schedule_map(build,
+					isl_union_map_from_map(schedule));
+	isl_ast_build_free(build);
+
+	return tree;
+}
+
+/* Replace the mark node "node" introduced by pack_arrays
+ * or replace_scalars by a user node that is annotated
+ * with a cpu_ast_pack containing the AST of the child of the mark node,
+ * along with ASTs for copying the elements of each array
+ * into its local buffer and for copying the written elements back,
+ * such that print_user can print the local buffers and the copies
+ * around the child.
+ */
+static __isl_give isl_ast_node *build_pack(__isl_take isl_ast_node *node,
+	__isl_keep isl_ast_build *build, struct ast_build_userinfo *build_info,
+	int is_private)
+{
+	int i;
+	isl_ctx *ctx;
+	isl_id *id;
+	struct cpu_ast_pack *pack;
+
+	if (is_private)
+		build_info->private_pack = NULL;
+	else
+		build_info->pack = NULL;
+
+	ctx = isl_ast_node_get_ctx(node);
+	pack = isl_calloc_type(ctx, struct cpu_ast_pack);
+	if (!pack)
+		return isl_ast_node_free(node);
+	pack->id = isl_ast_node_mark_get_id(node);
+	pack->pack = isl_id_get_user(pack->id);
+	pack->tree = isl_ast_node_mark_get_node(node);
+	isl_ast_node_free(node);
+	if (!pack->pack) {
+		cpu_ast_pack_free(pack);
+		return NULL;
+	}
+
+	pack->copy = isl_ast_node_list_alloc(ctx, pack->pack->n);
+	pack->copy_out = isl_ast_node_list_alloc(ctx, 0);
+	for (i = 0; i < pack->pack->n; ++i) {
+		struct cpu_packed_array *array = &pack->pack->array[i];
+		isl_ast_node *copy;
+
+		copy = build_pack_copy(build, array, 1);
+		pack->copy = isl_ast_node_list_add(pack->copy, copy);
+		if (!array->write)
+			continue;
+		copy = build_pack_copy(build, array, 0);
+		pack->copy_out = isl_ast_node_list_add(pack->copy_out, copy);
+	}
+
+	node = isl_ast_node_alloc_user(isl_ast_expr_from_id(
+						isl_id_copy(pack->id)));
+	id = isl_id_alloc(ctx, pack_name, pack);
+	id = isl_id_set_free_user(id, &cpu_ast_pack_free);
+	if (!pack->tree || !pack->copy || !pack->copy_out)
+		node = isl_ast_node_free(node);
+	return isl_ast_node_set_annotation(node, id);
+}
+
+/* This method is executed after the construction of the AST
+ * for the child of a mark node.
+ *
+ * If the mark was introduced by pack_arrays or replace_scalars,
+ * then it is handled by build_pack.
+ *
+ * If the mark was introduced by insert_tasks, then replace
+ * the mark node by a user node that is annotated with
+ * a cpu_ast_task containing the AST of the child of the mark node,
+ * such that print_user can print the task constructs around it.
+ * The sizes and the lower bounds of the array of dependence objects
+ * only depend on the parameters, so they are constructed in the context
+ * of the scop, while the indices of the array are constructed
+ * in terms of the tile loop iterators.
+ */
+static __isl_give isl_ast_node *ast_build_after_mark(
+	__isl_take isl_ast_node *node, __isl_keep isl_ast_build *build,
+	void *user)
+{
+	struct ast_build_userinfo *build_info = user;
+	struct cpu_task_band *band = build_info->task_band;
+	struct cpu_ast_task *task;
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_ast_build *context_build;
+	const char *name;
+	int region;
+
+	id = isl_ast_node_mark_get_id(node);
+	name = isl_id_get_name(id);
+	if (name && (!strcmp(name, pack_name) ||
+		     !strcmp(name, private_name))) {
+		int is_private = !strcmp(name, private_name);
+
+		isl_id_free(id);
+		return build_pack(node, build, build_info, is_private);
+	}
+	region = name && !strcmp(name, task_region_name);
+	if (!band || (!region && (!name || strcmp(name, task_name)))) {
+		isl_id_free(id);
+		return node;
+	}
+
+	ctx = isl_ast_node_get_ctx(node);
+	task = isl_calloc_type(ctx, struct cpu_ast_task);
+	if (!task)
+		goto error;
+	task->region = region;
+	task->n = band->n;
+	task->tree = isl_ast_node_mark_get_node(node);
+	context_build = isl_ast_build_from_context(
+				isl_set_copy(build_info->scop->context));
+	task->lower = expr_list_from_pw_aff_list(context_build, band->lower);
+	if (region)
+		task->size = expr_list_from_pw_aff_list(context_build,
+							band->size);
+	else
+		task->index = task_index(build, band);
+	isl_ast_build_free(context_build);
+	if (region)
+		build_info->task_band = NULL;
+
+	isl_ast_node_free(node);
+	node = isl_ast_node_alloc_user(isl_ast_expr_from_id(id));
+	id = isl_id_alloc(ctx, task_name, task);
+	id = isl_id_set_free_user(id, &cpu_ast_task_free);
+	if (!task->tree || !task->lower || (region && !task->size) ||
+	    (!region && !task->index))
+		node = isl_ast_node_free(node);
+	return isl_ast_node_set_annotation(node, id);
+error:
+	isl_id_free(id);
+	return isl_ast_node_free(node);
+}
+
+/* Find the element in scop->stmts that has the given "id".
+ */
+static struct pet_stmt *find_stmt(struct ppcg_scop *scop, __isl_keep isl_id *id)
+{
+	int i;
+
+	for (i = 0; i < scop->pet->n_stmt; ++i) {
+		struct pet_stmt *stmt = scop->pet->stmts[i];
+		isl_id *id_i;
+
+		id_i = isl_set_get_tuple_id(stmt->domain);
+		isl_id_free(id_i);
+
+		if (id_i == id)
+			return stmt;
+	}
+
+	isl_die(isl_id_get_ctx(id), isl_error_internal,
+		"statement not found", return NULL);
+}
+
+/* Print the element of the array of dependence objects
+ * that corresponds to distance "k" of the task "task" to "p".
+ */
+static __isl_give isl_printer *print_task_deps_element(
+	__isl_take isl_printer *p, struct cpu_ast_task *task, int k)
+{
+	int i;
+
+	p = isl_printer_print_str(p, task_deps_name);
+	for (i = 0; i < task->n; ++i) {
+		isl_ast_expr *expr;
+
+		p = isl_printer_print_str(p, "[");
+		expr = isl_ast_expr_list_get_ast_expr(task->index,
+							k * task->n + i);
+		p = isl_printer_print_ast_expr(p, expr);
+		isl_ast_expr_free(expr);
+		p = isl_printer_print_str(p, " - (");
+		expr = isl_ast_expr_list_get_ast_expr(task->lower, i);
+		p = isl_printer_print_ast_expr(p, expr);
+		isl_ast_expr_free(expr);
+		p = isl_printer_print_str(p, ")]");
+	}
+
+	return p;
+}
+
+/* Print the sizes of the array of dependence objects of "task"
+ * in dimensions "first" and onwards to "p".
+ */
+static __isl_give isl_printer *print_task_deps_size(__isl_take isl_printer *p,
+	struct cpu_ast_task *task, int first)
+{
+	int i;
+
+	for (i = first; i < task->n; ++i) {
+		isl_ast_expr *expr;
+
+		expr = isl_ast_expr_list_get_ast_expr(task->size, i);
+		p = isl_printer_print_str(p, "[");
+		p = isl_printer_print_ast_expr(p, expr);
+		p = isl_printer_print_str(p, "]");
+		isl_ast_expr_free(expr);
+	}
+
+	return p;
+}
+
+/* Print the AST of "task" to "p" inside a block.
+ */
+static __isl_give isl_printer *print_task_tree(__isl_take isl_printer *p,
+	struct cpu_ast_task *task,
+	__isl_keep isl_ast_print_options *print_options)
+{
+	p = ppcg_start_block(p);
+	p = isl_ast_node_print(task->tree, p,
+				isl_ast_print_options_copy(print_options));
+	p = ppcg_end_block(p);
+
+	return p;
+}
+
+/* Print the tile loops of a band with tiles that are executed
+ * as OpenMP tasks, as represented by "task", to "p".
+ *
+ * The array of dependence objects is allocated on the heap since
+ * it contains an element for each tile.  Its elements are only used
+ * for their addresses in the depend clauses of the tasks.
+ * The program is aborted if the array cannot be allocated.
+ * The declarations of malloc, free and abort are obtained
+ * from the inclusion of <stdlib.h> printed by generate_cpu.
+ * The tile loops themselves are executed by a single thread
+ * that creates the tasks.  The implicit barrier at the end
+ * of the parallel region ensures that all tasks have completed
+ * before the array is freed.
+ */
+static __isl_give isl_printer *print_task_region(__isl_take isl_printer *p,
+	struct cpu_ast_task *task,
+	__isl_keep isl_ast_print_options *print_options)
+{
+	p = ppcg_start_block(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "char (*");
+	p = isl_printer_print_str(p, task_deps_name);
+	p = isl_printer_print_str(p, ")");
+	p = print_task_deps_size(p, task, 1);
+	p = isl_printer_print_str(p, " = malloc(sizeof(char");
+	p = print_task_deps_size(p, task, 0);
+	p = isl_printer_print_str(p, "));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "if (!");
+	p = isl_printer_print_str(p, task_deps_name);
+	p = isl_printer_print_str(p, ")");
+	p = isl_printer_end_line(p);
+	p = isl_printer_indent(p, 2);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "abort();");
+	p = isl_printer_end_line(p);
+	p = isl_printer_indent(p, -2);
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "#pragma omp parallel");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "#pragma omp single");
+	p = isl_printer_end_line(p);
+	p = print_task_tree(p, task, print_options);
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "free(");
+	p = isl_printer_print_str(p, task_deps_name);
+	p = isl_printer_print_str(p, ");");
+	p = isl_printer_end_line(p);
+	p = ppcg_end_block(p);
+
+	return p;
+}
+
+/* Print the task represented by "task" to "p".
+ *
+ * The task writes to the dependence object of its own tile and
+ * reads from the dependence objects of the tiles at each
+ * of the distances from which a dependence may reach the task.
+ * Since these tiles precede the current tile in the execution order
+ * of the tile loops, their tasks have already been created.
+ * If there is no such tile, then nothing has been written
+ * to the corresponding dependence object and the task does not
+ * need to wait.
+ */
+static __isl_give isl_printer *print_task(__isl_take isl_printer *p,
+	struct cpu_ast_task *task,
+	__isl_keep isl_ast_print_options *print_options)
+{
+	int k, n_index;
+
+	n_index = isl_ast_expr_list_n_ast_expr(task->index);
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "#pragma omp task depend(out: ");
+	p = print_task_deps_element(p, task, 0);
+	p = isl_printer_print_str(p, ")");
+	for (k = 1; k * task->n < n_index; ++k) {
+		p = isl_printer_print_str(p, k == 1 ? " depend(in: " : ", ");
+		p = print_task_deps_element(p, task, k);
+	}
+	if (n_index > task->n)
+		p = isl_printer_print_str(p, ")");
+	p = isl_printer_end_line(p);
+	p = print_task_tree(p, task, print_options);
+
+	return p;
+}
+
+/* Print a declaration of the local buffer of "array" to "p".
+ */
+static __isl_give isl_printer *print_pack_declaration(
+	__isl_take isl_printer *p, struct cpu_packed_array *array)
+{
+	int i;
+	const char *name;
+
+	name = isl_multi_aff_get_tuple_name(array->tile->tiling, isl_dim_out);
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, array->array->element_type);
+	p = isl_printer_print_str(p, " ");
+	p = isl_printer_print_str(p, name);
+	for (i = 0; i < array->tile->n; ++i) {
+		p = isl_printer_print_str(p, "[");
+		p = isl_printer_print_val(p, array->tile->bound[i].size);
+		p = isl_printer_print_str(p, "]");
+	}
+	p = isl_printer_print_str(p, ";");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print the ASTs in "list" to "p".
+ */
+static __isl_give isl_printer *print_ast_node_list(__isl_take isl_printer *p,
+	__isl_keep isl_ast_node_list *list,
+	__isl_keep isl_ast_print_options *print_options)
+{
+	int i, n;
+
+	n = isl_ast_node_list_n_ast_node(list);
+	for (i = 0; i < n; ++i) {
+		isl_ast_node *node;
+
+		node = isl_ast_node_list_get_ast_node(list, i);
+		p = isl_ast_node_print(node, p,
+				isl_ast_print_options_copy(print_options));
+		isl_ast_node_free(node);
+	}
+
+	return p;
+}
+
+/* Print the subtree with local buffers represented by "pack" to "p".
+ *
+ * The local buffers are declared inside a block around the subtree,
+ * such that each thread executing the subtree has its own buffers.
+ * They are filled before the subtree is executed and
+ * the written elements are copied back afterwards.
+ */
+static __isl_give isl_printer *print_pack(__isl_take isl_printer *p,
+	struct cpu_ast_pack *pack,
+	__isl_keep isl_ast_print_options *print_options)
+{
+	int i;
+
+	p = ppcg_start_block(p);
+	for (i = 0; i < pack->pack->n; ++i)
+		p = print_pack_declaration(p, &pack->pack->array[i]);
+	p = print_ast_node_list(p, pack->copy, print_options);
+	p = isl_ast_node_print(pack->tree, p,
+				isl_ast_print_options_copy(print_options));
+	p = print_ast_node_list(p, pack->copy_out, print_options);
+	p = ppcg_end_block(p);
+
+	return p;
+}
+
+/* Print the statement "copy" that copies an element of an array
+ * into its local buffer or back to "p".
+ */
+static __isl_give isl_printer *print_pack_copy(__isl_take isl_printer *p,
+	struct cpu_pack_copy *copy)
+{
+	p = isl_printer_start_line(p);
+	if (copy->read) {
+		p = isl_printer_print_ast_expr(p, copy->local);
+		p = isl_printer_print_str(p, " = ");
+		p = isl_printer_print_ast_expr(p, copy->global);
+	} else {
+		p = isl_printer_print_ast_expr(p, copy->global);
+		p = isl_printer_print_str(p, " = ");
+		p = isl_printer_print_ast_expr(p, copy->local);
+	}
+	p = isl_printer_print_str(p, ";");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print a user statement in the generated AST.
+ * The ppcg_stmt has been attached to the node in at_each_domain.
+ * The user node may also have been introduced by ast_build_after_mark
+ * to represent a task or a band with tiles that are executed as tasks,
+ * or a subtree with local buffers.
+ * Finally, it may be a statement that copies an element
+ * of an array into its local buffer or back.
+ */
+static __isl_give isl_printer *print_user(__isl_take isl_printer *p,
+	__isl_take isl_ast_print_options *print_options,
+	__isl_keep isl_ast_node *node, void *user)
+{
+	struct ppcg_stmt *stmt;
+	struct cpu_ast_task *task;
+	struct cpu_ast_pack *pack;
+	struct cpu_pack_copy *copy;
+	isl_id *id;
+
+	task = get_ast_task(node);
+	if (task) {
+		if (task->region)
+			p = print_task_region(p, task, print_options);
+		else
+			p = print_task(p, task, print_options);
+		isl_ast_print_options_free(print_options);
+		return p;
+	}
+	pack = get_ast_pack(node);
+	if (pack) {
+		p = print_pack(p, pack, print_options);
+		isl_ast_print_options_free(print_options);
+		return p;
+	}
+	copy = get_pack_copy(node);
+	if (copy) {
+		p = print_pack_copy(p, copy);
+		isl_ast_print_options_free(print_options);
+		return p;
+	}
+
+	id = isl_ast_node_get_annotation(node);
+	stmt = isl_id_get_user(id);
+	isl_id_free(id);
+
+	p = pet_stmt_print_body(stmt->stmt, p, stmt->ref2expr);
+
+	isl_ast_print_options_free(print_options);
+
+	return p;
+}
+
+
+/* Return the information attached to the for node "node",
+ * or NULL if "node" is not a for node or has no information attached.
+ */
+static struct ast_node_userinfo *get_for_userinfo(
+	__isl_keep isl_ast_node *node)
+{
+	isl_id *id;
+	struct ast_node_userinfo *info;
+
+	if (isl_ast_node_get_type(node) != isl_ast_node_for)
+		return NULL;
+	id = isl_ast_node_get_annotation(node);
+	if (!id)
+		return NULL;
+	info = isl_id_get_user(id);
+	isl_id_free(id);
+
+	return info;
+}
+
+/* Does "expr" involve any of the identifiers in "ids"?
+ */
+static isl_bool expr_involves_ids(__isl_keep isl_ast_expr *expr,
+	__isl_keep isl_id_list *ids)
+{
+	int i, n;
+	isl_id *id;
+	isl_bool involves = isl_bool_false;
+
+	switch (isl_ast_expr_get_type(expr)) {
+	case isl_ast_expr_id:
+		id = isl_ast_expr_get_id(expr);
+		n = isl_id_list_n_id(ids);
+		for (i = 0; i < n && !involves; ++i) {
+			isl_id *id_i = isl_id_list_get_id(ids, i);
+			involves = id == id_i;
+			isl_id_free(id_i);
+		}
+		isl_id_free(id);
+		return involves;
+	case isl_ast_expr_op:
+		n = isl_ast_expr_get_op_n_arg(expr);
+		for (i = 0; i < n && !involves; ++i) {
+			isl_ast_expr *arg = isl_ast_expr_get_op_arg(expr, i);
+			involves = expr_involves_ids(arg, ids);
+			isl_ast_expr_free(arg);
+		}
+		return involves;
+	case isl_ast_expr_int:
+		return isl_bool_false;
+	default:
+		return isl_bool_error;
+	}
+}
+
+/* Do the bounds of the for node "node" involve any
+ * of the identifiers in "ids"?
+ */
+static isl_bool for_bounds_involve_ids(__isl_keep isl_ast_node *node,
+	__isl_keep isl_id_list *ids)
+{
+	isl_ast_expr *expr;
+	isl_bool involves;
+
+	expr = isl_ast_node_for_get_init(node);
+	involves = expr_involves_ids(expr, ids);
+	isl_ast_expr_free(expr);
+	if (involves)
+		return involves;
+	expr = isl_ast_node_for_get_cond(node);
+	involves = expr_involves_ids(expr, ids);
+	isl_ast_expr_free(expr);
+
+	return involves;
+}
+
+/* Add the iterator of the for node "node" to "ids".
+ */
+static __isl_give isl_id_list *add_iterator(__isl_take isl_id_list *ids,
+	__isl_keep isl_ast_node *node)
+{
+	isl_ast_expr *iterator;
+
+	iterator = isl_ast_node_for_get_iterator(node);
+	ids = isl_id_list_add(ids, isl_ast_expr_get_id(iterator));
+	isl_ast_expr_free(iterator);
+
+	return ids;
+}
+
+/* Mark the reduction groups carried by the for node with information "info"
+ * in "carried" of size "n".
+ */
+static void add_carried_reductions(int *carried, int n,
+	struct ast_node_userinfo *info)
+{
+	int i;
+
+	if (!info->reduction)
+		return;
+	for (i = 0; i < n; ++i)
+		if (info->reduction[i])
+			carried[i] = 1;
+}
+
+/* Collect the iterators of the for nodes that can be collapsed
+ * into the openmp parallel for node "node", including that of "node"
+ * itself, and return the innermost of these for nodes in *inner.
+ * Mark the reduction groups carried by any of these for nodes
+ * in "carried" of size "n_reduction".
+ *
+ * A for node can be collapsed if it forms the entire body
+ * of the previous for node in the chain, if it does not carry
+ * any dependences (as determined by mark_openmp_parallel),
+ * if it is not degenerate (since it would then not be printed as a loop)
+ * and if its bounds do not depend on the iterators of the previous
+ * for nodes in the chain.
+ */
+static __isl_give isl_id_list *collect_collapsed_iterators(
+	__isl_keep isl_ast_node *node, __isl_give isl_ast_node **inner,
+	int *carried, int n_reduction)
+{
+	isl_ctx *ctx = isl_ast_node_get_ctx(node);
+	isl_id_list *ids;
+
+	add_carried_reductions(carried, n_reduction, get_for_userinfo(node));
+	ids = isl_id_list_alloc(ctx, 1);
+	ids = add_iterator(ids, node);
+	node = isl_ast_node_copy(node);
+	for (;;) {
+		isl_ast_node *body;
+		struct ast_node_userinfo *info;
+		isl_bool involves;
+
+		body = isl_ast_node_for_get_body(node);
+		info = get_for_userinfo(body);
+		if (!info || !info->is_parallel ||
+		    isl_ast_node_for_is_degenerate(body) != isl_bool_false) {
+			isl_ast_node_free(body);
+			break;
+		}
+		involves = for_bounds_involve_ids(body, ids);
+		if (involves != isl_bool_false) {
+			isl_ast_node_free(body);
+			break;
+		}
+		ids = add_iterator(ids, body);
+		add_carried_reductions(carried, n_reduction, info);
+		isl_ast_node_free(node);
+		node = body;
+	}
+
+	*inner = node;
+	return ids;
+}
+
+/* Data used in check_load_balance.
+ *
+ * "ids" are the iterators of the openmp parallel loop(s).
+ * "bounds" is set if the bounds of any for node involve any of "ids".
+ * "conditions" is set if the condition of any if node involves any of "ids".
+ */
+struct ppcg_load_balance_data {
+	isl_id_list *ids;
+	int bounds;
+	int conditions;
+};
+
+/* Check whether the for or if node "node" has bounds or conditions
+ * that involve any of the iterators in data->ids.
+ */
+static isl_bool check_load_balance(__isl_keep isl_ast_node *node, void *user)
+{
+	struct ppcg_load_balance_data *data = user;
+	isl_ast_expr *cond;
+
+	if (isl_ast_node_get_type(node) == isl_ast_node_for) {
+		if (for_bounds_involve_ids(node, data->ids) == isl_bool_true)
+			data->bounds = 1;
+	} else if (isl_ast_node_get_type(node) == isl_ast_node_if) {
+		cond = isl_ast_node_if_get_cond(node);
+		if (expr_involves_ids(cond, data->ids) == isl_bool_true)
+			data->conditions = 1;
+		isl_ast_expr_free(cond);
+	}
+
+	return isl_bool_true;
+}
+
+/* The chunk size of a dynamic openmp schedule.
+ * The default chunk size of a single iteration makes the overhead
+ * of handing out the iterations to the threads significant
+ * for loops with small bodies.
+ */
+#define OPENMP_DYNAMIC_CHUNK	4
+
+/* Return the openmp schedule kind for the parallel loop(s) with
+ * iterators "ids" and innermost body "body".
+ *
+ * If the bounds of the loops inside the body depend on the parallel
+ * iterators, then the amount of work varies significantly between
+ * iterations, e.g., in case of triangular loop nests, so use
+ * a dynamic schedule.  The chunk size of this schedule is printed
+ * by print_openmp_schedule.
+ * If only some conditions depend on the parallel iterators, then
+ * use a guided schedule, which balances the load while
+ * having a lower overhead than a dynamic schedule.
+ * Otherwise, use a static schedule.
+ */
+static const char *openmp_schedule(__isl_keep isl_ast_node *body,
+	__isl_keep isl_id_list *ids)
+{
+	struct ppcg_load_balance_data data = { ids, 0, 0 };
+
+	if (isl_ast_node_foreach_descendant_top_down(body,
+					&check_load_balance, &data) < 0)
+		return "static";
+	if (data.bounds)
+		return "dynamic";
+	if (data.conditions)
+		return "guided";
+	return "static";
+}
+
+/* Print a schedule clause for the parallel loop(s) with
+ * iterators "ids" and innermost body "body", with the kind
+ * selected by openmp_schedule.
+ */
+static __isl_give isl_printer *print_openmp_schedule(
+	__isl_take isl_printer *p, __isl_keep isl_ast_node *body,
+	__isl_keep isl_id_list *ids)
+{
+	const char *kind;
+
+	kind = openmp_schedule(body, ids);
+	p = isl_printer_print_str(p, " schedule(");
+	p = isl_printer_print_str(p, kind);
+	if (!strcmp(kind, "dynamic")) {
+		p = isl_printer_print_str(p, ", ");
+		p = isl_printer_print_int(p, OPENMP_DYNAMIC_CHUNK);
+	}
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
+
+/* Print a reduction clause for each reduction group
+ * in build_info->reductions for which "carried" is set.
+ */
+static __isl_give isl_printer *print_reduction_clauses(
+	__isl_take isl_printer *p, struct ast_build_userinfo *build_info,
+	int *carried)
+{
+	struct ppcg_reductions *reductions = build_info->reductions;
+	int i;
+
+	if (!reductions || !carried)
+		return p;
+
+	for (i = 0; i < reductions->n; ++i) {
+		isl_ast_build *build;
+
+		if (!carried[i])
+			continue;
+		build = isl_ast_build_from_context(
+				isl_set_copy(build_info->scop->context));
+		p = ppcg_print_reduction_clause(p, &reductions->group[i],
+						build);
+		isl_ast_build_free(build);
+	}
+
+	return p;
+}
+
+/* Print a for loop node as an openmp parallel loop.
+ *
+ * To print an openmp parallel loop we print a normal for loop, but add
+ * "#pragma openmp parallel for" in front.
+ * If the loop is part of a sequence of openmp loops that are executed
+ * inside a single parallel region (see mark_openmp_regions), then
+ * print "#pragma omp for" instead and print the start or
+ * the end of the parallel region if the loop starts or ends the sequence.
+ *
+ * Any perfectly nested parallel loops are collapsed
+ * into the openmp parallel loop.  If the openmp_schedule option is set,
+ * then a schedule clause is derived from the dependence of the bounds
+ * inside the loop(s) on the parallel iterators.
+ * A reduction clause is printed for each reduction group
+ * in build_info->reductions that is carried by any of the collapsed loops.
+ * If the innermost of the collapsed loops has been marked as a simd loop,
+ * then the combined loop is executed as a simd loop.
+ * The innermost loop is then kept track of in build_info->collapsed_simd
+ * while the loops are printed such that print_for does not print
+ * the simd pragma again when it prints this loop.
+ *
+ * Variables that are declared within the body of this for loop are
+ * automatically openmp 'private'. Iterators declared outside of the
+ * for loop are automatically openmp 'shared'. As ppcg declares all iterators
+ * at the position where they are assigned, there is no need to explicitly mark
+ * variables. Their automatically assigned type is already correct.
+ *
+ * This function only generates valid OpenMP code, if the ast was generated
+ * with the 'atomic-bounds' option enabled.
+ *
+ */
+static __isl_give isl_printer *print_for_with_openmp(
+	__isl_keep isl_ast_node *node, __isl_take isl_printer *p,
+	__isl_take isl_ast_print_options *print_options,
+	struct ast_node_userinfo *info, struct ast_build_userinfo *build_info)
+{
+	isl_ctx *ctx = isl_ast_node_get_ctx(node);
+	struct ppcg_reductions *reductions = build_info->reductions;
+	isl_id_list *ids;
+	struct ast_node_userinfo *inner_info;
+	isl_ast_node *inner, *body;
+	int n, n_reduction, simd;
+	int *carried = NULL;
+
+	n_reduction = reductions ? reductions->n : 0;
+	if (n_reduction > 0) {
+		carried = isl_calloc_array(ctx, int, n_reduction);
+		if (!carried) {
+			isl_ast_print_options_free(print_options);
+			return isl_printer_free(p);
+		}
+	}
+	ids = collect_collapsed_iterators(node, &inner, carried, n_reduction);
+	n = isl_id_list_n_id(ids);
+	body = isl_ast_node_for_get_body(inner);
+	inner_info = get_for_userinfo(inner);
+	simd = inner_info->simd;
+
+	if (info->region_start) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "#pragma omp parallel");
+		p = isl_printer_end_line(p);
+		p = ppcg_start_block(p);
+	}
+
+	p = isl_printer_start_line(p);
+	if (info->in_region)
+		p = isl_printer_print_str(p, "#pragma omp for");
+	else
+		p = isl_printer_print_str(p, "#pragma omp parallel for");
+	if (simd)
+		p = isl_printer_print_str(p, " simd");
+	if (n > 1) {
+		p = isl_printer_print_str(p, " collapse(");
+		p = isl_printer_print_int(p, n);
+		p = isl_printer_print_str(p, ")");
+	}
+	if (build_info->scop->options->openmp_schedule)
+		p = print_openmp_schedule(p, body, ids);
+	p = print_reduction_clauses(p, build_info, carried);
+	if (info->nowait)
+		p = isl_printer_print_str(p, " nowait");
+	p = isl_printer_end_line(p);
+
+	free(carried);
+	isl_ast_node_free(body);
+	isl_id_list_free(ids);
+
+	if (simd)
+		build_info->collapsed_simd = inner;
+	p = isl_ast_node_for_print(node, p, print_options);
+	build_info->collapsed_simd = NULL;
+	isl_ast_node_free(inner);
+
+	if (info->region_end)
+		p = ppcg_end_block(p);
+
+	return p;
+}
+
+/* Print the for node "node", which has been marked as a simd loop,
+ * preceded by an openmp simd pragma.
+ * The pragma includes a safelen clause if the loop carries dependences
+ * and a reduction clause for each reduction group
+ * in build_info->reductions that is carried by the loop.
+ */
+static __isl_give isl_printer *print_for_with_simd(
+	__isl_keep isl_ast_node *node, __isl_take isl_printer *p,
+	__isl_take isl_ast_print_options *print_options,
+	struct ast_node_userinfo *info, struct ast_build_userinfo *build_info)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "#pragma omp simd");
+	if (info->safelen > 0) {
+		p = isl_printer_print_str(p, " safelen(");
+		p = isl_printer_print_int(p, info->safelen);
+		p = isl_printer_print_str(p, ")");
+	}
+	p = print_reduction_clauses(p, build_info, info->reduction);
+	p = isl_printer_end_line(p);
+
+	return isl_ast_node_for_print(node, p, print_options);
+}
+
+/* Print a for node that is executed as a whole inside
+ * an openmp parallel region.
+ */
+static __isl_give isl_printer *print_for_in_openmp_region(
+	__isl_keep isl_ast_node *node, __isl_take isl_printer *p,
+	__isl_take isl_ast_print_options *print_options)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "#pragma omp parallel");
+	p = isl_printer_end_line(p);
+	p = ppcg_start_block(p);
+	p = isl_ast_node_for_print(node, p, print_options);
+	p = ppcg_end_block(p);
+
+	return p;
+}
+
+/* Is "node" the innermost loop of the collapsed loops
+ * of the openmp parallel for node that is being printed,
+ * with its simd mark already printed as part of the pragma
+ * of the openmp parallel for node?
+ * "user" is the ast_build_userinfo passed to print_for, if any.
+ */
+static int is_collapsed_simd(__isl_keep isl_ast_node *node, void *user)
+{
+	struct ast_build_userinfo *build_info = user;
+
+	return build_info && build_info->collapsed_simd == node;
+}
+
+/* Print a for node.
+ *
+ * Depending on how the node is annotated, we either print a normal
+ * for node, a for node inside an openmp parallel region,
+ * an openmp simd loop or an openmp parallel for node.
+ * In the latter two cases, "user" points to the ast_build_userinfo
+ * that was used during the construction of the AST.
+ */
+static __isl_give isl_printer *print_for(__isl_take isl_printer *p,
+	__isl_take isl_ast_print_options *print_options,
+	__isl_keep isl_ast_node *node, void *user)
+{
+	struct ast_node_userinfo *info;
+
+	info = get_for_userinfo(node);
+
+	if (info && info->is_openmp)
+		p = print_for_with_openmp(node, p, print_options, info, user);
+	else if (info && info->hoisted)
+		p = print_for_in_openmp_region(node, p, print_options);
+	else if (info && info->simd && !is_collapsed_simd(node, user))
+		p = print_for_with_simd(node, p, print_options, info, user);
+	else
+		p = isl_ast_node_for_print(node, p, print_options);
+
+	return p;
+}
+
+/* Data used in pullback_index.
+ *
+ * "iterator_map" expresses the statement iterators in terms of
+ * AST loop iterators.
+ * "pack" describes the arrays that are packed inside the tile
+ * containing the statement, if any.
+ * "private_pack" describes the arrays with elements that are kept
+ * in local variables inside the innermost loop containing the statement,
+ * if any.
+ */
+struct ppcg_transform_data {
+	isl_pw_multi_aff *iterator_map;
+	struct cpu_pack *pack;
+	struct cpu_pack *private_pack;
+};
+
+/* Return the element of "pack" that refers to the array
+ * identified by "id", or NULL if there is no such element.
+ */
+static struct cpu_packed_array *find_packed_array(struct cpu_pack *pack,
+	__isl_keep isl_id *id)
+{
+	int i;
+
+	for (i = 0; i < pack->n; ++i) {
+		isl_id *id_i;
+
+		id_i = isl_set_get_tuple_id(pack->array[i].array->extent);
+		isl_id_free(id_i);
+		if (id_i == id)
+			return &pack->array[i];
+	}
+
+	return NULL;
+}
+
+/* Make the index expression "index", expressed in terms
+ * of the AST loop iterators, refer to the local buffer of "array".
+ *
+ * The index is of the form
+ *
+ *	L -> A
+ *
+ * while the tiling is of the form
+ *
+ *	[D -> A] -> T
+ *
+ * where D corresponds to the outer "depth" dimensions of L.
+ * Modify the index to keep track of these outer dimensions
+ *
+ *	L -> [D -> A]
+ *
+ * and combine the result with the tiling to obtain
+ *
+ *	L -> T
+ */
+static __isl_give isl_multi_pw_aff *tile_index(
+	__isl_take isl_multi_pw_aff *index, struct cpu_packed_array *array,
+	int depth)
+{
+	int dim;
+	isl_space *space;
+	isl_multi_aff *ma;
+	isl_multi_pw_aff *tiling;
+
+	space = isl_space_domain(isl_multi_pw_aff_get_space(index));
+	dim = isl_space_dim(space, isl_dim_set);
+	space = isl_space_map_from_set(space);
+	ma = isl_multi_aff_identity(space);
+	ma = isl_multi_aff_drop_dims(ma, isl_dim_out, depth, dim - depth);
+	ma = isl_multi_aff_reset_tuple_id(ma, isl_dim_out);
+	index = isl_multi_pw_aff_range_product(
+				isl_multi_pw_aff_from_multi_aff(ma), index);
+	tiling = isl_multi_pw_aff_from_multi_aff(
+				isl_multi_aff_copy(array->tile->tiling));
+
+	return isl_multi_pw_aff_pullback_multi_pw_aff(tiling, index);
+}
+
+/* If "index", expressed in terms of the AST loop iterators,
+ * accesses an element of one of the arrays in "pack", if any,
+ * then make it refer to the corresponding element of the local buffer.
+ * Otherwise, return "index" unchanged.
+ * In particular, an index expression that refers to an entire row
+ * of an array is left untouched.  The arrays are selected
+ * such that this can only happen for arrays that are not written.
+ */
+static __isl_give isl_multi_pw_aff *pack_index(
+	__isl_take isl_multi_pw_aff *index, struct cpu_pack *pack)
+{
+	struct cpu_packed_array *array;
+	isl_id *array_id;
+
+	if (!pack)
+		return index;
+	if (!isl_multi_pw_aff_has_tuple_id(index, isl_dim_out))
+		return index;
+	array_id = isl_multi_pw_aff_get_tuple_id(index, isl_dim_out);
+	array = find_packed_array(pack, array_id);
+	isl_id_free(array_id);
+	if (!array || isl_multi_pw_aff_dim(index, isl_dim_out) !=
+			isl_multi_aff_dim(array->tile->tiling, isl_dim_out))
+		return index;
+
+	return tile_index(index, array, pack->depth);
+}
+
+/* Index transformation callback for pet_stmt_build_ast_exprs.
+ *
+ * "index" expresses the array indices in terms of statement iterators
+ *
+ * The result expresses the array indices in terms of
+ * AST loop iterators.
+ * If the statement is executed inside an innermost loop
+ * with array elements that are kept in local variables or
+ * inside a tile with packed arrays and if "index" accesses
+ * an element of one of those arrays, then the result refers
+ * to the corresponding element of the local buffer instead.
+ * The local variables are considered first since they
+ * may hold values that are not yet available in the original array.
+ * An element of a local variable does not refer
+ * to any of the packed arrays.
+ */
+static __isl_give isl_multi_pw_aff *pullback_index(
+	__isl_take isl_multi_pw_aff *index, __isl_keep isl_id *id, void *user)
+{
+	struct ppcg_transform_data *data = user;
+	isl_pw_multi_aff *iterator_map;
+
+	iterator_map = isl_pw_multi_aff_copy(data->iterator_map);
+	index = isl_multi_pw_aff_pullback_pw_multi_aff(index, iterator_map);
+
+	index = pack_index(index, data->private_pack);
+	index = pack_index(index, data->pack);
+
+	return index;
+}
+
+/* Transform the accesses in the statement associated to the domain
+ * called by "node" to refer to the AST loop iterators, construct
+ * corresponding AST expressions using "build",
+ * collect them in a ppcg_stmt and annotate the node with the ppcg_stmt.
+ * Inside a subtree with local buffers, the accesses to the corresponding
+ * arrays refer to these local buffers.
+ */
+static __isl_give isl_ast_node *at_each_domain(__isl_take isl_ast_node *node,
+	__isl_keep isl_ast_build *build, void *user)
+{
+	struct ast_build_userinfo *build_info = user;
+	struct ppcg_scop *scop = build_info->scop;
+	struct ppcg_transform_data data;
+	isl_ast_expr *expr, *arg;
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_map *map;
+	struct ppcg_stmt *stmt;
+
+	ctx = isl_ast_node_get_ctx(node);
+	stmt = isl_calloc_type(ctx, struct ppcg_stmt);
+	if (!stmt)
+		goto error;
+
+	expr = isl_ast_node_user_get_expr(node);
+	arg = isl_ast_expr_get_op_arg(expr, 0);
+	isl_ast_expr_free(expr);
+	id = isl_ast_expr_get_id(arg);
+	isl_ast_expr_free(arg);
+	stmt->stmt = find_stmt(scop, id);
+	isl_id_free(id);
+	if (!stmt->stmt)
+		goto error;
+
+	map = isl_map_from_union_map(isl_ast_build_get_schedule(build));
+	map = isl_map_reverse(map);
+	data.iterator_map = isl_pw_multi_aff_from_map(map);
+	data.pack = build_info->pack;
+	data.private_pack = build_info->private_pack;
+	stmt->ref2expr = pet_stmt_build_ast_exprs(stmt->stmt, build,
+				    &pullback_index, &data, NULL, NULL);
+	isl_pw_multi_aff_free(data.iterator_map);
+
+	id = isl_id_alloc(isl_ast_node_get_ctx(node), NULL, stmt);
+	id = isl_id_set_free_user(id, &ppcg_stmt_free);
+	return isl_ast_node_set_annotation(node, id);
+error:
+	ppcg_stmt_free(stmt);
+	return isl_ast_node_free(node);
+}
+
+/* Set *depth (initialized to 0 by the caller) to the maximum
+ * of the schedule depths of the leaf nodes for which this function is called.
+ */
+static isl_bool update_depth(__isl_keep isl_schedule_node *node, void *user)
+{
+	int *depth = user;
+	int node_depth;
+
+	if (isl_schedule_node_get_type(node) != isl_schedule_node_leaf)
+		return isl_bool_true;
+	node_depth = isl_schedule_node_get_schedule_depth(node);
+	if (node_depth > *depth)
+		*depth = node_depth;
+
+	return isl_bool_false;
+}
+
+/* Print the macro definitions required for the AST expressions
+ * in "list", if any, to "p".
+ */
+static __isl_give isl_printer *print_expr_list_macros(
+	__isl_take isl_printer *p, __isl_keep isl_ast_expr_list *list)
+{
+	int i, n;
+
+	if (!list)
+		return p;
+	n = isl_ast_expr_list_n_ast_expr(list);
+	for (i = 0; i < n; ++i) {
+		isl_ast_expr *expr;
+
+		expr = isl_ast_expr_list_get_ast_expr(list, i);
+		p = ppcg_ast_expr_print_macros(expr, p);
+		isl_ast_expr_free(expr);
+	}
+
+	return p;
+}
+
+/* This function is called for each node in a CPU AST.
+ * In case of a user node, print the macro definitions required
+ * for printing the AST expressions in the annotation, if any.
+ * For other nodes, return true such that descendants are also
+ * visited.
+ *
+ * In particular, print the macro definitions needed for the substitutions
+ * of the original user statements.
+ * For a user node introduced by ast_build_after_mark, print the macro
+ * definitions needed for the AST expressions and the ASTs it contains.
+ * For a statement that copies an element of a packed array,
+ * print those needed for the two AST expressions.
+ */
+static isl_bool at_node(__isl_keep isl_ast_node *node, void *user)
+{
+	struct ppcg_stmt *stmt;
+	struct cpu_ast_task *task;
+	struct cpu_ast_pack *pack;
+	struct cpu_pack_copy *copy;
+	isl_id *id;
+	isl_printer **p = user;
+
+	if (isl_ast_node_get_type(node) != isl_ast_node_user)
+		return isl_bool_true;
+
+	task = get_ast_task(node);
+	if (task) {
+		if (isl_ast_node_foreach_descendant_top_down(task->tree,
+							&at_node, p) < 0)
+			return isl_bool_error;
+		*p = ppcg_print_macros(*p, task->tree);
+		*p = print_expr_list_macros(*p, task->lower);
+		*p = print_expr_list_macros(*p, task->size);
+		*p = print_expr_list_macros(*p, task->index);
+		return *p ? isl_bool_false : isl_bool_error;
+	}
+	pack = get_ast_pack(node);
+	if (pack) {
+		int i, j, n;
+		isl_ast_node_list *list[2] = { pack->copy, pack->copy_out };
+
+		for (j = 0; j < 2; ++j) {
+			n = isl_ast_node_list_n_ast_node(list[j]);
+			for (i = 0; i < n; ++i) {
+				isl_ast_node *copy;
+				isl_stat r;
+
+				copy = isl_ast_node_list_get_ast_node(list[j],
+									i);
+				r = isl_ast_node_foreach_descendant_top_down(
+						copy, &at_node, p);
+				*p = ppcg_print_macros(*p, copy);
+				isl_ast_node_free(copy);
+				if (r < 0)
+					return isl_bool_error;
+			}
+		}
+		if (isl_ast_node_foreach_descendant_top_down(pack->tree,
+							&at_node, p) < 0)
+			return isl_bool_error;
+		*p = ppcg_print_macros(*p, pack->tree);
+		return *p ? isl_bool_false : isl_bool_error;
+	}
+	copy = get_pack_copy(node);
+	if (copy) {
+		*p = ppcg_ast_expr_print_macros(copy->local, *p);
+		*p = ppcg_ast_expr_print_macros(copy->global, *p);
+		return *p ? isl_bool_false : isl_bool_error;
+	}
+
+	id = isl_ast_node_get_annotation(node);
+	stmt = isl_id_get_user(id);
+	isl_id_free(id);
+
+	if (!stmt)
+		return isl_bool_error;
+
+	*p = ppcg_print_body_macros(*p, stmt->ref2expr);
+	if (!*p)
+		return isl_bool_error;
+
+	return isl_bool_false;
+}
+
+/* Print the required macros for the CPU AST "node" to "p",
+ * including those needed for the user statements inside the AST.
+ */
+static __isl_give isl_printer *cpu_print_macros(__isl_take isl_printer *p,
+	__isl_keep isl_ast_node *node)
+{
+	if (isl_ast_node_foreach_descendant_top_down(node, &at_node, &p) < 0)
+		return isl_printer_free(p);
+	p = ppcg_print_macros(p, node);
+	return p;
+}
+
+/* Initialize the fields of "build_info".
+ *
+ * Initially, the AST generation is not inside any parallel for loop.
+ *
+ * The contraction of the entire schedule tree is extracted
+ * right underneath the root node.
+ *
+ * The dependences that need to be respected by parallel loops
+ * are collected once here rather than for each loop.
+ * If the live_range_reordering option is set, then this currently
+ * includes the order dependences.  In principle, non-zero order dependences
+ * could be allowed, but this would require privatization and/or expansion.
+ *
+ * If the openmp_reductions option is set, then the reduction groups
+ * are extracted from the scop and the dependences between instances
+ * of the same group are removed from the dependences that need
+ * to be respected by parallel loops.  They are handled by
+ * reduction clauses instead.
+ */
+static isl_stat init_build_info(struct ast_build_userinfo *build_info,
+	struct ppcg_scop *scop, __isl_keep isl_schedule *schedule)
+{
+	isl_schedule_node *node = isl_schedule_get_root(schedule);
+	isl_union_map *deps;
+
+	node = isl_schedule_node_child(node, 0);
+
+	build_info->scop = scop;
+	build_info->in_parallel_for = 0;
+	build_info->collapsed_simd = NULL;
+	build_info->contraction =
+		isl_schedule_node_get_subtree_contraction(node);
+
+	isl_schedule_node_free(node);
+
+	deps = isl_union_map_copy(scop->dep_flow);
+	deps = isl_union_map_union(deps, isl_union_map_copy(scop->dep_false));
+	if (scop->options->live_range_reordering) {
+		isl_union_map *order = isl_union_map_copy(scop->dep_order);
+		deps = isl_union_map_union(deps, order);
+	}
+	build_info->reductions = NULL;
+	if (scop->options->openmp_reductions) {
+		int i;
+
+		build_info->reductions =
+			ppcg_scop_extract_reductions(scop, deps);
+		if (!build_info->reductions)
+			deps = isl_union_map_free(deps);
+		for (i = 0; deps && i < build_info->reductions->n; ++i) {
+			isl_union_map *group_deps;
+
+			group_deps = build_info->reductions->group[i].deps;
+			deps = isl_union_map_subtract(deps,
+					isl_union_map_copy(group_deps));
+		}
+	}
+	build_info->deps = deps;
+	build_info->n_active = 0;
+	build_info->active = NULL;
+	build_info->task_band = NULL;
+
+	if (!build_info->contraction || !build_info->deps)
+		return isl_stat_error;
+	return isl_stat_ok;
+}
+
+/* Clear all memory allocated by "build_info".
+ */
+static void clear_build_info(struct ast_build_userinfo *build_info)
+{
+	int i;
+
+	isl_union_pw_multi_aff_free(build_info->contraction);
+	ppcg_reductions_free(build_info->reductions);
+	isl_union_map_free(build_info->deps);
+	for (i = 0; i < build_info->n_active; ++i) {
+		isl_union_set_free(build_info->active[i].domain);
+		isl_union_map_free(build_info->active[i].deps);
+	}
+	free(build_info->active);
+}
+
+/* Data used in mark_openmp_regions.
+ *
+ * "deps" are all dependences between statement instances,
+ * including those of the reduction groups.
+ */
+struct ppcg_openmp_region_data {
+	isl_union_map *deps;
+};
+
+/* Return all dependences between statement instances,
+ * i.e., build_info->deps along with the dependences
+ * of the reduction groups.
+ */
+static __isl_give isl_union_map *all_deps(
+	struct ast_build_userinfo *build_info)
+{
+	struct ppcg_reductions *reductions = build_info->reductions;
+	isl_union_map *deps;
+	int i;
+
+	deps = isl_union_map_copy(build_info->deps);
+	for (i = 0; reductions && i < reductions->n; ++i)
+		deps = isl_union_map_union(deps,
+			    isl_union_map_copy(reductions->group[i].deps));
+
+	return deps;
+}
+
+/* Are there any dependences in "deps" from an instance in "src"
+ * to an instance in "dst"?
+ */
+static isl_bool has_deps_between(__isl_keep isl_union_map *deps,
+	__isl_keep isl_union_set *src, __isl_keep isl_union_set *dst)
+{
+	isl_union_map *test;
+	isl_bool empty;
+
+	test = isl_union_map_copy(deps);
+	test = isl_union_map_intersect_domain(test, isl_union_set_copy(src));
+	test = isl_union_map_intersect_range(test, isl_union_set_copy(dst));
+	empty = isl_union_map_is_empty(test);
+	isl_union_map_free(test);
+
+	return isl_bool_not(empty);
+}
+
+/* Mark the sequence of "n" consecutive openmp parallel for nodes
+ * in "info" as being executed inside an enclosing openmp parallel region
+ * and remove the implicit barriers at the end of the loops
+ * where they are not needed, except at the end of the last loop.
+ *
+ * The barrier at the end of a loop can be removed if there are
+ * no dependences from any instance executed since the previous barrier
+ * to any instance of the next loop.
+ */
+static isl_stat mark_nowait(struct ppcg_openmp_region_data *data,
+	int n, struct ast_node_userinfo **info)
+{
+	int i;
+	isl_union_set *segment;
+
+	for (i = 0; i < n; ++i)
+		info[i]->in_region = 1;
+
+	segment = isl_union_set_copy(info[0]->domain);
+	for (i = 0; i + 1 < n; ++i) {
+		isl_bool deps;
+
+		deps = has_deps_between(data->deps, segment,
+					info[i + 1]->domain);
+		if (deps < 0)
+			break;
+		if (deps) {
+			isl_union_set_free(segment);
+			segment = isl_union_set_copy(info[i + 1]->domain);
+		} else {
+			info[i]->nowait = 1;
+			segment = isl_union_set_union(segment,
+				    isl_union_set_copy(info[i + 1]->domain));
+		}
+	}
+	isl_union_set_free(segment);
+
+	return i + 1 < n ? isl_stat_error : isl_stat_ok;
+}
+
+/* Mark the sequence of "n" consecutive openmp parallel for nodes
+ * in "info" as being executed inside a single openmp parallel region
+ * that starts at the first loop and ends at the last loop and
+ * remove the implicit barriers at the end of the loops
+ * where they are not needed.
+ * The barrier at the end of the last loop can always be removed
+ * since there is an implicit barrier at the end of the parallel region.
+ */
+static isl_stat mark_openmp_region(struct ppcg_openmp_region_data *data,
+	int n, struct ast_node_userinfo **info)
+{
+	info[0]->region_start = 1;
+	info[n - 1]->region_end = 1;
+	info[n - 1]->nowait = 1;
+
+	return mark_nowait(data, n, info);
+}
+
+/* Look for sequences of consecutive children of the block node "node"
+ * that are openmp parallel for nodes.
+ * If "hoisted" is set, then "node" is executed inside an enclosing
+ * openmp parallel region and the barriers between the loops
+ * in each sequence are removed where possible.
+ * Otherwise, mark each sequence of at least two such loops
+ * as being executed inside a single openmp parallel region.
+ * This avoids starting a new team of threads for each of the loops and
+ * allows the barriers between independent loops to be removed.
+ */
+static isl_stat mark_openmp_runs(struct ppcg_openmp_region_data *data,
+	__isl_keep isl_ast_node *node, int hoisted)
+{
+	isl_ast_node_list *children;
+	struct ast_node_userinfo **info;
+	int i, n, n_run;
+	isl_stat r = isl_stat_ok;
+
+	children = isl_ast_node_block_get_children(node);
+	n = isl_ast_node_list_n_ast_node(children);
+	info = isl_calloc_array(isl_ast_node_get_ctx(node),
+				struct ast_node_userinfo *, n);
+	if (n > 0 && !info)
+		r = isl_stat_error;
+
+	n_run = 0;
+	for (i = 0; r >= 0 && i <= n; ++i) {
+		struct ast_node_userinfo *child_info = NULL;
+
+		if (i < n) {
+			isl_ast_node *child;
+
+			child = isl_ast_node_list_get_ast_node(children, i);
+			child_info = get_for_userinfo(child);
+			isl_ast_node_free(child);
+		}
+		if (child_info && child_info->is_openmp) {
+			info[n_run++] = child_info;
+			continue;
+		}
+		if (hoisted && n_run >= 1)
+			r = mark_nowait(data, n_run, info);
+		else if (n_run >= 2)
+			r = mark_openmp_region(data, n_run, info);
+		n_run = 0;
+	}
+
+	free(info);
+	isl_ast_node_list_free(children);
+
+	return r;
+}
+
+/* Data used in check_hoistable.
+ *
+ * "n_openmp" is the number of openmp parallel for nodes encountered.
+ * "n_user" is the number of user nodes encountered outside
+ * of openmp parallel for nodes.
+ */
+struct ppcg_hoist_data {
+	int n_openmp;
+	int n_user;
+};
+
+/* Update the counts in "user" with "node" and
+ * skip the descendants of openmp parallel for nodes.
+ */
+static isl_bool check_hoistable(__isl_keep isl_ast_node *node, void *user)
+{
+	struct ppcg_hoist_data *data = user;
+	struct ast_node_userinfo *info;
+
+	info = get_for_userinfo(node);
+	if (info && info->is_openmp) {
+		data->n_openmp++;
+		return isl_bool_false;
+	}
+	if (isl_ast_node_get_type(node) == isl_ast_node_user)
+		data->n_user++;
+
+	return isl_bool_true;
+}
+
+/* Can the for node "node", which is not an openmp parallel for node,
+ * be executed as a whole inside an openmp parallel region?
+ *
+ * This is the case if every statement inside "node" is executed
+ * inside an openmp parallel for node, since every thread then executes
+ * the remaining control flow and encounters the same worksharing loops
+ * in the same order.  Only do this if there is at least one such loop.
+ */
+static isl_bool is_hoistable(__isl_keep isl_ast_node *node)
+{
+	struct ppcg_hoist_data data = { 0, 0 };
+
+	if (isl_ast_node_foreach_descendant_top_down(node,
+					&check_hoistable, &data) < 0)
+		return isl_bool_error;
+
+	return data.n_openmp > 0 && data.n_user == 0;
+}
+
+/* Mark "node", which is a descendant of a for node around which
+ * an openmp parallel region is created, as being executed inside
+ * that region.  In particular, mark the openmp parallel for nodes
+ * as such and remove barriers between consecutive loops where possible.
+ * The barrier at the end of the last loop of a sequence is kept since
+ * the code that follows in the same thread (possibly in the next iteration
+ * of an outer sequential loop) may depend on the results of all threads.
+ */
+static isl_bool mark_hoisted(__isl_keep isl_ast_node *node, void *user)
+{
+	struct ppcg_openmp_region_data *data = user;
+	struct ast_node_userinfo *info;
+
+	info = get_for_userinfo(node);
+	if (info && info->is_openmp) {
+		info->in_region = 1;
+		return isl_bool_false;
+	}
+	if (isl_ast_node_get_type(node) != isl_ast_node_block)
+		return isl_bool_true;
+	if (mark_openmp_runs(data, node, 1) < 0)
+		return isl_bool_error;
+
+	return isl_bool_true;
+}
+
+/* Determine the openmp parallel regions.
+ * This is only performed if the openmp_regions option is set.
+ * Otherwise, each openmp parallel for node is printed
+ * with its own parallel region.
+ *
+ * If "node" is a for node that is not an openmp parallel for node,
+ * but that contains openmp parallel for nodes, e.g., a sequential
+ * time loop around parallel loops, and if it can be executed
+ * inside an openmp parallel region, then create the region around "node",
+ * such that the team of threads is only started once rather than
+ * in every iteration of "node".
+ * The openmp parallel for nodes inside "node" are then printed
+ * as worksharing loops.
+ *
+ * If "node" is a block node, then look for sequences of consecutive
+ * openmp parallel for nodes that can share a parallel region.
+ */
+static isl_bool mark_openmp_regions(__isl_keep isl_ast_node *node, void *user)
+{
+	struct ppcg_openmp_region_data *data = user;
+	struct ast_node_userinfo *info;
+	isl_bool hoistable;
+
+	info = get_for_userinfo(node);
+	if (info && info->is_openmp)
+		return isl_bool_false;
+	if (info) {
+		hoistable = is_hoistable(node);
+		if (hoistable < 0)
+			return isl_bool_error;
+		if (!hoistable)
+			return isl_bool_true;
+		info->hoisted = 1;
+		if (isl_ast_node_foreach_descendant_top_down(node,
+						&mark_hoisted, data) < 0)
+			return isl_bool_error;
+		return isl_bool_false;
+	}
+
+	if (isl_ast_node_get_type(node) != isl_ast_node_block)
+		return isl_bool_true;
+	if (mark_openmp_runs(data, node, 0) < 0)
+		return isl_bool_error;
+
+	return isl_bool_true;
+}
+
+/* Code generate the scop 'scop' using "schedule"
+ * and print the corresponding C code to 'p'.
+ */
+static __isl_give isl_printer *print_scop(struct ppcg_scop *scop,
+	__isl_take isl_schedule *schedule, __isl_take isl_printer *p,
+	struct ppcg_options *options)
+{
+	isl_ctx *ctx = isl_printer_get_ctx(p);
+	isl_ast_build *build;
+	isl_ast_print_options *print_options;
+	isl_ast_node *tree;
+	isl_id_list *iterators;
+	struct ast_build_userinfo build_info;
+	int depth;
+
+	depth = 0;
+	if (isl_schedule_foreach_schedule_node_top_down(schedule, &update_depth,
+						&depth) < 0)
+		goto error;
+
+	build = isl_ast_build_alloc(ctx);
+	iterators = ppcg_scop_generate_names(scop, depth, "c");
+	build = isl_ast_build_set_iterators(build, iterators);
+	build_info.scop = scop;
+	build_info.task_band = NULL;
+	build_info.pack = NULL;
+	build_info.private_pack = NULL;
+	build = isl_ast_build_set_at_each_domain(build, &at_each_domain,
+							&build_info);
+
+	if (options->openmp) {
+		if (init_build_info(&build_info, scop, schedule) < 0)
+			build = isl_ast_build_free(build);
+
+		build = isl_ast_build_set_before_each_for(build,
+							&ast_build_before_for,
+							&build_info);
+		build = isl_ast_build_set_after_each_for(build,
+							&ast_build_after_for,
+							&build_info);
+	}
+	if (options->openmp || options->pack_arrays ||
+	    options->scalar_replacement) {
+		build = isl_ast_build_set_before_each_mark(build,
+							&ast_build_before_mark,
+							&build_info);
+		build = isl_ast_build_set_after_each_mark(build,
+							&ast_build_after_mark,
+							&build_info);
+	}
+
+	ppcg_profile_start(options->profile, "ast_generation");
+	tree = isl_ast_build_node_from_schedule(build, schedule);
+	isl_ast_build_free(build);
+	ppcg_profile_end(options->profile);
+
+	if (options->openmp && options->openmp_regions) {
+		struct ppcg_openmp_region_data data;
+
+		data.deps = all_deps(&build_info);
+		if (isl_ast_node_foreach_descendant_top_down(tree,
+					&mark_openmp_regions, &data) < 0)
+			tree = isl_ast_node_free(tree);
+		isl_union_map_free(data.deps);
+	}
+
+	print_options = isl_ast_print_options_alloc(ctx);
+	print_options = isl_ast_print_options_set_print_user(print_options,
+							&print_user, NULL);
+
+	print_options = isl_ast_print_options_set_print_for(print_options,
+			&print_for, options->openmp ? &build_info : NULL);
+
+	ppcg_profile_start(options->profile, "printing");
+	p = cpu_print_macros(p, tree);
+	p = isl_ast_node_print(tree, p, print_options);
+	ppcg_profile_end(options->profile);
+
+	if (options->openmp)
+		clear_build_info(&build_info);
+
+	isl_ast_node_free(tree);
+
+	return p;
+error:
+	isl_schedule_free(schedule);
+	isl_printer_free(p);
+	return NULL;
+}
+
+/* Express the partial schedule "mupa", defined over the domain
+ * of "node", in terms of the expanded domains.
+ * As explained in ast_schedule_dim_is_parallel, the dependences and
+ * the access relations are formulated in terms of the expanded domains.
+ */
+static __isl_give isl_multi_union_pw_aff *expand_schedule(
+	__isl_keep isl_schedule_node *node,
+	__isl_take isl_multi_union_pw_aff *mupa)
+{
+	isl_union_pw_multi_aff *contraction;
+
+	contraction = isl_schedule_node_get_subtree_contraction(node);
+	return isl_multi_union_pw_aff_pullback_union_pw_multi_aff(mupa,
+								contraction);
+}
+
+/* Data used in count_unit_stride_ref.
+ *
+ * "step" maps statement instances to the statement instances
+ * that are executed in the next iteration of the schedule dimension
+ * under consideration.
+ * "count" is the number of references encountered so far
+ * that access consecutive array elements in consecutive iterations.
+ */
+struct ppcg_stride_data {
+	isl_union_map *step;
+	int count;
+};
+
+/* Increment data->count if the tagged access relation "tagged",
+ * corresponding to a single reference, accesses array elements
+ * that only differ by one in the final index in the statement instances
+ * related by data->step.
+ */
+static isl_stat count_unit_stride_ref(__isl_take isl_map *tagged, void *user)
+{
+	struct ppcg_stride_data *data = user;
+	int i, n;
+	isl_space *space;
+	isl_union_map *access, *pairs;
+	isl_union_set *deltas;
+	isl_set *set, *unit;
+	isl_bool empty, subset;
+
+	tagged = isl_map_domain_factor_domain(tagged);
+	space = isl_space_range(isl_map_get_space(tagged));
+	access = isl_union_map_from_map(tagged);
+	pairs = isl_union_map_apply_range(isl_union_map_copy(data->step),
+					isl_union_map_copy(access));
+	pairs = isl_union_map_apply_range(isl_union_map_reverse(access),
+					pairs);
+	deltas = isl_union_map_deltas(pairs);
+	set = isl_union_set_extract_set(deltas, isl_space_copy(space));
+	isl_union_set_free(deltas);
+
+	n = isl_space_dim(space, isl_dim_set);
+	unit = isl_set_universe(space);
+	for (i = 0; i + 1 < n; ++i)
+		unit = isl_set_fix_si(unit, isl_dim_set, i, 0);
+	if (n > 0)
+		unit = isl_set_union(
+			isl_set_fix_si(isl_set_copy(unit), isl_dim_set, i, 1),
+			isl_set_fix_si(unit, isl_dim_set, i, -1));
+	else
+		unit = isl_set_empty(isl_set_get_space(unit));
+
+	empty = isl_set_is_empty(set);
+	subset = isl_set_is_subset(set, unit);
+	isl_set_free(set);
+	isl_set_free(unit);
+
+	if (empty < 0 || subset < 0)
+		return isl_stat_error;
+	if (!empty && subset)
+		data->count++;
+	return isl_stat_ok;
+}
+
+/* Count the number of references in "accesses", a union
+ * of tagged access relations, that access consecutive array elements
+ * in consecutive iterations of dimension "pos" of "schedule",
+ * which lives in "space".
+ * Return -1 on error.
+ */
+static int count_unit_stride(__isl_keep isl_union_map *accesses,
+	__isl_keep isl_union_map *schedule, __isl_keep isl_space *space,
+	int pos)
+{
+	struct ppcg_stride_data data = { NULL, 0 };
+	isl_multi_aff *ma;
+	isl_aff *aff;
+	isl_union_map *next;
+	isl_stat r;
+
+	ma = isl_multi_aff_identity(isl_space_map_from_set(
+						isl_space_copy(space)));
+	aff = isl_multi_aff_get_aff(ma, pos);
+	aff = isl_aff_add_constant_si(aff, 1);
+	ma = isl_multi_aff_set_aff(ma, pos, aff);
+	next = isl_union_map_from_map(isl_map_from_multi_aff(ma));
+
+	data.step = isl_union_map_copy(schedule);
+	data.step = isl_union_map_apply_range(data.step, next);
+	data.step = isl_union_map_apply_range(data.step,
+			isl_union_map_reverse(isl_union_map_copy(schedule)));
+	r = isl_union_map_foreach_map(accesses, &count_unit_stride_ref, &data);
+	isl_union_map_free(data.step);
+
+	return r < 0 ? -1 : data.count;
+}
+
+/* Given the point band node "node" of a tiled band,
+ * move the member with the largest number of references
+ * that access consecutive array elements in consecutive iterations
+ * to the innermost position, provided the band is permutable and
+ * this number is strictly larger than that of the current innermost member.
+ * The relative order of the other members is preserved.
+ *
+ * The references are counted with the outer schedule dimensions
+ * fixed, such that only the effect of the point loop is considered.
+ * The permuted band replaces the original band node,
+ * keeping the coincidence of each member.
+ */
+static __isl_give isl_schedule_node *permute_point_band(
+	__isl_take isl_schedule_node *node, struct ppcg_scop *scop)
+{
+	int i, n, n_prefix, best, best_count;
+	int *coincident;
+	isl_ctx *ctx;
+	isl_space *space;
+	isl_union_map *schedule, *accesses;
+	isl_multi_union_pw_aff *prefix, *partial, *permuted;
+
+	if (isl_schedule_node_band_get_permutable(node) != isl_bool_true)
+		return node;
+	n = isl_schedule_node_band_n_member(node);
+	if (n <= 1)
+		return node;
+
+	prefix = isl_schedule_node_get_prefix_schedule_multi_union_pw_aff(node);
+	prefix = expand_schedule(node, prefix);
+	n_prefix = isl_multi_union_pw_aff_dim(prefix, isl_dim_set);
+	partial = isl_schedule_node_band_get_partial_schedule(node);
+	partial = expand_schedule(node, partial);
+	partial = isl_multi_union_pw_aff_flat_range_product(prefix, partial);
+	space = isl_multi_union_pw_aff_get_space(partial);
+	schedule = isl_union_map_from_multi_union_pw_aff(partial);
+	accesses = isl_union_map_union(
+			isl_union_map_copy(scop->tagged_reads),
+			isl_union_map_copy(scop->tagged_may_writes));
+
+	best = n - 1;
+	best_count = count_unit_stride(accesses, schedule, space,
+					n_prefix + best);
+	for (i = 0; best_count >= 0 && i < n - 1; ++i) {
+		int count;
+
+		count = count_unit_stride(accesses, schedule, space,
+					n_prefix + i);
+		if (count < 0)
+			best_count = -1;
+		else if (count > best_count) {
+			best = i;
+			best_count = count;
+		}
+	}
+
+	isl_space_free(space);
+	isl_union_map_free(schedule);
+	isl_union_map_free(accesses);
+	if (best_count < 0)
+		return isl_schedule_node_free(node);
+	if (best == n - 1)
+		return node;
+
+	ctx = isl_schedule_node_get_ctx(node);
+	coincident = isl_alloc_array(ctx, int, n);
+	if (!coincident)
+		return isl_schedule_node_free(node);
+	partial = isl_schedule_node_band_get_partial_schedule(node);
+	permuted = isl_multi_union_pw_aff_copy(partial);
+	for (i = 0; i < n; ++i) {
+		int j = i < best ? i : i < n - 1 ? i + 1 : best;
+		isl_union_pw_aff *upa;
+
+		upa = isl_multi_union_pw_aff_get_union_pw_aff(partial, j);
+		permuted = isl_multi_union_pw_aff_set_union_pw_aff(permuted,
+								i, upa);
+		coincident[i] =
+			isl_schedule_node_band_member_get_coincident(node, j);
+	}
+	isl_multi_union_pw_aff_free(partial);
+
+	node = isl_schedule_node_delete(node);
+	node = isl_schedule_node_insert_partial_schedule(node, permuted);
+	node = isl_schedule_node_band_set_permutable(node, 1);
+	for (i = 0; i < n; ++i)
+		node = isl_schedule_node_band_member_set_coincident(node, i,
+							coincident[i]);
+	free(coincident);
+
+	return node;
+}
+
+/* Data used in tile_band.
+ *
+ * "scop" is the scop that is being tiled.
+ * "sizes" contains the tile sizes specified through the --sizes option,
+ * if any.
+ * "used_sizes" collects the effectively used tile sizes
+ * if the --dump-sizes option is set.
+ * "band_id" is the sequence number of the next band that gets tiled.
+ * "cache" contains the sizes of the "n_cache" data caches
+ * if tile sizes should be selected automatically,
+ * ordered from the smallest to the largest cache.
+ */
+struct cpu_tile_data {
+	struct ppcg_scop *scop;
+	isl_union_map *sizes;
+	isl_union_map *used_sizes;
+	int band_id;
+	int n_cache;
+	int *cache;
+};
+
+/* The largest tile size that is considered by select_cache_tile_sizes.
+ */
+#define MAX_AUTO_TILE_SIZE	1024
+
+/* Data used in add_array_footprint.
+ *
+ * "scop" is the scop that is being tiled.
+ * "footprint" is the total number of bytes accessed by a tile
+ * for the arrays considered so far or -1 if this number is unbounded.
+ */
+struct ppcg_footprint_data {
+	struct ppcg_scop *scop;
+	double footprint;
+};
+
+/* Return the size in bytes of the elements of the array
+ * living in "space" in data->scop.
+ * Assume double precision elements if the array cannot be found.
+ */
+static int element_size(struct ppcg_footprint_data *data,
+	__isl_keep isl_space *space)
+{
+	int i;
+	struct pet_scop *pet = data->scop->pet;
+
+	for (i = 0; i < pet->n_array; ++i) {
+		isl_space *array_space;
+		isl_bool equal;
+
+		array_space = isl_set_get_space(pet->arrays[i]->extent);
+		equal = isl_space_tuple_is_equal(array_space, isl_dim_set,
+						space, isl_dim_set);
+		isl_space_free(array_space);
+		if (equal == isl_bool_true)
+			return pet->arrays[i]->element_size;
+	}
+
+	return sizeof(double);
+}
+
+/* Given the differences "deltas" between the indices of array elements
+ * that are accessed by the same tile, add the number of bytes
+ * in a box around the elements accessed by a tile to data->footprint.
+ * In each dimension, the box has a width of one more than
+ * the maximal difference.
+ * Abort if the differences are not bounded,
+ * e.g., because a tile contains a loop with parametric bounds.
+ */
+static isl_stat add_array_footprint(__isl_take isl_set *deltas, void *user)
+{
+	struct ppcg_footprint_data *data = user;
+	int i, n, n_param;
+	double footprint;
+	isl_space *space;
+	isl_bool bounded;
+
+	n_param = isl_set_dim(deltas, isl_dim_param);
+	deltas = isl_set_project_out(deltas, isl_dim_param, 0, n_param);
+	bounded = isl_set_is_bounded(deltas);
+	if (bounded != isl_bool_true) {
+		isl_set_free(deltas);
+		data->footprint = -1;
+		return isl_stat_error;
+	}
+
+	space = isl_set_get_space(deltas);
+	footprint = element_size(data, space);
+	isl_space_free(space);
+	n = isl_set_dim(deltas, isl_dim_set);
+	for (i = 0; i < n; ++i) {
+		isl_set *dim;
+		isl_val *v;
+
+		dim = isl_set_copy(deltas);
+		dim = isl_set_project_out(dim, isl_dim_set, i + 1, n - i - 1);
+		dim = isl_set_project_out(dim, isl_dim_set, 0, i);
+		dim = isl_set_lexmax(dim);
+		v = isl_set_plain_get_val_if_fixed(dim, isl_dim_set, 0);
+		isl_set_free(dim);
+		if (v && isl_val_is_int(v))
+			footprint *= isl_val_get_d(v) + 1;
+		isl_val_free(v);
+	}
+	isl_set_free(deltas);
+
+	data->footprint += footprint;
+	return isl_stat_ok;
+}
+
+/* Return the number of bytes accessed by a single tile of the band
+ * node "node" of "scop" when tiled with tile size "size"
+ * in each dimension, or -1 if this number is unbounded.
+ *
+ * As in gpu_group.c, the footprint is approximated by a box
+ * around the array elements accessed by the tile, for each array.
+ * The sizes of the boxes are derived from the differences
+ * between the indices of array elements that are accessed
+ * by statement instances in the same tile, i.e., instances
+ * that are mapped to the same tile by the tile band and
+ * to the same iteration of the outer band nodes.
+ */
+static double tile_footprint(__isl_keep isl_schedule_node *node,
+	struct ppcg_scop *scop, int size)
+{
+	struct ppcg_footprint_data data = { scop, 0 };
+	isl_space *space;
+	isl_multi_val *mv;
+	isl_multi_union_pw_aff *prefix, *tile;
+	isl_schedule_node *tiled;
+	isl_union_map *access, *pairs;
+	isl_union_set *deltas;
+	isl_stat r;
+
+	space = isl_schedule_node_band_get_space(node);
+	mv = ppcg_multi_val_from_int(space, size);
+	tiled = isl_schedule_node_band_tile(isl_schedule_node_copy(node), mv);
+	tile = isl_schedule_node_band_get_partial_schedule(tiled);
+	tile = expand_schedule(tiled, tile);
+	isl_schedule_node_free(tiled);
+	prefix = isl_schedule_node_get_prefix_schedule_multi_union_pw_aff(node);
+	prefix = expand_schedule(node, prefix);
+	tile = isl_multi_union_pw_aff_flat_range_product(prefix, tile);
+
+	access = isl_union_map_union(isl_union_map_copy(scop->reads),
+				isl_union_map_copy(scop->may_writes));
+	access = isl_union_map_apply_domain(access,
+				isl_union_map_from_multi_union_pw_aff(tile));
+	pairs = isl_union_map_apply_range(
+			isl_union_map_reverse(isl_union_map_copy(access)),
+			access);
+	deltas = isl_union_map_deltas(pairs);
+	r = isl_union_set_foreach_set(deltas, &add_array_footprint, &data);
+	isl_union_set_free(deltas);
+
+	if (r < 0 && data.footprint >= 0)
+		return -2;
+	return data.footprint;
+}
+
+/* Add the map { band[id] -> type[size, ..., size] }, with "n" elements
+ * in the range, to data->sizes.
+ */
+static void add_band_tile_sizes(struct cpu_tile_data *data,
+	const char *type, int id, int size, int n)
+{
+	int i;
+	int *sizes;
+	isl_ctx *ctx = isl_union_map_get_ctx(data->sizes);
+
+	sizes = isl_alloc_array(ctx, int, n);
+	if (!sizes) {
+		data->sizes = isl_union_map_free(data->sizes);
+		return;
+	}
+	for (i = 0; i < n; ++i)
+		sizes[i] = size;
+	data->sizes = ppcg_add_used_sizes(data->sizes, "band", type, id,
+					sizes, n);
+	free(sizes);
+}
+
+/* Select tile sizes for the band node "node" with sequence number "id"
+ * such that the footprint of a tile fits in the data caches
+ * in data->cache and add them to data->sizes, unless tile sizes
+ * have been specified for the band by the user.
+ *
+ * For each cache, starting from the largest, select the largest
+ * power of two (up to MAX_AUTO_TILE_SIZE) such that a tile
+ * with this size in every dimension fits in the cache.
+ * The tile sizes of the largest cache are used for the outer
+ * tiling level ("tile"), while those of smaller caches, if smaller,
+ * are used for further tiling levels ("tile2", "tile3", ...).
+ * The tiling levels are numbered consecutively, skipping the caches
+ * for which no smaller tile size was selected, since tile_inner_levels
+ * stops at the first missing level.
+ * Since the tile sizes are powers of two, the tiles of each level
+ * evenly divide the tiles of the previous level.
+ * Levels for which the user has specified tile sizes are left alone,
+ * since adding sizes to those of the user would result
+ * in invalid sizes.
+ * If the footprint is unbounded or if no tile fits in any cache,
+ * then no tile sizes are selected.
+ */
+static isl_stat select_cache_tile_sizes(__isl_keep isl_schedule_node *node,
+	struct cpu_tile_data *data, int id)
+{
+	int i, n, size, level, prev, n_level;
+	int chosen[PPCG_MAX_CACHE_LEVELS];
+	isl_set *user;
+
+	user = ppcg_extract_sizes(data->sizes, "band", "tile", id);
+	if (user) {
+		isl_set_free(user);
+		return isl_stat_ok;
+	}
+
+	level = data->n_cache - 1;
+	for (size = MAX_AUTO_TILE_SIZE; size >= 2 && level >= 0; size /= 2) {
+		double footprint;
+
+		footprint = tile_footprint(node, data->scop, size);
+		if (footprint < -1)
+			return isl_stat_error;
+		if (footprint < 0)
+			break;
+		for (; level >= 0 && footprint <= data->cache[level]; --level)
+			chosen[level] = size;
+	}
+
+	if (!data->sizes) {
+		isl_ctx *ctx = isl_schedule_node_get_ctx(node);
+		isl_space *space = isl_space_params_alloc(ctx, 0);
+		data->sizes = isl_union_map_empty(space);
+	}
+	n = isl_schedule_node_band_n_member(node);
+	prev = 0;
+	n_level = 0;
+	for (i = data->n_cache - 1; i > level; --i) {
+		char type[20];
+
+		if (prev && chosen[i] >= prev)
+			continue;
+		if (n_level == 0)
+			snprintf(type, sizeof(type), "tile");
+		else
+			snprintf(type, sizeof(type), "tile%d", n_level + 1);
+		n_level++;
+		prev = chosen[i];
+		user = ppcg_extract_sizes(data->sizes, "band", type, id);
+		if (user) {
+			isl_set_free(user);
+			continue;
+		}
+		add_band_tile_sizes(data, type, id, chosen[i], n);
+	}
+
+	return data->sizes ? isl_stat_ok : isl_stat_error;
+}
 
-	p = pet_stmt_print_body(stmt->stmt, p, stmt->ref2expr);
+/* Extract the tile sizes of type "type" for the band with sequence
+ * number "id" from data->sizes, if any, and store them in "sizes",
+ * updating *len as in ppcg_read_sizes_from_set.
+ * Return isl_bool_true if such sizes were specified.
+ */
+static isl_bool extract_band_tile_sizes(struct cpu_tile_data *data,
+	const char *type, int id, int *sizes, int *len)
+{
+	isl_set *size;
 
-	isl_ast_print_options_free(print_options);
+	size = ppcg_extract_sizes(data->sizes, "band", type, id);
+	if (!size)
+		return isl_bool_false;
+	if (ppcg_read_sizes_from_set(size, sizes, len) < 0)
+		return isl_bool_error;
+	return isl_bool_true;
+}
 
-	return p;
+/* Add the "len" tile sizes "sizes" of type "type" that are effectively
+ * used for the band with sequence number "id" to data->used_sizes.
+ */
+static isl_stat record_band_tile_sizes(struct cpu_tile_data *data,
+	const char *type, int id, int *sizes, int len)
+{
+	if (!data->used_sizes)
+		return isl_stat_ok;
+	data->used_sizes = ppcg_add_used_sizes(data->used_sizes,
+					"band", type, id, sizes, len);
+	return data->used_sizes ? isl_stat_ok : isl_stat_error;
 }
 
+/* Extract the tile sizes of type "type" for the band with sequence
+ * number "id" from data->sizes, if any, and store them in "sizes",
+ * updating *len as in ppcg_read_sizes_from_set.
+ * Add the effectively used sizes to data->used_sizes.
+ */
+static isl_stat read_band_tile_sizes(struct cpu_tile_data *data,
+	const char *type, int id, int *sizes, int *len)
+{
+	if (extract_band_tile_sizes(data, type, id, sizes, len) < 0)
+		return isl_stat_error;
+	return record_band_tile_sizes(data, type, id, sizes, *len);
+}
 
-/* Print a for loop node as an openmp parallel loop.
+/* Return the statement instances reaching the band node "node"
+ * that belong to full tiles when "node" is tiled with tile sizes "sizes".
  *
- * To print an openmp parallel loop we print a normal for loop, but add
- * "#pragma openmp parallel for" in front.
+ * The elements of the band are described by pairs of values
+ * of the outer band nodes and the band node itself, i.e.,
  *
- * Variables that are declared within the body of this for loop are
- * automatically openmp 'private'. Iterators declared outside of the
- * for loop are automatically openmp 'shared'. As ppcg declares all iterators
- * at the position where they are assigned, there is no need to explicitly mark
- * variables. Their automatically assigned type is already correct.
+ *	[[outer] -> [band]]
  *
- * This function only generates valid OpenMP code, if the ast was generated
- * with the 'atomic-bounds' option enabled.
+ * and are mapped to the corresponding tiles by
  *
+ *	[[outer] -> [band]] -> [[outer] -> [floor(band/sizes)]]
+ *
+ * As in compute_full_tile in hybrid.c, the partial tiles are those
+ * that contain an element that is not executed.  The full tiles
+ * are all other tiles.  The result consists of the statement instances
+ * that are mapped to elements of these full tiles.
+ * Note that the domain, the prefix schedule and the partial schedule
+ * of "node" all refer to the statement instances reaching "node",
+ * which may be grouped statement instances.  The same holds
+ * for the prefix schedule used by isolate_full_tiles.
  */
-static __isl_give isl_printer *print_for_with_openmp(
-	__isl_keep isl_ast_node *node, __isl_take isl_printer *p,
-	__isl_take isl_ast_print_options *print_options)
+static __isl_give isl_union_set *full_tile_instances(
+	__isl_keep isl_schedule_node *node, __isl_keep isl_multi_val *sizes)
 {
-	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "#pragma omp parallel for");
-	p = isl_printer_end_line(p);
+	isl_space *space;
+	isl_multi_aff *ma;
+	isl_multi_union_pw_aff *partial;
+	isl_union_set *domain;
+	isl_union_map *el;
+	isl_map *id, *el2tile;
+	isl_set *all_el, *all, *partial_tiles;
+
+	domain = isl_schedule_node_get_domain(node);
+	partial = isl_schedule_node_band_get_partial_schedule(node);
+	el = isl_schedule_node_get_prefix_schedule_union_map(node);
+	el = isl_union_map_range_product(el,
+				isl_union_map_from_multi_union_pw_aff(partial));
+	domain = isl_union_set_apply(domain, isl_union_map_copy(el));
+	all_el = isl_set_from_union_set(domain);
+
+	space = isl_space_unwrap(isl_set_get_space(all_el));
+	id = isl_map_identity(isl_space_map_from_set(
+				isl_space_domain(isl_space_copy(space))));
+	ma = isl_multi_aff_identity(isl_space_map_from_set(
+				isl_space_range(space)));
+	ma = isl_multi_aff_scale_down_multi_val(ma, isl_multi_val_copy(sizes));
+	ma = isl_multi_aff_floor(ma);
+	el2tile = isl_map_product(id, isl_map_from_multi_aff(ma));
+
+	all = isl_set_apply(isl_set_copy(all_el), isl_map_copy(el2tile));
+	partial_tiles = isl_set_apply(isl_set_copy(all),
+				isl_map_reverse(isl_map_copy(el2tile)));
+	partial_tiles = isl_set_subtract(partial_tiles, all_el);
+	partial_tiles = isl_set_apply(partial_tiles, isl_map_copy(el2tile));
+	all = isl_set_subtract(all, partial_tiles);
+	all = isl_set_apply(all, isl_map_reverse(el2tile));
+
+	return isl_union_set_apply(isl_union_set_from_set(all),
+				isl_union_map_reverse(el));
+}
 
-	p = isl_ast_node_for_print(node, p, print_options);
+/* Mark the full tiles of the point band node "node" for isolation,
+ * where "full" contains the statement instances that belong to full tiles.
+ *
+ * The isolate option is expressed in terms of the values
+ * of the outer loops, including the tile loops, i.e.,
+ * the prefix schedule of "node".  Since all iterations of the point loops
+ * are executed inside a full tile, the point loops are not constrained.
+ * The isolated part then has point loops with constant trip counts,
+ * while the remaining partial tiles are generated separately.
+ *
+ * The AST loop types of the isolated part are set to be the same
+ * as those of the non-isolated part.
+ */
+static __isl_give isl_schedule_node *isolate_full_tiles(
+	__isl_take isl_schedule_node *node, __isl_take isl_union_set *full)
+{
+	int i, n;
+	isl_bool empty;
+	isl_space *space;
+	isl_union_map *prefix;
+	isl_union_set *opt;
+	isl_set *tiles;
+	isl_map *map;
 
-	return p;
+	empty = isl_union_set_is_empty(full);
+	if (empty < 0 || empty) {
+		isl_union_set_free(full);
+		return empty < 0 ? isl_schedule_node_free(node) : node;
+	}
+
+	prefix = isl_schedule_node_get_prefix_schedule_union_map(node);
+	tiles = isl_set_from_union_set(isl_union_set_apply(full, prefix));
+	tiles = isl_set_reset_tuple_id(tiles);
+	n = isl_schedule_node_band_n_member(node);
+	space = isl_space_set_alloc(isl_schedule_node_get_ctx(node), 0, n);
+	map = isl_map_from_domain_and_range(tiles, isl_set_universe(space));
+	tiles = isl_set_set_tuple_name(isl_map_wrap(map), "isolate");
+
+	opt = isl_schedule_node_band_get_ast_build_options(node);
+	opt = isl_union_set_add_set(opt, tiles);
+	node = isl_schedule_node_band_set_ast_build_options(node, opt);
+	for (i = 0; i < n; ++i) {
+		enum isl_ast_loop_type type;
+
+		type = isl_schedule_node_band_member_get_ast_loop_type(node, i);
+		node = isl_schedule_node_band_member_set_isolate_ast_loop_type(
+								node, i, type);
+	}
+
+	return node;
 }
 
-/* Print a for node.
+/* Tile the band node "node" with tile sizes "sizes", where
+ * only the first "len" members are tiled.
+ * The remaining members, if any, are split off into a separate band node.
+ * If "full" is not NULL, then replace *full by the statement instances
+ * that belong to full tiles.
+ * Return a pointer to the resulting tile band node.
+ */
+static __isl_give isl_schedule_node *tile_members(
+	__isl_take isl_schedule_node *node, int *sizes, int len,
+	isl_union_set **full)
+{
+	isl_space *space;
+	isl_multi_val *mv;
+
+	if (len < isl_schedule_node_band_n_member(node))
+		node = isl_schedule_node_band_split(node, len);
+	space = isl_schedule_node_band_get_space(node);
+	mv = ppcg_multi_val_from_int_list(space, sizes);
+	if (full) {
+		isl_union_set_free(*full);
+		*full = full_tile_instances(node, mv);
+	}
+	node = isl_schedule_node_band_tile(node, mv);
+	node = ppcg_set_schedule_node_type(node, isl_ast_loop_atomic);
+
+	return node;
+}
+
+/* Tile the point band node "node" of the band with sequence number "id"
+ * further with the tile sizes specified for the inner tiling levels,
+ * i.e., those of type "tile2", "tile3", ..., in data->sizes.
+ * Each level only tiles the (first) members of the point band
+ * of the previous level.  The first level without any specified
+ * tile sizes ends the sequence.
+ * If "full" is not NULL, then *full is updated to contain
+ * the statement instances that belong to full innermost tiles.
+ * Return a pointer to the innermost point band node.
+ */
+static __isl_give isl_schedule_node *tile_inner_levels(
+	__isl_take isl_schedule_node *node, struct cpu_tile_data *data, int id,
+	isl_union_set **full)
+{
+	int level;
+
+	for (level = 2; data->sizes; ++level) {
+		char type[20];
+		int len;
+		int *sizes;
+		isl_set *size;
+
+		snprintf(type, sizeof(type), "tile%d", level);
+		size = ppcg_extract_sizes(data->sizes, "band", type, id);
+		if (!size)
+			break;
+		isl_set_free(size);
+		len = isl_schedule_node_band_n_member(node);
+		sizes = isl_alloc_array(isl_schedule_node_get_ctx(node),
+					int, len);
+		if (!sizes ||
+		    read_band_tile_sizes(data, type, id, sizes, &len) < 0) {
+			free(sizes);
+			return isl_schedule_node_free(node);
+		}
+		if (len > 0) {
+			node = tile_members(node, sizes, len, full);
+			node = isl_schedule_node_child(node, 0);
+		}
+		free(sizes);
+		if (len == 0)
+			break;
+	}
+
+	return node;
+}
+
+/* Skew the permutable band node "node" into a wavefront.
+ * That is, replace the first member of the band by the sum
+ * of all members.
  *
- * Depending on how the node is annotated, we either print a normal
- * for node or an openmp parallel for node.
+ * Since the band is permutable, all dependences have a non-negative
+ * distance in each of the members.  Any dependence that is not carried
+ * by the new first member therefore has a zero distance
+ * in all the other members, such that these other members
+ * are all coincident.
+ * The resulting band is still permutable.
+ * All members are marked "atomic", as in tile.
  */
-static __isl_give isl_printer *print_for(__isl_take isl_printer *p,
-	__isl_take isl_ast_print_options *print_options,
-	__isl_keep isl_ast_node *node, void *user)
+static __isl_give isl_schedule_node *wavefront(
+	__isl_take isl_schedule_node *node)
 {
-	isl_id *id;
-	int openmp;
+	int i, n;
+	isl_multi_union_pw_aff *mupa;
+	isl_union_pw_aff *sum;
 
-	openmp = 0;
-	id = isl_ast_node_get_annotation(node);
+	n = isl_schedule_node_band_n_member(node);
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	sum = isl_multi_union_pw_aff_get_union_pw_aff(mupa, 0);
+	for (i = 1; i < n; ++i) {
+		isl_union_pw_aff *upa;
 
-	if (id) {
-		struct ast_node_userinfo *info;
+		upa = isl_multi_union_pw_aff_get_union_pw_aff(mupa, i);
+		sum = isl_union_pw_aff_add(sum, upa);
+	}
+	mupa = isl_multi_union_pw_aff_set_union_pw_aff(mupa, 0, sum);
+
+	node = isl_schedule_node_delete(node);
+	node = isl_schedule_node_insert_partial_schedule(node, mupa);
+	node = isl_schedule_node_band_set_permutable(node, 1);
+	for (i = 1; i < n; ++i)
+		node = isl_schedule_node_band_member_set_coincident(node, i, 1);
+	node = ppcg_set_schedule_node_type(node, isl_ast_loop_atomic);
+
+	return node;
+}
+
+/* The number of registers that are assumed to be available
+ * for holding the values accessed by an unrolled and jammed block
+ * in select_unroll_jam_factors.
+ */
+#define UNROLL_JAM_REGISTERS	16
+
+/* Return the number of references in "scop" that are executed
+ * by the statement instances reaching "node".
+ * The access relations are formulated in terms of the expanded domains,
+ * while the domain of "node" may have been contracted,
+ * so the domain of "node" is first expanded.
+ */
+static int count_references(__isl_keep isl_schedule_node *node,
+	struct ppcg_scop *scop)
+{
+	int n;
+	isl_union_map *tagged;
+	isl_union_set *domain;
+	isl_union_pw_multi_aff *contraction;
+
+	tagged = isl_union_map_union(isl_union_map_copy(scop->tagged_reads),
+				isl_union_map_copy(scop->tagged_may_writes));
+	tagged = isl_union_set_wrapped_domain_map(
+				isl_union_map_domain(tagged));
+	domain = isl_schedule_node_get_domain(node);
+	contraction = isl_schedule_node_get_subtree_contraction(node);
+	domain = isl_union_set_preimage_union_pw_multi_aff(domain,
+							contraction);
+	tagged = isl_union_map_intersect_range(tagged, domain);
+	n = isl_union_map_n_map(tagged);
+	isl_union_map_free(tagged);
+
+	return n;
+}
+
+/* Select unroll-and-jam factors for the "n" members of the point band
+ * node "node" of a tiled band in "scop" and store them in "factors".
+ *
+ * The innermost member is not unrolled since unrolling it
+ * does not allow any values to be reused from registers.
+ * Each unrolled iteration is assumed to keep a value in a register
+ * for each of the references executed inside the band, such that
+ * the product of the factors times the number of references should not
+ * exceed UNROLL_JAM_REGISTERS.  The factors of the other members
+ * are doubled in turn, starting from the innermost one,
+ * as long as this bound is respected.
+ */
+static isl_stat select_unroll_jam_factors(__isl_keep isl_schedule_node *node,
+	struct ppcg_scop *scop, int n, int *factors)
+{
+	int i, refs, product;
+	int progress;
+
+	refs = count_references(node, scop);
+	if (refs < 0)
+		return isl_stat_error;
+	if (refs == 0)
+		refs = 1;
+
+	for (i = 0; i < n; ++i)
+		factors[i] = 1;
+	product = 1;
+	do {
+		progress = 0;
+		for (i = n - 2; i >= 0; --i) {
+			if (2 * product * refs > UNROLL_JAM_REGISTERS)
+				break;
+			factors[i] *= 2;
+			product *= 2;
+			progress = 1;
+		}
+	} while (progress);
+
+	return isl_stat_ok;
+}
+
+/* Apply unroll-and-jam (register tiling) to the innermost point band
+ * node "node" of the band with sequence number "id".
+ * The unroll factors are taken from the "unroll" sizes specified
+ * for the band in data->sizes, if any.  Otherwise, they are selected
+ * by select_unroll_jam_factors if the "unroll_jam" option is set.
+ * Members without an unroll factor get a factor of one.
+ *
+ * The point band is tiled with the unroll factors and
+ * the resulting point band is marked for unrolling, such that
+ * the unrolled iterations are jammed together inside the loops
+ * of the tile band.  This requires the band to be permutable.
+ * Return a pointer to the tile band node, which replaces "node".
+ */
+static __isl_give isl_schedule_node *unroll_and_jam(
+	__isl_take isl_schedule_node *node, struct cpu_tile_data *data, int id)
+{
+	int i, n, len;
+	int *factors;
+	isl_bool permutable;
+	isl_set *size;
+	isl_space *space;
+	isl_multi_val *mv;
 
-		info = (struct ast_node_userinfo *) isl_id_get_user(id);
-		if (info && info->is_openmp)
-			openmp = 1;
+	size = ppcg_extract_sizes(data->sizes, "band", "unroll", id);
+	if (!size && !data->scop->options->unroll_jam)
+		return node;
+
+	permutable = isl_schedule_node_band_get_permutable(node);
+	if (permutable != isl_bool_true) {
+		isl_set_free(size);
+		if (permutable < 0)
+			return isl_schedule_node_free(node);
+		return node;
 	}
 
-	if (openmp)
-		p = print_for_with_openmp(node, p, print_options);
-	else
-		p = isl_ast_node_for_print(node, p, print_options);
+	n = isl_schedule_node_band_n_member(node);
+	factors = isl_alloc_array(isl_schedule_node_get_ctx(node), int, n);
+	if (!factors) {
+		isl_set_free(size);
+		return isl_schedule_node_free(node);
+	}
+	if (size) {
+		isl_set_free(size);
+		for (i = 0; i < n; ++i)
+			factors[i] = 1;
+		len = n;
+		if (read_band_tile_sizes(data, "unroll", id, factors, &len) < 0)
+			node = isl_schedule_node_free(node);
+	} else {
+		if (select_unroll_jam_factors(node, data->scop, n, factors) < 0)
+			node = isl_schedule_node_free(node);
+		if (data->used_sizes)
+			data->used_sizes = ppcg_add_used_sizes(data->used_sizes,
+					"band", "unroll", id, factors, n);
+	}
+
+	for (i = 0; i < n; ++i)
+		if (factors[i] > 1)
+			break;
+	if (!node || i >= n) {
+		free(factors);
+		return node;
+	}
 
+	space = isl_schedule_node_band_get_space(node);
+	mv = ppcg_multi_val_from_int_list(space, factors);
+	free(factors);
+	node = isl_schedule_node_band_tile(node, mv);
+	node = isl_schedule_node_child(node, 0);
+	node = ppcg_set_schedule_node_type(node, isl_ast_loop_unroll);
+	node = isl_schedule_node_parent(node);
+
+	return node;
+}
+
+/* Data used in find_mark.
+ *
+ * "name" is the name of the mark node that is being looked for.
+ * "found" is set if such a mark node has been found.
+ */
+struct ppcg_find_mark_data {
+	const char *name;
+	isl_bool found;
+};
+
+/* Set data->found if "node" is a mark node called data->name.
+ * There is no need to look inside such a mark node.
+ */
+static isl_bool find_mark(__isl_keep isl_schedule_node *node, void *user)
+{
+	struct ppcg_find_mark_data *data = user;
+	isl_id *id;
+	const char *name;
+
+	if (isl_schedule_node_get_type(node) != isl_schedule_node_mark)
+		return isl_bool_true;
+	id = isl_schedule_node_mark_get_id(node);
+	name = isl_id_get_name(id);
+	if (name && !strcmp(name, data->name))
+		data->found = isl_bool_true;
 	isl_id_free(id);
 
-	return p;
+	return data->found ? isl_bool_false : isl_bool_true;
 }
 
-/* Index transformation callback for pet_stmt_build_ast_exprs.
+/* Does the subtree rooted at "node" contain any mark node called "name"?
+ */
+static isl_bool has_mark(__isl_keep isl_schedule_node *node,
+	const char *name)
+{
+	struct ppcg_find_mark_data data = { name, isl_bool_false };
+
+	if (isl_schedule_node_foreach_descendant_top_down(node,
+					&find_mark, &data) < 0)
+		return isl_bool_error;
+
+	return data.found;
+}
+
+/* Is it worthwhile to pack the elements of a tile of an array
+ * in the local buffer described by "tile"?
+ * That is, are the elements spread over several positions
+ * in any but the last dimension of the array?
+ * If not, then the elements are already contiguous in memory.
+ */
+static int is_scattered(struct gpu_array_tile *tile)
+{
+	int i;
+
+	for (i = 0; i + 1 < tile->n; ++i)
+		if (!isl_val_is_one(tile->bound[i].size))
+			return 1;
+
+	return 0;
+}
+
+/* Return the accesses in "accesses" to elements of "array"
+ * by the statement instances in "domain".
+ */
+static __isl_give isl_union_map *array_accesses(
+	__isl_keep isl_union_map *accesses, __isl_keep isl_union_set *domain,
+	struct pet_array *array)
+{
+	isl_union_set *extent;
+
+	extent = isl_union_set_from_set(isl_set_universe(
+					isl_set_get_space(array->extent)));
+	accesses = isl_union_map_copy(accesses);
+	accesses = isl_union_map_intersect_domain(accesses,
+					isl_union_set_copy(domain));
+	accesses = isl_union_map_intersect_range(accesses, extent);
+
+	return accesses;
+}
+
+/* Are some of the array elements in "accesses" accessed
+ * by several statement instances that are mapped
+ * to the same outer schedule dimensions D by "prefix"?
+ * That is, is the mapping
  *
- * "index" expresses the array indices in terms of statement iterators
- * "iterator_map" expresses the statement iterators in terms of
- * AST loop iterators.
+ *	S[s] -> [D[i] -> A[a]]
  *
- * The result expresses the array indices in terms of
- * AST loop iterators.
+ * not injective?
  */
-static __isl_give isl_multi_pw_aff *pullback_index(
-	__isl_take isl_multi_pw_aff *index, __isl_keep isl_id *id, void *user)
+static isl_bool has_reuse(__isl_keep isl_union_map *prefix,
+	__isl_keep isl_union_map *accesses)
 {
-	isl_pw_multi_aff *iterator_map = user;
+	isl_union_map *tagged;
+	isl_bool injective;
 
-	iterator_map = isl_pw_multi_aff_copy(iterator_map);
-	return isl_multi_pw_aff_pullback_pw_multi_aff(index, iterator_map);
+	tagged = isl_union_map_range_product(isl_union_map_copy(prefix),
+					isl_union_map_copy(accesses));
+	injective = isl_union_map_is_injective(tagged);
+	isl_union_map_free(tagged);
+
+	return isl_bool_not(injective);
 }
 
-/* Transform the accesses in the statement associated to the domain
- * called by "node" to refer to the AST loop iterators, construct
- * corresponding AST expressions using "build",
- * collect them in a ppcg_stmt and annotate the node with the ppcg_stmt.
+/* Return the number of bytes in a local buffer for the elements
+ * of "array" described by "tile".
  */
-static __isl_give isl_ast_node *at_each_domain(__isl_take isl_ast_node *node,
-	__isl_keep isl_ast_build *build, void *user)
+static __isl_give isl_val *local_buffer_bytes(struct pet_array *array,
+	struct gpu_array_tile *tile)
+{
+	isl_val *size;
+
+	size = gpu_array_tile_size(tile);
+	return isl_val_mul_ui(size, array->element_size);
+}
+
+/* Compute a local buffer for the elements of "array" in "access" and
+ * store the information in "packed", provided these elements fit
+ * in a box of fixed size, as computed by gpu_array_tile_can_tile,
+ * of at most "max_bytes" bytes and, if "scattered" is set,
+ * provided they are spread over several rows of the array.
+ * "access" is of the form
+ *
+ *	D[i] -> A[a]
+ *
+ * with D the outer schedule dimensions on which the local buffer depends.
+ * The name of the local buffer is "prefix" followed by the name
+ * of the array.
+ * Return isl_bool_true if the local buffer has been computed.
+ */
+static isl_bool compute_local_buffer(struct pet_array *array,
+	__isl_take isl_map *access, int max_bytes, int scattered,
+	const char *prefix, struct cpu_packed_array *packed)
 {
-	struct ppcg_scop *scop = user;
-	isl_ast_expr *expr, *arg;
 	isl_ctx *ctx;
-	isl_id *id;
-	isl_map *map;
-	isl_pw_multi_aff *iterator_map;
-	struct ppcg_stmt *stmt;
+	isl_bool ok;
+	isl_val *size;
+	isl_printer *p;
+	char *name;
+	struct gpu_array_tile *tile;
 
-	ctx = isl_ast_node_get_ctx(node);
-	stmt = isl_calloc_type(ctx, struct ppcg_stmt);
-	if (!stmt)
-		goto error;
+	if (!access)
+		return isl_bool_error;
 
-	expr = isl_ast_node_user_get_expr(node);
-	arg = isl_ast_expr_get_op_arg(expr, 0);
-	isl_ast_expr_free(expr);
-	id = isl_ast_expr_get_id(arg);
-	isl_ast_expr_free(arg);
-	stmt->stmt = find_stmt(scop, id);
-	isl_id_free(id);
-	if (!stmt->stmt)
-		goto error;
+	ctx = isl_map_get_ctx(access);
+	tile = gpu_array_tile_create(ctx, isl_map_dim(access, isl_dim_out));
+	ok = gpu_array_tile_can_tile(access, tile);
+	if (ok == isl_bool_true && scattered && !is_scattered(tile))
+		ok = isl_bool_false;
+	if (ok == isl_bool_true) {
+		size = local_buffer_bytes(array, tile);
+		if (!size)
+			ok = isl_bool_error;
+		else if (isl_val_cmp_si(size, max_bytes) > 0)
+			ok = isl_bool_false;
+		isl_val_free(size);
+	}
+	if (ok != isl_bool_true) {
+		isl_map_free(access);
+		gpu_array_tile_free(tile);
+		return ok;
+	}
 
-	map = isl_map_from_union_map(isl_ast_build_get_schedule(build));
-	map = isl_map_reverse(map);
-	iterator_map = isl_pw_multi_aff_from_map(map);
-	stmt->ref2expr = pet_stmt_build_ast_exprs(stmt->stmt, build,
-				    &pullback_index, iterator_map, NULL, NULL);
-	isl_pw_multi_aff_free(iterator_map);
+	p = isl_printer_to_str(ctx);
+	p = isl_printer_print_str(p, prefix);
+	p = isl_printer_print_str(p, isl_map_get_tuple_name(access,
+							isl_dim_out));
+	name = isl_printer_get_str(p);
+	isl_printer_free(p);
+	gpu_array_tile_compute_tiling(tile,
+			isl_space_range(isl_map_get_space(access)), name);
+	free(name);
+
+	packed->array = array;
+	packed->access = access;
+	packed->tile = tile;
+	if (!tile->tiling)
+		return isl_bool_error;
 
-	id = isl_id_alloc(isl_ast_node_get_ctx(node), NULL, stmt);
-	id = isl_id_set_free_user(id, &ppcg_stmt_free);
-	return isl_ast_node_set_annotation(node, id);
-error:
-	ppcg_stmt_free(stmt);
-	return isl_ast_node_free(node);
+	return isl_bool_true;
 }
 
-/* Set *depth (initialized to 0 by the caller) to the maximum
- * of the schedule depths of the leaf nodes for which this function is called.
+/* Check whether the elements of "array" that are accessed
+ * by the statement instances in "prefix" should be packed
+ * into a local buffer inside each tile and, if so,
+ * store the information in "packed".
+ * "prefix" maps the statement instances inside the tiles
+ * to the outer schedule dimensions D, up to and including the tile loops.
+ * Return isl_bool_true if the array should be packed.
+ *
+ * Only arrays that are read, but not written, inside the tiles
+ * are considered, such that the local buffers never need
+ * to be copied back.  Arrays of structures are not supported.
+ * Packing is only performed if the accessed elements
+ * are spread over several rows of a multi-dimensional array and
+ * if some of these elements are accessed by several statement instances
+ * inside the same tile.
+ * Finally, the accessed elements need to fit in a box of fixed size
+ * of at most "pack_max_bytes" bytes.
  */
-static isl_bool update_depth(__isl_keep isl_schedule_node *node, void *user)
+static isl_bool compute_packed_array(struct pet_array *array,
+	__isl_keep isl_union_map *prefix, struct ppcg_scop *scop,
+	struct cpu_packed_array *packed)
 {
-	int *depth = user;
-	int node_depth;
+	isl_bool written, unread, reuse;
+	isl_union_set *domain;
+	isl_union_map *writes, *reads;
+
+	if (array->element_is_record ||
+	    isl_set_dim(array->extent, isl_dim_set) < 2)
+		return isl_bool_false;
+
+	domain = isl_union_map_domain(isl_union_map_copy(prefix));
+	writes = array_accesses(scop->may_writes, domain, array);
+	written = isl_bool_not(isl_union_map_is_empty(writes));
+	isl_union_map_free(writes);
+	reads = array_accesses(scop->reads, domain, array);
+	isl_union_set_free(domain);
+	unread = isl_union_map_is_empty(reads);
+	reuse = isl_bool_false;
+	if (written == isl_bool_false && unread == isl_bool_false)
+		reuse = has_reuse(prefix, reads);
+	if (written < 0 || unread < 0 || reuse != isl_bool_true) {
+		isl_union_map_free(reads);
+		if (written < 0 || unread < 0)
+			return isl_bool_error;
+		return reuse;
+	}
 
-	if (isl_schedule_node_get_type(node) != isl_schedule_node_leaf)
-		return isl_bool_true;
-	node_depth = isl_schedule_node_get_schedule_depth(node);
-	if (node_depth > *depth)
-		*depth = node_depth;
+	reads = isl_union_map_apply_domain(reads, isl_union_map_copy(prefix));
+	return compute_local_buffer(array, isl_map_from_union_map(reads),
+				scop->options->pack_max_bytes, 1, "packed_",
+				packed);
+}
 
-	return isl_bool_false;
+/* Drop local buffers from "pack" such that the total size
+ * of the remaining local buffers is at most "max_bytes" bytes.
+ * The local buffers are kept in order, i.e., the buffers
+ * that do not fit together with the earlier buffers are dropped.
+ */
+static isl_stat limit_local_buffers(struct cpu_pack *pack, int max_bytes)
+{
+	int i;
+	isl_val *total;
+
+	total = isl_val_zero(isl_map_get_ctx(pack->array[0].access));
+	for (i = 0; i < pack->n; ++i) {
+		struct cpu_packed_array *packed = &pack->array[i];
+		isl_val *size;
+
+		size = local_buffer_bytes(packed->array, packed->tile);
+		size = isl_val_add(size, isl_val_copy(total));
+		if (!size)
+			break;
+		if (isl_val_cmp_si(size, max_bytes) <= 0) {
+			isl_val_free(total);
+			total = size;
+			continue;
+		}
+		isl_val_free(size);
+		isl_map_free(packed->access);
+		isl_map_free(packed->write);
+		gpu_array_tile_free(packed->tile);
+		memmove(packed, packed + 1,
+			(pack->n - i - 1) * sizeof(*packed));
+		pack->n--;
+		i--;
+	}
+	if (!total || i < pack->n) {
+		isl_val_free(total);
+		return isl_stat_error;
+	}
+	isl_val_free(total);
+
+	return isl_stat_ok;
 }
 
-/* This function is called for each node in a CPU AST.
- * In case of a user node, print the macro definitions required
- * for printing the AST expressions in the annotation, if any.
- * For other nodes, return true such that descendants are also
- * visited.
+/* Collect the arrays with elements that should be copied
+ * into local buffers inside a subtree of the schedule,
+ * as determined by "select", in a cpu_pack.
+ * "prefix" maps the statement instances inside the subtree
+ * to the outer schedule dimensions on which the local buffers depend.
+ * Return NULL on error.
+ */
+static struct cpu_pack *collect_local_buffers(
+	__isl_keep isl_union_map *prefix, struct ppcg_scop *scop,
+	isl_bool (*select)(struct pet_array *array,
+		__isl_keep isl_union_map *prefix, struct ppcg_scop *scop,
+		struct cpu_packed_array *packed))
+{
+	int i;
+	isl_ctx *ctx;
+	struct cpu_pack *pack;
+
+	if (!prefix)
+		return NULL;
+
+	ctx = isl_union_map_get_ctx(prefix);
+	pack = isl_calloc_type(ctx, struct cpu_pack);
+	if (!pack)
+		return NULL;
+	pack->array = isl_calloc_array(ctx, struct cpu_packed_array,
+					scop->pet->n_array);
+	if (!pack->array) {
+		cpu_pack_free(pack);
+		return NULL;
+	}
+	for (i = 0; i < scop->pet->n_array; ++i) {
+		isl_bool r;
+
+		r = select(scop->pet->arrays[i], prefix, scop,
+				&pack->array[pack->n]);
+		if (r != isl_bool_false)
+			pack->n++;
+		if (r < 0) {
+			cpu_pack_free(pack);
+			return NULL;
+		}
+	}
+
+	return pack;
+}
+
+/* Pack the elements of the arrays that are reused inside the tiles
+ * of the tile band "node" into local buffers, if any.
+ * Return a pointer to the tile band.
  *
- * In particular, print the macro definitions needed for the substitutions
- * of the original user statements.
+ * The arrays that should be packed are determined
+ * by compute_packed_array and they are recorded in a mark node
+ * that is inserted between the tile band and the point band.
+ * The local buffers are declared inside the tile loops and
+ * therefore live on the stack of the thread executing the tile.
+ * Their total size is therefore limited to "pack_max_bytes" bytes.
+ * This mark node is handled by ast_build_before_mark and
+ * ast_build_after_mark.
+ * The local buffers are not nested, so nothing is done
+ * if the point band already contains packed arrays,
+ * which are then packed inside smaller tiles.
+ */
+static __isl_give isl_schedule_node *pack_arrays(
+	__isl_take isl_schedule_node *node, struct ppcg_scop *scop)
+{
+	isl_bool nested;
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_multi_union_pw_aff *mupa;
+	isl_union_map *prefix;
+	struct cpu_pack *pack;
+
+	node = isl_schedule_node_child(node, 0);
+	nested = has_mark(node, pack_name);
+	if (nested < 0)
+		return isl_schedule_node_free(node);
+	if (nested)
+		return isl_schedule_node_parent(node);
+
+	mupa = isl_schedule_node_get_prefix_schedule_multi_union_pw_aff(node);
+	mupa = expand_schedule(node, mupa);
+	prefix = isl_union_map_from_multi_union_pw_aff(mupa);
+	pack = collect_local_buffers(prefix, scop, &compute_packed_array);
+	isl_union_map_free(prefix);
+	if (pack && pack->n > 0 &&
+	    limit_local_buffers(pack, scop->options->pack_max_bytes) < 0) {
+		cpu_pack_free(pack);
+		pack = NULL;
+	}
+	if (!pack)
+		return isl_schedule_node_free(node);
+	if (pack->n == 0) {
+		cpu_pack_free(pack);
+		return isl_schedule_node_parent(node);
+	}
+	pack->depth = isl_schedule_node_get_schedule_depth(node);
+
+	ctx = isl_schedule_node_get_ctx(node);
+	id = isl_id_alloc(ctx, pack_name, pack);
+	id = isl_id_set_free_user(id, &cpu_pack_free);
+	node = isl_schedule_node_insert_mark(node, id);
+	node = isl_schedule_node_parent(node);
+
+	return node;
+}
+
+/* Tile the band node "node" with sequence number "id"
+ * with tile sizes "sizes", of which only the first "len" are used, and
+ * mark all members of the resulting tile node as "atomic".
+ * The point band is tiled further according to the inner tiling levels
+ * specified in data->sizes, if any.
+ * If the "permute_point_loops" option is set, then
+ * the innermost point loops are permuted by permute_point_band.
+ * The innermost point band is then unrolled and jammed
+ * by unroll_and_jam, if requested.
+ * If "skew" is set, then the outer tile band is skewed
+ * into a wavefront.
+ * If the "isolate_full_tiles" option is set, then the full
+ * innermost tiles are isolated from the partial tiles.
+ * This is performed after the other transformations since it depends
+ * on the final values of the tile loops and since the AST build options
+ * are lost when the point band is permuted.
+ * Finally, if the "pack_arrays" option is set, then the arrays
+ * that are reused inside the outer tiles are packed by pack_arrays.
+ * Return a pointer to the outer tile band node.
  */
-static isl_bool at_node(__isl_keep isl_ast_node *node, void *user)
+static __isl_give isl_schedule_node *tile(__isl_take isl_schedule_node *node,
+	int *sizes, int len, struct cpu_tile_data *data, int id, int skew)
 {
-	struct ppcg_stmt *stmt;
-	isl_id *id;
-	isl_printer **p = user;
+	int i, depth;
+	isl_union_set *full = NULL;
+	isl_union_set **full_p = NULL;
+
+	if (data->scop->options->isolate_full_tiles)
+		full_p = &full;
+	node = tile_members(node, sizes, len, full_p);
+	depth = isl_schedule_node_get_tree_depth(node);
+	node = isl_schedule_node_child(node, 0);
+	node = tile_inner_levels(node, data, id, full_p);
+	if (data->scop->options->permute_point_loops)
+		node = permute_point_band(node, data->scop);
+	node = unroll_and_jam(node, data, id);
+	depth = isl_schedule_node_get_tree_depth(node) - depth;
+	node = isl_schedule_node_ancestor(node, depth);
+	if (skew)
+		node = wavefront(node);
+	if (full_p) {
+		for (i = 0; i < depth; ++i)
+			node = isl_schedule_node_child(node, 0);
+		node = isolate_full_tiles(node, full);
+		node = isl_schedule_node_ancestor(node, depth);
+	}
+	if (data->scop->options->pack_arrays)
+		node = pack_arrays(node, data->scop);
 
-	if (isl_ast_node_get_type(node) != isl_ast_node_user)
-		return isl_bool_true;
+	return node;
+}
 
-	id = isl_ast_node_get_annotation(node);
-	stmt = isl_id_get_user(id);
-	isl_id_free(id);
+/* Are any of the first "n" members of the band node "node" coincident?
+ */
+static isl_bool has_coincident_member(__isl_keep isl_schedule_node *node,
+	int n)
+{
+	int i;
 
-	if (!stmt)
-		return isl_bool_error;
+	for (i = 0; i < n; ++i) {
+		isl_bool coincident;
 
-	*p = ppcg_print_body_macros(*p, stmt->ref2expr);
-	if (!*p)
-		return isl_bool_error;
+		coincident = isl_schedule_node_band_member_get_coincident(node,
+									i);
+		if (coincident != isl_bool_false)
+			return coincident;
+	}
 
 	return isl_bool_false;
 }
 
-/* Print the required macros for the CPU AST "node" to "p",
- * including those needed for the user statements inside the AST.
+/* The maximal number of distinct distances between tiles
+ * that are connected by a dependence for which the tiles are executed
+ * as OpenMP tasks.  Each of them results in a depend clause.
  */
-static __isl_give isl_printer *cpu_print_macros(__isl_take isl_printer *p,
-	__isl_keep isl_ast_node *node)
-{
-	if (isl_ast_node_foreach_descendant_top_down(node, &at_node, &p) < 0)
-		return isl_printer_free(p);
-	p = ppcg_print_macros(p, node);
-	return p;
-}
+#define MAX_TASK_DISTANCES	32
 
-/* Initialize the fields of "build_info".
- *
- * Initially, the AST generation is not inside any parallel for loop.
+/* Data used in add_task_distance.
  *
- * The contraction of the entire schedule tree is extracted
- * right underneath the root node.
+ * "band" collects the distances.
+ * "invalid" is set if some distance cannot be expressed
+ * in terms of depend clauses.
  */
-static isl_stat init_build_info(struct ast_build_userinfo *build_info,
-	struct ppcg_scop *scop, __isl_keep isl_schedule *schedule)
+struct ppcg_task_distance_data {
+	struct cpu_task_band *band;
+	int invalid;
+};
+
+/* Add the distance "pnt" to data->band and update the padding.
+ * Set data->invalid and abort if the distance has a negative element or
+ * if there are too many distances.
+ */
+static isl_stat add_task_distance(__isl_take isl_point *pnt, void *user)
 {
-	isl_schedule_node *node = isl_schedule_get_root(schedule);
-	node = isl_schedule_node_child(node, 0);
+	struct ppcg_task_distance_data *data = user;
+	struct cpu_task_band *band = data->band;
+	int i;
+	int *dist;
 
-	build_info->scop = scop;
-	build_info->in_parallel_for = 0;
-	build_info->contraction =
-		isl_schedule_node_get_subtree_contraction(node);
+	if (band->n_dist >= MAX_TASK_DISTANCES)
+		goto invalid;
+	dist = realloc(band->dist,
+			(band->n_dist + 1) * band->n * sizeof(int));
+	if (!dist)
+		goto error;
+	band->dist = dist;
+	dist += band->n_dist * band->n;
+	for (i = 0; i < band->n; ++i) {
+		isl_val *v;
+
+		v = isl_point_get_coordinate_val(pnt, isl_dim_set, i);
+		if (!v)
+			goto error;
+		if (isl_val_is_neg(v)) {
+			isl_val_free(v);
+			goto invalid;
+		}
+		dist[i] = isl_val_get_num_si(v);
+		isl_val_free(v);
+		if (dist[i] > band->pad[i])
+			band->pad[i] = dist[i];
+	}
+	band->n_dist++;
 
-	isl_schedule_node_free(node);
+	isl_point_free(pnt);
+	return isl_stat_ok;
+invalid:
+	data->invalid = 1;
+error:
+	isl_point_free(pnt);
+	return isl_stat_error;
+}
+
+/* Extract the non-zero distances between tiles that are connected
+ * by a dependence from "deltas", living in "space", and store them
+ * in "band".
+ * Return isl_bool_false if these distances cannot be expressed
+ * as a finite set of constant, non-negative vectors.
+ */
+static isl_bool extract_task_distances(struct cpu_task_band *band,
+	__isl_take isl_union_set *deltas, __isl_take isl_space *space)
+{
+	struct ppcg_task_distance_data data = { band, 0 };
+	int i, n_param;
+	isl_set *set, *zero;
+	isl_bool bounded;
+	isl_stat r;
+
+	set = isl_union_set_extract_set(deltas, isl_space_copy(space));
+	isl_union_set_free(deltas);
+	zero = isl_set_universe(space);
+	for (i = 0; i < band->n; ++i)
+		zero = isl_set_fix_si(zero, isl_dim_set, i, 0);
+	set = isl_set_subtract(set, zero);
+	n_param = isl_set_dim(set, isl_dim_param);
+	set = isl_set_project_out(set, isl_dim_param, 0, n_param);
+	bounded = isl_set_is_bounded(set);
+	if (bounded != isl_bool_true) {
+		isl_set_free(set);
+		return bounded;
+	}
+	r = isl_set_foreach_point(set, &add_task_distance, &data);
+	isl_set_free(set);
 
-	return isl_stat_non_null(build_info->contraction);
+	if (data.invalid)
+		return isl_bool_false;
+	return r < 0 ? isl_bool_error : isl_bool_true;
 }
 
-/* Clear all memory allocated by "build_info".
+/* Compute lower bounds on the tile indices in "range",
+ * living in "space", and the corresponding sizes of the array
+ * of dependence objects, taking into account the padding,
+ * and store them in "band".
+ * Return isl_bool_false if the tile indices are not bounded
+ * in terms of the parameters.
  */
-static void clear_build_info(struct ast_build_userinfo *build_info)
+static isl_bool extract_task_bounds(struct cpu_task_band *band,
+	__isl_take isl_union_set *range, __isl_take isl_space *space,
+	__isl_keep isl_set *context)
 {
-	isl_union_pw_multi_aff_free(build_info->contraction);
+	int i;
+	isl_ctx *ctx;
+	isl_set *set;
+	isl_bool ok;
+
+	ctx = isl_space_get_ctx(space);
+	set = isl_union_set_extract_set(range, space);
+	isl_union_set_free(range);
+	set = isl_set_intersect_params(set, isl_set_copy(context));
+	ok = isl_bool_not(isl_set_is_empty(set));
+	if (ok != isl_bool_true)
+		goto done;
+
+	band->lower = isl_pw_aff_list_alloc(ctx, band->n);
+	band->size = isl_pw_aff_list_alloc(ctx, band->n);
+	for (i = 0; i < band->n; ++i) {
+		isl_pw_aff *lower, *upper, *size;
+		isl_aff *one;
+
+		ok = isl_set_dim_has_lower_bound(set, isl_dim_set, i);
+		if (ok == isl_bool_true)
+			ok = isl_set_dim_has_upper_bound(set, isl_dim_set, i);
+		if (ok != isl_bool_true)
+			goto done;
+		lower = isl_set_dim_min(isl_set_copy(set), i);
+		upper = isl_set_dim_max(isl_set_copy(set), i);
+		size = isl_pw_aff_sub(upper, isl_pw_aff_copy(lower));
+		one = isl_aff_zero_on_domain(isl_local_space_from_space(
+					isl_pw_aff_get_domain_space(size)));
+		one = isl_aff_add_constant_si(one, 1 + band->pad[i]);
+		size = isl_pw_aff_add(size, isl_pw_aff_from_aff(one));
+		band->lower = isl_pw_aff_list_add(band->lower, lower);
+		band->size = isl_pw_aff_list_add(band->size, size);
+	}
+
+	if (!band->lower || !band->size)
+		ok = isl_bool_error;
+done:
+	isl_set_free(set);
+	return ok;
 }
 
-/* Code generate the scop 'scop' using "schedule"
- * and print the corresponding C code to 'p'.
+/* Return the dependences that need to be respected by the execution
+ * order of the tiles.  These are the same dependences as those
+ * that need to be respected by parallel loops (see init_build_info),
+ * except that no reductions are taken into account, along with
+ * the forced dependences.
  */
-static __isl_give isl_printer *print_scop(struct ppcg_scop *scop,
-	__isl_take isl_schedule *schedule, __isl_take isl_printer *p,
-	struct ppcg_options *options)
+static __isl_give isl_union_map *task_deps(struct ppcg_scop *scop)
 {
-	isl_ctx *ctx = isl_printer_get_ctx(p);
-	isl_ast_build *build;
-	isl_ast_print_options *print_options;
-	isl_ast_node *tree;
-	isl_id_list *iterators;
-	struct ast_build_userinfo build_info;
-	int depth;
+	isl_union_map *deps;
 
-	depth = 0;
-	if (isl_schedule_foreach_schedule_node_top_down(schedule, &update_depth,
-						&depth) < 0)
-		goto error;
+	deps = isl_union_map_copy(scop->dep_flow);
+	deps = isl_union_map_union(deps, isl_union_map_copy(scop->dep_false));
+	deps = isl_union_map_union(deps, isl_union_map_copy(scop->dep_forced));
+	if (scop->options->live_range_reordering) {
+		isl_union_map *order = isl_union_map_copy(scop->dep_order);
+		deps = isl_union_map_union(deps, order);
+	}
 
-	build = isl_ast_build_alloc(ctx);
-	iterators = ppcg_scop_generate_names(scop, depth, "c");
-	build = isl_ast_build_set_iterators(build, iterators);
-	build = isl_ast_build_set_at_each_domain(build, &at_each_domain, scop);
+	return deps;
+}
 
-	if (options->openmp) {
-		if (init_build_info(&build_info, scop, schedule) < 0)
-			build = isl_ast_build_free(build);
+/* Compute the information needed to execute the tiles
+ * of the tile band node "node", with tile sizes "sizes",
+ * as OpenMP tasks and store it in *band.
+ *
+ * If the tile loops are scaled by the tile sizes, then the tile
+ * loop iterators are first divided by these tile sizes
+ * to obtain the tile indices.
+ * The distances between tiles that are connected by a dependence
+ * are computed from the dependences between statement instances
+ * in the subtree of "node" that are scheduled together
+ * by the outer band nodes.  The dependences are formulated in terms
+ * of the expanded domains, so the schedules and the domain of the subtree
+ * need to be expressed in terms of these expanded domains as well.
+ * Otherwise, dependences between instances that have been grouped
+ * together would be missed.
+ * Return isl_bool_false if these distances or the ranges of the tile loop
+ * iterators are not suitable for expressing the dependences
+ * between the tasks in terms of depend clauses.
+ * In this case, as well as in case of an error, *band is set to NULL.
+ */
+static isl_bool compute_task_band(__isl_keep isl_schedule_node *node,
+	__isl_keep isl_multi_val *sizes, struct ppcg_scop *scop,
+	struct cpu_task_band **band)
+{
+	int i, scale;
+	isl_ctx *ctx;
+	isl_space *space;
+	isl_union_set *domain, *range;
+	isl_union_map *deps, *map;
+	isl_multi_union_pw_aff *prefix, *tile;
+	isl_bool ok;
+
+	ctx = isl_schedule_node_get_ctx(node);
+	*band = isl_calloc_type(ctx, struct cpu_task_band);
+	if (!*band)
+		return isl_bool_error;
+	(*band)->n = isl_schedule_node_band_n_member(node);
+	(*band)->pad = isl_calloc_array(ctx, int, (*band)->n);
+	(*band)->scale = isl_alloc_array(ctx, int, (*band)->n);
+	if (!(*band)->pad || !(*band)->scale) {
+		cpu_task_band_free(*band);
+		*band = NULL;
+		return isl_bool_error;
+	}
+	scale = isl_options_get_tile_scale_tile_loops(ctx);
+	for (i = 0; i < (*band)->n; ++i) {
+		isl_val *v;
 
-		build = isl_ast_build_set_before_each_for(build,
-							&ast_build_before_for,
-							&build_info);
-		build = isl_ast_build_set_after_each_for(build,
-							&ast_build_after_for,
-							&build_info);
+		v = isl_multi_val_get_val(sizes, i);
+		(*band)->scale[i] = scale ? isl_val_get_num_si(v) : 1;
+		isl_val_free(v);
 	}
 
-	tree = isl_ast_build_node_from_schedule(build, schedule);
-	isl_ast_build_free(build);
+	prefix = isl_schedule_node_get_prefix_schedule_multi_union_pw_aff(node);
+	prefix = expand_schedule(node, prefix);
+	tile = isl_schedule_node_band_get_partial_schedule(node);
+	tile = expand_schedule(node, tile);
+	domain = isl_multi_union_pw_aff_domain(
+					isl_multi_union_pw_aff_copy(tile));
+	if (scale)
+		tile = isl_multi_union_pw_aff_scale_down_multi_val(tile,
+						isl_multi_val_copy(sizes));
+	space = isl_multi_union_pw_aff_get_space(tile);
+
+	deps = task_deps(scop);
+	deps = isl_union_map_intersect_domain(deps,
+					isl_union_set_copy(domain));
+	deps = isl_union_map_intersect_range(deps,
+					isl_union_set_copy(domain));
+	if (isl_multi_union_pw_aff_dim(prefix, isl_dim_set) > 0)
+		deps = isl_union_map_eq_at_multi_union_pw_aff(deps, prefix);
+	else
+		isl_multi_union_pw_aff_free(prefix);
+	map = isl_union_map_from_multi_union_pw_aff(tile);
+	deps = isl_union_map_apply_domain(deps, isl_union_map_copy(map));
+	deps = isl_union_map_apply_range(deps, isl_union_map_copy(map));
+	range = isl_union_set_apply(domain, map);
+
+	ok = extract_task_distances(*band, isl_union_map_deltas(deps),
+				isl_space_copy(space));
+	if (ok == isl_bool_true)
+		ok = extract_task_bounds(*band, range, space, scop->context);
+	else {
+		isl_union_set_free(range);
+		isl_space_free(space);
+	}
+	if (ok != isl_bool_true) {
+		cpu_task_band_free(*band);
+		*band = NULL;
+	}
 
-	if (options->openmp)
-		clear_build_info(&build_info);
+	return ok;
+}
 
-	print_options = isl_ast_print_options_alloc(ctx);
-	print_options = isl_ast_print_options_set_print_user(print_options,
-							&print_user, NULL);
+/* Prepare the tiles of the tile band node "node", with tile sizes "sizes",
+ * the child of which is the corresponding point band node,
+ * for being executed as OpenMP tasks, with dependences between the tasks
+ * derived from the dependences between the tiles.
+ *
+ * In particular, insert a mark node between the tile band and
+ * the point band that identifies the tasks and a mark node
+ * on top of the tile band that refers to the information
+ * in a cpu_task_band.  The mark nodes are handled by
+ * ast_build_before_mark and ast_build_after_mark.
+ * Return a pointer to the latter mark node.
+ *
+ * Tasks are not nested, so nothing is done if the subtree
+ * already contains tasks.  The tiles are also executed
+ * in their original order if the dependences between the tiles
+ * cannot be expressed in terms of depend clauses.
+ */
+static __isl_give isl_schedule_node *insert_tasks(
+	__isl_take isl_schedule_node *node, __isl_keep isl_multi_val *sizes,
+	struct ppcg_scop *scop)
+{
+	isl_bool nested, expressible;
+	isl_ctx *ctx;
+	isl_id *id;
+	struct cpu_task_band *band;
 
-	print_options = isl_ast_print_options_set_print_for(print_options,
-							&print_for, NULL);
+	nested = has_mark(node, task_region_name);
+	if (nested < 0)
+		return isl_schedule_node_free(node);
+	if (nested)
+		return node;
 
-	p = cpu_print_macros(p, tree);
-	p = isl_ast_node_print(tree, p, print_options);
+	expressible = compute_task_band(node, sizes, scop, &band);
+	if (expressible < 0)
+		return isl_schedule_node_free(node);
+	if (!expressible)
+		return node;
 
-	isl_ast_node_free(tree);
+	ctx = isl_schedule_node_get_ctx(node);
+	id = isl_id_alloc(ctx, task_region_name, band);
+	id = isl_id_set_free_user(id, &cpu_task_band_free);
+	node = isl_schedule_node_child(node, 0);
+	node = isl_schedule_node_insert_mark(node,
+					isl_id_alloc(ctx, task_name, NULL));
+	node = isl_schedule_node_parent(node);
+	node = isl_schedule_node_insert_mark(node, id);
 
-	return p;
-error:
-	isl_schedule_free(schedule);
-	isl_printer_free(p);
-	return NULL;
+	return node;
 }
 
-/* Tile the band node "node" with tile sizes "sizes" and
- * mark all members of the resulting tile node as "atomic".
+/* The possible outcomes of try_hybrid_tile.
+ *
+ * ppcg_hybrid_no_pattern means that "node" and its parent do not have
+ * the required form.  The tile sizes of the band have not been read.
+ * ppcg_hybrid_rejected means that hybrid tiling was considered,
+ * but that it cannot be applied with the tile sizes of the band.
+ * If these tile sizes were specified by the user, then they
+ * are meant for hybrid tiling.
+ * ppcg_hybrid_applied means that hybrid tiling was applied.
  */
-static __isl_give isl_schedule_node *tile(__isl_take isl_schedule_node *node,
-	__isl_take isl_multi_val *sizes)
+enum ppcg_hybrid_status {
+	ppcg_hybrid_no_pattern,
+	ppcg_hybrid_rejected,
+	ppcg_hybrid_applied
+};
+
+/* See if hybrid tiling can be performed on "node" and its parent,
+ * where "id" is the sequence number of "node" among the tiled bands,
+ * and store the outcome in *status.
+ * If so, apply hybrid tiling and return a pointer to the outer node
+ * of the result, which replaces the parent of "node".
+ * If not, return the original schedule tree.
+ * Return NULL on error.
+ *
+ * If hybrid tiling is rejected, then *user_sizes is set
+ * if the user specified tile sizes for the band that could have been
+ * used for hybrid tiling.
+ * The tile sizes are only added to data->used_sizes
+ * if hybrid tiling is applied.
+ *
+ * The tile sizes are read in the same way as in try_hybrid_tile
+ * in gpu.c, except that they default to the "tile_size" option.
+ * That is, the first tile size is half the size of the tile
+ * in the time dimension of the parent, the second is the base of
+ * the hexagon and the remaining sizes apply to the remaining members
+ * of "node", which are split off if fewer sizes are specified.
+ * Unlike on GPUs, where an error is reported,
+ * hybrid tiling is not applied if the base of the hexagon
+ * is not sufficiently wide for the computed dependence distance bounds.
+ *
+ * Within each time tile, the hexagonal tiles of each phase
+ * are independent of each other.  The outer space tile loop
+ * of each phase is therefore detected as a parallel loop
+ * by ast_schedule_dim_is_parallel, while the sequential time tile loop
+ * keeps the two phases separated by a barrier.  If the openmp_regions
+ * option is set, then the two phases are moreover executed
+ * inside a single parallel region, as described in mark_openmp_regions.
+ * The phase marks are removed since they are not needed
+ * during code generation.
+ */
+static __isl_give isl_schedule_node *try_hybrid_tile(
+	__isl_take isl_schedule_node *node, struct cpu_tile_data *data, int id,
+	enum ppcg_hybrid_status *status, int *user_sizes)
 {
-	node = isl_schedule_node_band_tile(node, sizes);
-	node = ppcg_set_schedule_node_type(node, isl_ast_loop_atomic);
+	int i, len;
+	int *sizes;
+	isl_bool ok, user;
+	isl_space *space;
+	isl_multi_val *mv;
+	isl_schedule_node *orig = node;
+	ppcg_ht_bounds *bounds;
+	struct ppcg_scop *scop = data->scop;
+
+	*status = ppcg_hybrid_no_pattern;
+	*user_sizes = 0;
+	ok = ppcg_ht_parent_has_input_pattern(node);
+	if (ok < 0)
+		return isl_schedule_node_free(node);
+	if (!ok)
+		return orig;
+
+	*status = ppcg_hybrid_rejected;
+	len = 1 + isl_schedule_node_band_n_member(node);
+	sizes = isl_alloc_array(isl_schedule_node_get_ctx(node), int, len);
+	if (!sizes)
+		return isl_schedule_node_free(node);
+	for (i = 0; i < len; ++i)
+		sizes[i] = scop->options->tile_size;
+	user = extract_band_tile_sizes(data, "tile", id, sizes, &len);
+	*user_sizes = user == isl_bool_true && len >= 2;
+	if (user < 0 || len < 2) {
+		free(sizes);
+		return user < 0 ? isl_schedule_node_free(node) : orig;
+	}
+
+	node = isl_schedule_node_copy(node);
+	if (len - 1 < isl_schedule_node_band_n_member(node))
+		node = isl_schedule_node_band_split(node, len - 1);
+	space = isl_schedule_node_band_get_space(node);
+	node = isl_schedule_node_parent(node);
+	space = isl_space_product(isl_schedule_node_band_get_space(node),
+				space);
+	mv = ppcg_multi_val_from_int_list(space, sizes);
+	bounds = ppcg_ht_compute_bounds(scop, node);
+
+	ok = ppcg_ht_bounds_supports_sizes(bounds, mv);
+	if (ok == isl_bool_true &&
+	    record_band_tile_sizes(data, "tile", id, sizes, len) < 0)
+		ok = isl_bool_error;
+	free(sizes);
+	if (ok < 0 || !ok) {
+		ppcg_ht_bounds_free(bounds);
+		isl_multi_val_free(mv);
+		isl_schedule_node_free(node);
+		if (ok < 0)
+			return isl_schedule_node_free(orig);
+		return orig;
+	}
+	isl_schedule_node_free(orig);
+	*status = ppcg_hybrid_applied;
+
+	node = ppcg_ht_bounds_insert_tiling(bounds, mv, node, scop->options);
+	node = hybrid_tile_drop_phase_marks(node);
 
 	return node;
 }
 
 /* Tile "node", if it is a band node with at least 2 members.
- * The tile sizes are set from the "tile_size" option.
+ * The bands are numbered in the order in which they are tiled,
+ * i.e., bands nested inside other bands come first.
+ * The tile sizes are set from the "tile_size" option,
+ * unless other tile sizes are specified for the band
+ * through the "sizes" option in data->sizes.
+ * If the "auto_tile_sizes" option is set, then tile sizes that
+ * fit the data caches are first added to data->sizes
+ * for bands without user specified tile sizes.
+ * If fewer tile sizes are specified than there are band members,
+ * then only the corresponding outer members are tiled.
+ *
+ * If the "wavefront" and "openmp" options are set and if none
+ * of the members of the permutable band is coincident, then
+ * none of the tile loops could be executed in parallel.
+ * Skew the tile loops into a wavefront in this case
+ * such that all but the outer tile loop can be executed in parallel.
+ * Note that the coincidence of the band members is only computed
+ * if the "openmp" option is set.
+ *
+ * If the "openmp" and "openmp_tasks" options are set, then the tiles
+ * are executed as OpenMP tasks instead.  The dependences between
+ * the tasks allow them to be executed in a wavefront
+ * without any explicit skewing.
+ *
+ * If the "openmp" and "hybrid" options are set, then hybrid tiling
+ * is first tried on "node" and its parent, which may have
+ * a single member.  If it is applied, then a pointer to the result
+ * is returned, which is located at the position of the parent.
+ * The "tile" option only controls the classical tiling.
+ * If hybrid tiling is rejected for a band with user specified
+ * tile sizes, then these sizes are meant for hybrid tiling and
+ * are not reinterpreted as sizes for the classical tiling.
+ * The band is then tiled with the default tile sizes instead.
+ * Executing the tiles of a band that is tiled using hybrid tiling
+ * as OpenMP tasks is not supported.  The "openmp_tasks" option
+ * is ignored for such bands, whose hexagonal tiles within
+ * each phase are executed by parallel loops instead.
  */
 static __isl_give isl_schedule_node *tile_band(
 	__isl_take isl_schedule_node *node, void *user)
 {
-	struct ppcg_scop *scop = user;
-	int n;
-	isl_space *space;
-	isl_multi_val *sizes;
+	struct cpu_tile_data *data = user;
+	struct ppcg_scop *scop = data->scop;
+	int i, n, id, len;
+	int *sizes;
+	int hybrid_sizes = 0;
+	isl_bool coincident;
+	isl_multi_val *mv;
 
 	if (isl_schedule_node_get_type(node) != isl_schedule_node_band)
 		return node;
 
+	if (scop->options->openmp && scop->options->hybrid) {
+		enum ppcg_hybrid_status status;
+
+		node = try_hybrid_tile(node, data, data->band_id,
+					&status, &hybrid_sizes);
+		if (!node)
+			return NULL;
+		if (status == ppcg_hybrid_applied) {
+			data->band_id++;
+			return node;
+		}
+	}
+	if (!scop->options->tile)
+		return node;
+
 	n = isl_schedule_node_band_n_member(node);
 	if (n <= 1)
 		return node;
 
-	space = isl_schedule_node_band_get_space(node);
-	sizes = ppcg_multi_val_from_int(space, scop->options->tile_size);
+	id = data->band_id++;
+	if (data->cache && !hybrid_sizes &&
+	    select_cache_tile_sizes(node, data, id) < 0)
+		return isl_schedule_node_free(node);
+	sizes = isl_alloc_array(isl_schedule_node_get_ctx(node), int, n);
+	if (!sizes)
+		return isl_schedule_node_free(node);
+	for (i = 0; i < n; ++i)
+		sizes[i] = scop->options->tile_size;
+	len = n;
+	if (hybrid_sizes) {
+		if (record_band_tile_sizes(data, "tile", id, sizes, len) < 0)
+			node = isl_schedule_node_free(node);
+	} else if (read_band_tile_sizes(data, "tile", id, sizes, &len) < 0)
+		node = isl_schedule_node_free(node);
+	if (!node || len == 0) {
+		free(sizes);
+		return node;
+	}
+
+	if (scop->options->openmp && scop->options->openmp_tasks) {
+		node = tile(node, sizes, len, data, id, 0);
+		mv = ppcg_multi_val_from_int_list(
+				isl_schedule_node_band_get_space(node), sizes);
+		node = insert_tasks(node, mv, scop);
+		isl_multi_val_free(mv);
+		free(sizes);
+		return node;
+	}
+	if (!scop->options->openmp || !scop->options->wavefront ||
+	    isl_schedule_node_band_get_permutable(node) != isl_bool_true) {
+		node = tile(node, sizes, len, data, id, 0);
+		free(sizes);
+		return node;
+	}
+	coincident = has_coincident_member(node, len);
+	if (coincident < 0)
+		node = isl_schedule_node_free(node);
+	node = tile(node, sizes, len, data, id,
+			coincident == isl_bool_false);
+	free(sizes);
 
-	return tile(node, sizes);
+	return node;
 }
 
 /* Construct schedule constraints from the dependences in ps
@@ -704,6 +4944,11 @@ static __isl_give isl_schedule_constraints *construct_cpu_schedule_constraints(
  * First derive the appropriate schedule constraints from the dependences
  * in "ps" and then compute a schedule from those schedule constraints,
  * possibly grouping statement instances based on the input schedule.
+ *
+ * If hybrid tiling may be applied, then the outer dimension of each band
+ * is required to be coincident, as on GPU targets, such that
+ * a sequential (time) dimension ends up in a separate band
+ * on top of a band of coincident (space) dimensions.
  */
 static __isl_give isl_schedule *compute_cpu_schedule(struct ppcg_scop *ps)
 {
@@ -715,7 +4960,18 @@ static __isl_give isl_schedule *compute_cpu_schedule(struct ppcg_scop *ps)
 
 	sc = construct_cpu_schedule_constraints(ps);
 
-	schedule = ppcg_compute_schedule(sc, ps->schedule, ps->options);
+	if (ps->options->openmp && ps->options->hybrid) {
+		isl_ctx *ctx = isl_union_set_get_ctx(ps->domain);
+		int outer = isl_options_get_schedule_outer_coincidence(ctx);
+
+		isl_options_set_schedule_outer_coincidence(ctx, 1);
+		schedule = ppcg_compute_schedule(sc, ps->schedule,
+						ps->options);
+		isl_options_set_schedule_outer_coincidence(ctx, outer);
+	} else {
+		schedule = ppcg_compute_schedule(sc, ps->schedule,
+						ps->options);
+	}
 
 	return schedule;
 }
@@ -734,8 +4990,295 @@ static __isl_give isl_schedule *optionally_compute_schedule(void *user)
 	return compute_cpu_schedule(ps);
 }
 
+/* Tile the bands in "schedule" of the scop "ps", taking into account
+ * the tile sizes specified through the "sizes" option, if any.
+ * If the "dump_sizes" option is set, then print the effectively
+ * used tile sizes.
+ */
+static __isl_give isl_schedule *tile_schedule(__isl_take isl_schedule *schedule,
+	struct ppcg_scop *ps, struct ppcg_options *options)
+{
+	isl_ctx *ctx = isl_schedule_get_ctx(schedule);
+	struct cpu_tile_data data = { ps, NULL, NULL, 0, 0, NULL };
+
+	if (options->sizes)
+		data.sizes = isl_union_map_read_from_str(ctx, options->sizes);
+	if (options->auto_tile_sizes)
+		data.cache = ppcg_machine_cache_sizes(options->cache_sizes,
+							&data.n_cache);
+	if (options->debug->dump_sizes) {
+		isl_space *space = isl_space_params_alloc(ctx, 0);
+		data.used_sizes = isl_union_map_empty(space);
+	}
+
+	schedule = isl_schedule_map_schedule_node_bottom_up(schedule,
+							&tile_band, &data);
+
+	if (options->debug->dump_sizes) {
+		isl_union_map_dump(data.used_sizes);
+		isl_union_map_free(data.used_sizes);
+	}
+	isl_union_map_free(data.sizes);
+	free(data.cache);
+
+	return schedule;
+}
+
+/* The maximal number of elements in the local buffer of an array
+ * that is kept in local variables inside an innermost loop.
+ * These elements are meant to be kept in registers.
+ */
+#define MAX_PRIVATE_ELEMENTS	UNROLL_JAM_REGISTERS
+
+/* Data used in check_unsupported_access.
+ *
+ * "id" identifies the array under consideration and
+ * "n_index" is its number of indices.
+ * "written" is set if the array is written inside the innermost loop.
+ * "unsupported" is set if an access that cannot be replaced
+ * by an access to the local variables is found.
+ */
+struct ppcg_unsupported_access_data {
+	isl_id *id;
+	int n_index;
+	int written;
+	int unsupported;
+};
+
+/* Set data->unsupported if "expr" accesses the array identified by data->id
+ * with an index that is not an affine expression in the loop iterators
+ * and the parameters or, if the array is written,
+ * with fewer than data->n_index indices.
+ * Indices that depend on data or that are not affine are represented
+ * by pet as arguments of the access expression.
+ */
+static int check_unsupported_access(__isl_keep pet_expr *expr, void *user)
+{
+	struct ppcg_unsupported_access_data *data = user;
+	isl_multi_pw_aff *index;
+	isl_id *id;
+
+	index = pet_expr_access_get_index(expr);
+	if (!index)
+		return -1;
+	if (isl_multi_pw_aff_has_tuple_id(index, isl_dim_out)) {
+		id = isl_multi_pw_aff_get_tuple_id(index, isl_dim_out);
+		if (id == data->id && pet_expr_get_n_arg(expr) > 0)
+			data->unsupported = 1;
+		if (id == data->id && data->written &&
+		    isl_multi_pw_aff_dim(index, isl_dim_out) < data->n_index)
+			data->unsupported = 1;
+		isl_id_free(id);
+	}
+	isl_multi_pw_aff_free(index);
+
+	return 0;
+}
+
+/* Does any statement in "scop" access "array" in a way that
+ * prevents the accesses from being replaced by accesses
+ * to local variables?
+ * This is the case if any access has an index that depends on data
+ * or that is not affine since the corresponding element
+ * of the local variables cannot be determined at compile time.
+ * If the array is written ("written" is set), then it is also the case
+ * if any access uses fewer indices than the array has dimensions,
+ * e.g., by passing a row of the array to a function.
+ */
+static isl_bool has_unsupported_access(struct ppcg_scop *scop,
+	struct pet_array *array, int written)
+{
+	int i;
+	struct ppcg_unsupported_access_data data;
+
+	data.id = isl_set_get_tuple_id(array->extent);
+	data.n_index = isl_set_dim(array->extent, isl_dim_set);
+	data.written = written;
+	data.unsupported = 0;
+	for (i = 0; !data.unsupported && i < scop->pet->n_stmt; ++i) {
+		struct pet_stmt *stmt = scop->pet->stmts[i];
+
+		if (pet_tree_foreach_access_expr(stmt->body,
+					&check_unsupported_access, &data) < 0) {
+			isl_id_free(data.id);
+			return isl_bool_error;
+		}
+	}
+	isl_id_free(data.id);
+
+	return data.unsupported ? isl_bool_true : isl_bool_false;
+}
+
+/* Check whether the elements of "array" that are accessed
+ * by the statement instances in "prefix" should be kept
+ * in local variables inside the innermost loop and, if so,
+ * store the information in "packed".
+ * "prefix" maps the statement instances inside the innermost loop
+ * to the outer schedule dimensions D, i.e., all schedule dimensions
+ * except the innermost.
+ * Return isl_bool_true if the elements should be kept in local variables.
+ *
+ * The local variables are only useful if some of the accessed elements
+ * are accessed in several iterations of the innermost loop,
+ * e.g., because the access does not depend on the innermost loop.
+ * The accessed elements need to fit in a box of fixed size
+ * of at most MAX_PRIVATE_ELEMENTS elements, which means in particular
+ * that the number of accessed elements does not depend
+ * on the number of iterations of the innermost loop.
+ * The written elements are copied back after the innermost loop.
+ * Since all accesses to the array inside the innermost loop then need
+ * to refer to the local variables, arrays are not considered
+ * if any of the accesses to the array has an index that depends on data
+ * or that is not affine, or, for arrays that are written,
+ * if any of the accesses refers to only part of the array.
+ * They are also not considered if the openmp_reductions option is set
+ * since the reduction clauses refer to the original arrays.
+ * Arrays of structures and scalars are not supported.
+ */
+static isl_bool compute_private_array(struct pet_array *array,
+	__isl_keep isl_union_map *prefix, struct ppcg_scop *scop,
+	struct cpu_packed_array *packed)
+{
+	isl_bool written, skip, empty, reuse;
+	isl_union_set *domain;
+	isl_union_map *writes, *accesses;
+
+	if (array->element_is_record ||
+	    isl_set_dim(array->extent, isl_dim_set) == 0)
+		return isl_bool_false;
+
+	domain = isl_union_map_domain(isl_union_map_copy(prefix));
+	writes = array_accesses(scop->may_writes, domain, array);
+	accesses = array_accesses(scop->reads, domain, array);
+	isl_union_set_free(domain);
+	accesses = isl_union_map_union(accesses, isl_union_map_copy(writes));
+	written = isl_bool_not(isl_union_map_is_empty(writes));
+	skip = isl_bool_false;
+	if (written == isl_bool_true && scop->options->openmp_reductions)
+		skip = isl_bool_true;
+	else if (written >= 0)
+		skip = has_unsupported_access(scop, array, written);
+	empty = isl_union_map_is_empty(accesses);
+	reuse = isl_bool_false;
+	if (skip == isl_bool_false && empty == isl_bool_false)
+		reuse = has_reuse(prefix, accesses);
+	if (written < 0 || skip < 0 || empty < 0 || reuse != isl_bool_true) {
+		isl_union_map_free(writes);
+		isl_union_map_free(accesses);
+		if (written < 0 || skip < 0 || empty < 0)
+			return isl_bool_error;
+		return reuse;
+	}
+
+	accesses = isl_union_map_apply_domain(accesses,
+					isl_union_map_copy(prefix));
+	reuse = compute_local_buffer(array, isl_map_from_union_map(accesses),
+			MAX_PRIVATE_ELEMENTS * array->element_size, 0,
+			"private_", packed);
+	if (reuse == isl_bool_true && written) {
+		writes = isl_union_map_apply_domain(writes,
+					isl_union_map_copy(prefix));
+		packed->write = isl_map_from_union_map(writes);
+		if (!packed->write)
+			return isl_bool_error;
+	} else {
+		isl_union_map_free(writes);
+	}
+
+	return reuse;
+}
+
+/* If "node" is a band node with a leaf child, then keep the elements
+ * of the arrays that are reused in several iterations
+ * of its innermost member in local variables, if any.
+ *
+ * The arrays are determined by compute_private_array and
+ * they are recorded in a mark node that is inserted right above
+ * the innermost member, after splitting it off from the other members.
+ * This mark node is handled by ast_build_before_mark and
+ * ast_build_after_mark, such that the elements are loaded
+ * before the innermost loop and stored back after the loop.
+ * Innermost members that are completely unrolled are skipped
+ * since the compiler can already keep the values in registers.
+ * When generating OpenMP code, coincident innermost members
+ * are skipped as well.  The corresponding loops may end up
+ * being executed as (collapsed) openmp parallel for loops
+ * or inside an openmp parallel region around an outer loop,
+ * while the user node that replaces the mark would hide them
+ * from the detection of perfectly nested parallel loops
+ * in collect_collapsed_iterators and from is_hoistable.
+ */
+static __isl_give isl_schedule_node *replace_scalars(
+	__isl_take isl_schedule_node *node, void *user)
+{
+	struct ppcg_scop *scop = user;
+	int n;
+	isl_bool leaf;
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_schedule_node *child;
+	isl_multi_union_pw_aff *mupa, *partial;
+	isl_union_map *prefix;
+	struct cpu_pack *pack;
+
+	if (isl_schedule_node_get_type(node) != isl_schedule_node_band)
+		return node;
+	child = isl_schedule_node_get_child(node, 0);
+	leaf = isl_schedule_node_get_type(child) == isl_schedule_node_leaf;
+	isl_schedule_node_free(child);
+	n = isl_schedule_node_band_n_member(node);
+	if (!leaf || n == 0)
+		return node;
+	if (isl_schedule_node_band_member_get_ast_loop_type(node, n - 1) ==
+	    isl_ast_loop_unroll)
+		return node;
+	if (scop->options->openmp) {
+		isl_bool coincident;
+
+		coincident = isl_schedule_node_band_member_get_coincident(node,
+									n - 1);
+		if (coincident < 0)
+			return isl_schedule_node_free(node);
+		if (coincident)
+			return node;
+	}
+
+	mupa = isl_schedule_node_get_prefix_schedule_multi_union_pw_aff(node);
+	partial = isl_schedule_node_band_get_partial_schedule(node);
+	partial = isl_multi_union_pw_aff_drop_dims(partial, isl_dim_set,
+						n - 1, 1);
+	mupa = isl_multi_union_pw_aff_flat_range_product(mupa, partial);
+	mupa = expand_schedule(node, mupa);
+	prefix = isl_union_map_from_multi_union_pw_aff(mupa);
+	pack = collect_local_buffers(prefix, scop, &compute_private_array);
+	isl_union_map_free(prefix);
+	if (!pack)
+		return isl_schedule_node_free(node);
+	if (pack->n == 0) {
+		cpu_pack_free(pack);
+		return node;
+	}
+	pack->depth = isl_schedule_node_get_schedule_depth(node) + n - 1;
+
+	if (n > 1) {
+		node = isl_schedule_node_band_split(node, n - 1);
+		node = isl_schedule_node_child(node, 0);
+	}
+	ctx = isl_schedule_node_get_ctx(node);
+	id = isl_id_alloc(ctx, private_name, pack);
+	id = isl_id_set_free_user(id, &cpu_pack_free);
+	node = isl_schedule_node_insert_mark(node, id);
+	if (n > 1)
+		node = isl_schedule_node_parent(node);
+
+	return node;
+}
+
 /* Compute a schedule based on the dependences in "ps" and
- * tile it if requested by the user.
+ * tile it if requested by the user, either through the "tile" option or
+ * through the "hybrid" option in combination with the "openmp" option.
+ * If the "scalar_replacement" option is set, then reused array elements
+ * are kept in local variables inside the innermost loops.
  */
 static __isl_give isl_schedule *get_schedule(struct ppcg_scop *ps,
 	struct ppcg_options *options)
@@ -749,9 +5292,12 @@ static __isl_give isl_schedule *get_schedule(struct ppcg_scop *ps,
 	ctx = isl_union_set_get_ctx(ps->domain);
 	schedule = ppcg_get_schedule(ctx, options,
 				    &optionally_compute_schedule, ps);
-	if (ps->options->tile)
+	if (ps->options->tile ||
+	    (ps->options->openmp && ps->options->hybrid))
+		schedule = tile_schedule(schedule, ps, options);
+	if (ps->options->scalar_replacement)
 		schedule = isl_schedule_map_schedule_node_bottom_up(schedule,
-							&tile_band, ps);
+							&replace_scalars, ps);
 
 	return schedule;
 }
@@ -833,6 +5379,9 @@ static __isl_give isl_printer *print_cpu_wrap(__isl_take isl_printer *p,
 /* Transform the code in the file called "input" by replacing
  * all scops by corresponding CPU code and write the results to a file
  * called "output".
+ * If tiles may get executed as OpenMP tasks, then the generated code
+ * may call malloc, free and abort, so <stdlib.h> is included
+ * at the start of the output.
  */
 int generate_cpu(isl_ctx *ctx, struct ppcg_options *options,
 	const char *input, const char *output)
@@ -844,6 +5393,8 @@ int generate_cpu(isl_ctx *ctx, struct ppcg_options *options,
 	if (!output_file)
 		return -1;
 
+	if (options->openmp && options->openmp_tasks)
+		fprintf(output_file, "#include <stdlib.h>\n");
 	r = ppcg_transform(ctx, input, output_file, options,
 					&print_cpu_wrap, options);
 
@@ -0,0 +1,618 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <isl/ctx.h>
+#include <isl/printer.h>
+#include <pet.h>
+
+#include "extract_cache.h"
+
+/* Update the 64-bit FNV-1a hash "hash" with the "len" bytes in "data".
+ */
+static unsigned long long hash_data(unsigned long long hash,
+	const char *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= (unsigned char) data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/* Read the entire contents of the file called "filename" and
+ * return them as a null-terminated string, storing the length
+ * of the contents in *len.
+ * Return NULL if the file cannot be read.
+ */
+static char *read_file(const char *filename, size_t *len)
+{
+	FILE *file;
+	char *text;
+	long size;
+
+	file = fopen(filename, "rb");
+	if (!file)
+		return NULL;
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+	    fseek(file, 0, SEEK_SET) != 0) {
+		fclose(file);
+		return NULL;
+	}
+	text = malloc(size + 1);
+	if (text && fread(text, 1, size, file) != size) {
+		free(text);
+		text = NULL;
+	}
+	fclose(file);
+	if (!text)
+		return NULL;
+	text[size] = '\0';
+	*len = size;
+
+	return text;
+}
+
+/* Maximal nesting depth of included headers that is taken into account
+ * in the hash of an input file.
+ */
+#define MAX_INCLUDE_DEPTH	8
+
+/* Return the concatenation of the "dir_len" first characters of "dir",
+ * a slash and the "name_len" first characters of "name".
+ */
+static char *join_path(const char *dir, size_t dir_len,
+	const char *name, size_t name_len)
+{
+	char *path;
+
+	path = malloc(dir_len + 1 + name_len + 1);
+	if (!path)
+		return NULL;
+	memcpy(path, dir, dir_len);
+	path[dir_len] = '/';
+	memcpy(path + dir_len + 1, name, name_len);
+	path[dir_len + 1 + name_len] = '\0';
+
+	return path;
+}
+
+/* Return the length of the directory part of the path "path",
+ * i.e., the position of the final slash.
+ * Set *dir to "." if there is no such slash.
+ */
+static size_t dir_part(const char *path, const char **dir)
+{
+	const char *slash = strrchr(path, '/');
+
+	if (!slash) {
+		*dir = ".";
+		return 1;
+	}
+	*dir = path;
+	return slash - path;
+}
+
+/* Find the next include directory in the command line "key",
+ * which has one argument per line, starting at *pos.
+ * An include directory is specified as "-I<dir>", "-I" followed
+ * by "<dir>" on the next line, or "--include-path=<dir>".
+ * Return a pointer to the start of the directory, store its length
+ * in *len and advance *pos past the directory.
+ * Return NULL if there is no further include directory.
+ */
+static const char *next_include_dir(const char **pos, size_t *len)
+{
+	const char *line = *pos;
+	const char *opt = "--include-path=";
+
+	while (line && *line) {
+		const char *dir = NULL;
+		const char *eol;
+
+		if (!strncmp(line, "-I", 2))
+			dir = line + 2;
+		else if (!strncmp(line, opt, strlen(opt)))
+			dir = line + strlen(opt);
+		if (dir && *dir == '\n')
+			dir++;
+		eol = strchr(dir ? dir : line, '\n');
+		if (dir) {
+			*len = eol ? eol - dir : strlen(dir);
+			*pos = eol ? eol + 1 : dir + *len;
+			if (*len > 0)
+				return dir;
+		}
+		line = eol ? eol + 1 : NULL;
+		*pos = line;
+	}
+
+	return NULL;
+}
+
+static unsigned long long hash_includes(unsigned long long hash,
+	const char *text, size_t len, const char *dir, size_t dir_len,
+	const char *key, int depth);
+
+/* Update "hash" with the contents of the header "name" of length
+ * "name_len" and, recursively, with the headers it includes.
+ * If "quoted" is set, then the header is first looked up in the directory
+ * "dir" of length "dir_len" of the including file.
+ * Otherwise, or if it cannot be found there, the header is looked up
+ * in the include directories specified in the command line "key".
+ * If the header cannot be found, e.g., because it is a system header,
+ * then only its name is taken into account.
+ */
+static unsigned long long hash_header(unsigned long long hash,
+	const char *name, size_t name_len, int quoted,
+	const char *dir, size_t dir_len, const char *key, int depth)
+{
+	const char *pos = key;
+	const char *header_dir;
+	char *path = NULL;
+	char *text = NULL;
+	size_t len;
+
+	hash = hash_data(hash, name, name_len);
+	if (name_len > 0 && name[0] == '/')
+		path = join_path("", 0, name + 1, name_len - 1);
+	else if (quoted)
+		path = join_path(dir, dir_len, name, name_len);
+	if (path)
+		text = read_file(path, &len);
+	while (!text) {
+		free(path);
+		path = NULL;
+		dir = next_include_dir(&pos, &dir_len);
+		if (!dir)
+			return hash;
+		path = join_path(dir, dir_len, name, name_len);
+		if (!path)
+			return hash;
+		text = read_file(path, &len);
+	}
+
+	hash = hash_data(hash, text, len);
+	dir_len = dir_part(path, &header_dir);
+	hash = hash_includes(hash, text, len, header_dir, dir_len,
+				key, depth + 1);
+	free(text);
+	free(path);
+
+	return hash;
+}
+
+/* Skip spaces and tabs in "p", up to "end".
+ */
+static const char *skip_blanks(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		++p;
+	return p;
+}
+
+/* Update "hash" with the contents of the headers included
+ * by the text "text" of length "len" of a file in directory "dir"
+ * of length "dir_len".
+ * Only lines of the form
+ *
+ *	#include "header"
+ *	#include <header>
+ *
+ * are taken into account.
+ */
+static unsigned long long hash_includes(unsigned long long hash,
+	const char *text, size_t len, const char *dir, size_t dir_len,
+	const char *key, int depth)
+{
+	const char *p = text;
+	const char *end = text + len;
+
+	if (depth >= MAX_INCLUDE_DEPTH)
+		return hash;
+
+	while (p < end) {
+		const char *eol, *name;
+		char close;
+
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		p = skip_blanks(p, eol);
+		if (p < eol && *p == '#')
+			p = skip_blanks(p + 1, eol);
+		else
+			p = eol;
+		if (eol - p >= 7 && !strncmp(p, "include", 7)) {
+			p = skip_blanks(p + 7, eol);
+			close = p < eol && *p == '<' ? '>' : '"';
+			if (p < eol && (*p == '<' || *p == '"')) {
+				name = ++p;
+				while (p < eol && *p != close)
+					++p;
+				if (p < eol)
+					hash = hash_header(hash, name, p - name,
+						close == '"', dir, dir_len,
+						key, depth);
+			}
+		}
+		p = eol + 1;
+	}
+
+	return hash;
+}
+
+/* Return the name of the file in the cache that holds
+ * extracted scop "i" of the input with cache file prefix "base",
+ * or the file that holds the number of extracted scops if "i" is negative.
+ */
+static char *cache_file_name(const char *base, int i)
+{
+	size_t len = strlen(base) + 32;
+	char *name;
+
+	name = malloc(len);
+	if (!name)
+		return NULL;
+	if (i < 0)
+		snprintf(name, len, "%s.n", base);
+	else
+		snprintf(name, len, "%s-%d.yaml", base, i);
+
+	return name;
+}
+
+/* Atomically replace the file called "filename" by the file
+ * called "tmp".  Remove "tmp" if this fails.
+ * Return 0 on success and -1 on failure.
+ */
+static int move_into_place(const char *tmp, const char *filename)
+{
+	if (rename(tmp, filename) == 0)
+		return 0;
+	remove(tmp);
+	return -1;
+}
+
+/* Open a temporary file for writing a new version of "filename"
+ * and store its name in *tmp.
+ * The name of the temporary file is specific to this process
+ * such that concurrently running ppcg processes do not interfere
+ * with each other.
+ */
+static FILE *open_tmp(const char *filename, char **tmp)
+{
+	size_t len = strlen(filename) + 32;
+	FILE *file;
+
+	*tmp = malloc(len);
+	if (!*tmp)
+		return NULL;
+	snprintf(*tmp, len, "%s.%ld.tmp", filename, (long) getpid());
+	file = fopen(*tmp, "w");
+	if (!file) {
+		free(*tmp);
+		*tmp = NULL;
+	}
+
+	return file;
+}
+
+/* Store "scop" as extracted scop "i" in the cache files with prefix "base".
+ * Return 0 on success and -1 on failure.
+ */
+static int save_scop(struct pet_scop *scop, const char *base, int i)
+{
+	FILE *file;
+	char *name, *tmp;
+	int r;
+
+	name = cache_file_name(base, i);
+	if (!name)
+		return -1;
+	file = open_tmp(name, &tmp);
+	if (!file) {
+		free(name);
+		return -1;
+	}
+	r = pet_scop_emit(file, scop);
+	if (fclose(file) != 0)
+		r = -1;
+	if (r >= 0)
+		r = move_into_place(tmp, name);
+	else
+		remove(tmp);
+	free(tmp);
+	free(name);
+
+	return r;
+}
+
+/* Record that the input with cache file prefix "base" contains "n" scops.
+ * This file is written last such that its presence guarantees
+ * that all extracted scops are available.
+ * Return 0 on success and -1 on failure.
+ */
+static int save_n_scop(const char *base, int n)
+{
+	FILE *file;
+	char *name, *tmp;
+	int r;
+
+	name = cache_file_name(base, -1);
+	if (!name)
+		return -1;
+	file = open_tmp(name, &tmp);
+	if (!file) {
+		free(name);
+		return -1;
+	}
+	r = fprintf(file, "%d\n", n) < 0 ? -1 : 0;
+	if (fclose(file) != 0)
+		r = -1;
+	if (r >= 0)
+		r = move_into_place(tmp, name);
+	else
+		remove(tmp);
+	free(tmp);
+	free(name);
+
+	return r;
+}
+
+/* Return the number of scops recorded in the cache for the input
+ * with cache file prefix "base", or -1 if the input is not in the cache.
+ */
+static int load_n_scop(const char *base)
+{
+	FILE *file;
+	char *name;
+	int n;
+
+	name = cache_file_name(base, -1);
+	if (!name)
+		return -1;
+	file = fopen(name, "r");
+	free(name);
+	if (!file)
+		return -1;
+	if (fscanf(file, "%d", &n) != 1 || n < 0)
+		n = -1;
+	fclose(file);
+
+	return n;
+}
+
+/* Load extracted scop "i" from the cache files with prefix "base".
+ */
+static struct pet_scop *load_scop(isl_ctx *ctx, const char *base, int i)
+{
+	FILE *file;
+	char *name;
+	struct pet_scop *scop;
+
+	name = cache_file_name(base, i);
+	if (!name)
+		return NULL;
+	file = fopen(name, "r");
+	free(name);
+	if (!file)
+		return NULL;
+	scop = pet_scop_parse(ctx, file);
+	fclose(file);
+
+	return scop;
+}
+
+/* Internal data structure for save_and_transform.
+ *
+ * "base" is the prefix of the cache files of the input.
+ * "n_scop" is the number of scops that have been extracted so far.
+ * "failed" is set if any of these scops could not be stored in the cache.
+ * "transform" and "user" are the callback passed
+ * to ppcg_extract_cache_transform and its argument.
+ */
+struct ppcg_extract_cache_data {
+	const char *base;
+	int n_scop;
+	int failed;
+
+	__isl_give isl_printer *(*transform)(__isl_take isl_printer *p,
+		struct pet_scop *scop, void *user);
+	void *user;
+};
+
+/* Callback for pet_transform_C_source that stores the extracted "scop"
+ * in the cache before passing it on to data->transform.
+ */
+static __isl_give isl_printer *save_and_transform(__isl_take isl_printer *p,
+	struct pet_scop *scop, void *user)
+{
+	struct ppcg_extract_cache_data *data = user;
+
+	if (!data->failed && save_scop(scop, data->base, data->n_scop) < 0)
+		data->failed = 1;
+	data->n_scop++;
+
+	return data->transform(p, scop, data->user);
+}
+
+/* Transform the contents "text" of length "len" of the input file
+ * by replacing the "n" scops in "scops" by the result of "transform"
+ * and write the result to "out".
+ * The text outside of the scops is copied verbatim, in the same way
+ * as pet_transform_C_source does.
+ * The scops are consumed by this function.
+ *
+ * Return 0 on success and -1 on failure.
+ */
+static int transform_scops(isl_ctx *ctx, const char *text, size_t len,
+	FILE *out, int n, struct pet_scop **scops,
+	__isl_give isl_printer *(*transform)(__isl_take isl_printer *p,
+		struct pet_scop *scop, void *user), void *user)
+{
+	int i;
+	size_t pos = 0;
+	isl_printer *p;
+
+	p = isl_printer_to_file(ctx, out);
+	p = isl_printer_set_output_format(p, ISL_FORMAT_C);
+	for (i = 0; i < n; ++i) {
+		struct pet_scop *scop = scops[i];
+		unsigned start, end;
+
+		scops[i] = NULL;
+		start = pet_loc_get_start(scop->loc);
+		end = pet_loc_get_end(scop->loc);
+		fwrite(text + pos, 1, start - pos, out);
+		p = isl_printer_set_indent_prefix(p,
+					pet_loc_get_indent(scop->loc));
+		p = transform(p, scop, user);
+		if (!p)
+			break;
+		pos = end;
+	}
+	for (; i < n; ++i)
+		pet_scop_free(scops[i]);
+	if (!p)
+		return -1;
+	fwrite(text + pos, 1, len - pos, out);
+	isl_printer_free(p);
+
+	return ferror(out) ? -1 : 0;
+}
+
+/* Transform the input "text" of length "len" using the "n" scops
+ * stored in the cache files with prefix "base".
+ * All scops are loaded before any output is produced such that
+ * the caller can fall back to extracting the scops from scratch
+ * if any of them is missing or invalid.
+ *
+ * Return 0 on success, -1 on failure and
+ * 1 if the scops could not be loaded.
+ */
+static int transform_cached(isl_ctx *ctx, const char *text, size_t len,
+	FILE *out, const char *base, int n,
+	__isl_give isl_printer *(*transform)(__isl_take isl_printer *p,
+		struct pet_scop *scop, void *user), void *user)
+{
+	int i;
+	unsigned pos = 0;
+	struct pet_scop **scops;
+
+	scops = calloc(n ? n : 1, sizeof(*scops));
+	if (!scops)
+		return 1;
+	for (i = 0; i < n; ++i) {
+		scops[i] = load_scop(ctx, base, i);
+		if (!scops[i])
+			break;
+		if (pet_loc_get_start(scops[i]->loc) < pos ||
+		    pet_loc_get_end(scops[i]->loc) > len) {
+			scops[i] = pet_scop_free(scops[i]);
+			break;
+		}
+		pos = pet_loc_get_end(scops[i]->loc);
+	}
+	if (i < n) {
+		while (i-- > 0)
+			pet_scop_free(scops[i]);
+		free(scops);
+		return 1;
+	}
+
+	i = transform_scops(ctx, text, len, out, n, scops, transform, user);
+	free(scops);
+
+	return i;
+}
+
+/* Transform the C source file "input" by rewriting each scop
+ * through a call to "transform" and write the result to "out",
+ * reusing scops that were extracted by an earlier run if possible.
+ * This function has the same effect as pet_transform_C_source,
+ * except that the extracted scops are stored in the directory "dir".
+ *
+ * The cached scops are identified by a hash of the contents
+ * of "input", of the headers it includes and of "key",
+ * which is expected to be the command line, with one argument per line,
+ * such that it describes all other information that affects
+ * the extraction, including macro definitions and include directories.
+ * The headers are looked up in the directory of the including file
+ * (for quoted includes) and in the include directories specified in "key".
+ * Headers that cannot be found there, such as system headers,
+ * only contribute their names.
+ * If the input is found in the cache, then the scops are loaded
+ * from the cache and the input is not parsed.
+ * Since these scops are not attached to the input file,
+ * *original is set to the contents of the input file while
+ * they are being transformed, such that "transform" can print
+ * their original code from there.
+ * Otherwise, the scops are extracted by pet_transform_C_source
+ * and stored in the cache.
+ * Each cache file is written to a temporary file first and
+ * the number of scops is only recorded after all scops have
+ * been stored, such that concurrently running ppcg processes
+ * only ever see complete cache entries.
+ */
+int ppcg_extract_cache_transform(isl_ctx *ctx, const char *input, FILE *out,
+	const char *dir, const char *key, const char **original,
+	__isl_give isl_printer *(*transform)(__isl_take isl_printer *p,
+		struct pet_scop *scop, void *user), void *user)
+{
+	struct ppcg_extract_cache_data data = { NULL, 0, 0, transform, user };
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	char *text;
+	char *base;
+	const char *input_dir;
+	size_t len, base_len, input_dir_len;
+	int n, r;
+
+	text = read_file(input, &len);
+	if (!text)
+		return pet_transform_C_source(ctx, input, out,
+						transform, user);
+
+	hash = hash_data(hash, text, len);
+	input_dir_len = dir_part(input, &input_dir);
+	hash = hash_includes(hash, text, len, input_dir, input_dir_len,
+				key, 0);
+	if (key)
+		hash = hash_data(hash, key, strlen(key));
+	base_len = strlen(dir) + 40;
+	base = malloc(base_len);
+	if (!base) {
+		free(text);
+		return -1;
+	}
+	snprintf(base, base_len, "%s/ppcg-scops-%016llx", dir, hash);
+
+	n = load_n_scop(base);
+	r = 1;
+	if (n >= 0) {
+		*original = text;
+		r = transform_cached(ctx, text, len, out, base, n,
+					transform, user);
+		*original = NULL;
+	}
+	if (r == 1) {
+		data.base = base;
+		r = pet_transform_C_source(ctx, input, out,
+					    &save_and_transform, &data);
+		if (r >= 0 && !data.failed)
+			save_n_scop(base, data.n_scop);
+	}
+
+	free(base);
+	free(text);
+
+	return r;
+}
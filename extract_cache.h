@@ -0,0 +1,15 @@
+#ifndef EXTRACT_CACHE_H
+#define EXTRACT_CACHE_H
+
+#include <stdio.h>
+
+#include <isl/ctx.h>
+#include <isl/printer.h>
+#include <pet.h>
+
+int ppcg_extract_cache_transform(isl_ctx *ctx, const char *input, FILE *out,
+	const char *dir, const char *key, const char **original,
+	__isl_give isl_printer *(*transform)(__isl_take isl_printer *p,
+		struct pet_scop *scop, void *user), void *user);
+
+#endif
@@ -34,6 +34,7 @@
 #include "schedule.h"
 #include "ppcg_options.h"
 #include "print.h"
+#include "profile.h"
 #include "util.h"
 
 struct gpu_array_info;
@@ -470,125 +471,17 @@ __isl_give isl_set *gpu_array_positive_size_guard(struct gpu_array_info *array)
 	return guard;
 }
 
-/* Internal data structure for extract_size_of_type.
- * "type" specifies the name of the space that we want to extract.
- * "res" is used to store the subset of that space.
- */
-struct ppcg_extract_size_data {
-	const char *type;
-	isl_set *res;
-};
-
-/* This function is called for each set in a union_set.
- * If the name of the set matches data->type, we store the
- * set in data->res.
- */
-static isl_stat extract_size_of_type(__isl_take isl_set *size, void *user)
-{
-	struct ppcg_extract_size_data *data = user;
-	const char *name;
-
-	name = isl_set_get_tuple_name(size);
-	if (name && !strcmp(name, data->type)) {
-		data->res = size;
-		return isl_stat_error;
-	}
-
-	isl_set_free(size);
-	return isl_stat_ok;
-}
-
-/* Given a union map { kernel[i] -> *[...] },
- * return the range in the space called "type" for the kernel with
- * sequence number "id".
- */
-static __isl_give isl_set *extract_sizes(__isl_keep isl_union_map *sizes,
-	const char *type, int id)
-{
-	isl_space *space;
-	isl_set *dom;
-	isl_union_set *local_sizes;
-	struct ppcg_extract_size_data data = { type, NULL };
-
-	if (!sizes)
-		return NULL;
-
-	space = isl_union_map_get_space(sizes);
-	space = isl_space_set_from_params(space);
-	space = isl_space_add_dims(space, isl_dim_set, 1);
-	space = isl_space_set_tuple_name(space, isl_dim_set, "kernel");
-	dom = isl_set_universe(space);
-	dom = isl_set_fix_si(dom, isl_dim_set, 0, id);
-
-	local_sizes = isl_union_set_apply(isl_union_set_from_set(dom),
-					isl_union_map_copy(sizes));
-	isl_union_set_foreach_set(local_sizes, &extract_size_of_type, &data);
-	isl_union_set_free(local_sizes);
-	return data.res;
-}
-
-/* Given a singleton set, extract the first (at most *len) elements
- * of the single integer tuple into *sizes and update *len if needed.
- *
- * If "set" is NULL, then the "sizes" array is not updated.
- */
-static isl_stat read_sizes_from_set(__isl_take isl_set *set, int *sizes,
-	int *len)
-{
-	int i;
-	int dim;
-
-	if (!set)
-		return isl_stat_ok;
-
-	dim = isl_set_dim(set, isl_dim_set);
-	if (dim < *len)
-		*len = dim;
-
-	for (i = 0; i < *len; ++i) {
-		isl_val *v;
-
-		v = isl_set_plain_get_val_if_fixed(set, isl_dim_set, i);
-		if (!v)
-			goto error;
-		sizes[i] = isl_val_get_num_si(v);
-		isl_val_free(v);
-	}
-
-	isl_set_free(set);
-	return isl_stat_ok;
-error:
-	isl_set_free(set);
-	return isl_stat_error;
-}
-
 /* Add the map { kernel[id] -> type[sizes] } to gen->used_sizes,
  * if the option debug->dump_sizes is set.
  */
 static void set_used_sizes(struct gpu_gen *gen, const char *type, int id,
 	int *sizes, int len)
 {
-	int i;
-	isl_space *space;
-	isl_map *map;
-
 	if (!gen->options->debug->dump_sizes)
 		return;
 
-	space = isl_union_map_get_space(gen->used_sizes);
-	space = isl_space_set_from_params(space);
-	space = isl_space_add_dims(space, isl_dim_set, 1);
-	space = isl_space_set_tuple_name(space, isl_dim_set, "kernel");
-	space = isl_space_from_domain(space);
-	space = isl_space_add_dims(space, isl_dim_out, len);
-	space = isl_space_set_tuple_name(space, isl_dim_out, type);
-
-	map = isl_map_universe(space);
-	map = isl_map_fix_si(map, isl_dim_in, 0, id);
-	for (i = 0; i < len; ++i)
-		map = isl_map_fix_si(map, isl_dim_out, i, sizes[i]);
-
-	gen->used_sizes = isl_union_map_add_map(gen->used_sizes, map);
+	gen->used_sizes = ppcg_add_used_sizes(gen->used_sizes, "kernel",
+						type, id, sizes, len);
 }
 
 /* Extract user specified "tile" sizes from the "sizes" command line option,
@@ -610,8 +503,9 @@ static int *read_tile_sizes(struct gpu_gen *gen, int *tile_len)
 	for (n = 0; n < *tile_len; ++n)
 		tile_size[n] = gen->options->tile_size;
 
-	size = extract_sizes(gen->sizes, "tile", gen->kernel_id);
-	if (read_sizes_from_set(size, tile_size, tile_len) < 0)
+	size = ppcg_extract_sizes(gen->sizes, "kernel", "tile",
+				gen->kernel_id);
+	if (ppcg_read_sizes_from_set(size, tile_size, tile_len) < 0)
 		goto error;
 	set_used_sizes(gen, "tile", gen->kernel_id, tile_size, *tile_len);
 
@@ -646,8 +540,9 @@ static isl_stat read_block_sizes(struct ppcg_kernel *kernel,
 		break;
 	}
 
-	size = extract_sizes(sizes, "block", kernel->id);
-	return read_sizes_from_set(size, kernel->block_dim, &kernel->n_block);
+	size = ppcg_extract_sizes(sizes, "kernel", "block", kernel->id);
+	return ppcg_read_sizes_from_set(size, kernel->block_dim,
+					&kernel->n_block);
 }
 
 /* Extract user specified "grid" sizes from the "sizes" command line option,
@@ -670,8 +565,9 @@ static isl_stat read_grid_sizes(struct ppcg_kernel *kernel,
 		break;
 	}
 
-	size = extract_sizes(sizes, "grid", kernel->id);
-	return read_sizes_from_set(size, kernel->grid_dim, &kernel->n_grid);
+	size = ppcg_extract_sizes(sizes, "kernel", "grid", kernel->id);
+	return ppcg_read_sizes_from_set(size, kernel->grid_dim,
+					&kernel->n_grid);
 }
 
 /* Extract user specified grid and block sizes from the gen->sizes
@@ -3940,8 +3836,11 @@ __isl_give isl_schedule_node *gpu_create_kernel(struct gpu_gen *gen,
 
 	node = gpu_tree_move_up_to_kernel(node);
 
+	ppcg_profile_start_kernel(gen->options->profile, "group_references",
+				kernel->id);
 	if (gpu_group_references(kernel, node) < 0)
 		node = isl_schedule_node_free(node);
+	ppcg_profile_end(gen->options->profile);
 	localize_bounds(kernel, host_domain);
 	isl_set_free(host_domain);
 
@@ -5691,11 +5590,15 @@ static __isl_give isl_printer *generate(__isl_take isl_printer *p,
 		isl_schedule_free(schedule);
 	} else {
 		schedule = map_to_device(gen, schedule);
+		ppcg_profile_start(options->profile, "ast_generation");
 		gen->tree = generate_code(gen, schedule);
+		ppcg_profile_end(options->profile);
+		ppcg_profile_start(options->profile, "printing");
 		p = ppcg_set_macro_names(p);
 		p = ppcg_print_exposed_declarations(p, prog->scop);
 		p = gen->print(p, gen->prog, gen->tree, &gen->types,
 				    gen->print_user);
+		ppcg_profile_end(options->profile);
 		isl_ast_node_free(gen->tree);
 	}
 
@@ -69,3 +69,264 @@ __isl_give isl_val *gpu_array_tile_size(struct gpu_array_tile *tile)
 
 	return size;
 }
+
+/* Given an array access "access", check if for any index i there is
+ * a shift a(p) and a stride g such that
+ *
+ *	a(p) + i = 0 mod g
+ *
+ * If so, record the information in tile->bound[i]->stride and
+ * tile->bound[i]->shift.
+ * Otherwise, set tile->bound[i]->stride to 1 (and tile->bound[i]->shift to 0).
+ * Return isl_bool_true if any non-trivial stride was found.
+ *
+ * Note that the stride info returned by isl_map_get_range_stride_info
+ * is of the form
+ *
+ *	i = o(p) + g n
+ *
+ * a(p) can therefore be taken to be equal to -o(p).
+ */
+static isl_bool detect_strides(struct gpu_array_tile *tile,
+	__isl_keep isl_map *access)
+{
+	int i;
+	isl_bool has_strides = isl_bool_false;
+
+	for (i = 0; i < tile->n; ++i) {
+		struct gpu_array_bound *bound = &tile->bound[i];
+		isl_stride_info *si;
+
+		si = isl_map_get_range_stride_info(access, i);
+		bound->stride = isl_stride_info_get_stride(si);
+		bound->shift = isl_aff_neg(isl_stride_info_get_offset(si));
+		isl_stride_info_free(si);
+
+		if (!has_strides)
+			has_strides = isl_val_gt_si(bound->stride, 1);
+		if (has_strides < 0)
+			return isl_bool_error;
+	}
+
+	return has_strides;
+}
+
+/* Given an array access "access", remove the strides based
+ * on the information in tile->bound[i]->stride and tile->bound[i]->shift.
+ *
+ * In particular let the access be A[a] and
+ * let the shifts s_i(p) and the strides g_i be such that
+ *
+ *  S(p) + a = 0 mod G
+ *
+ * Replace the access by
+ *
+ *  A[(a + S(p))/G]
+ *
+ * First collect the shifts s_i into an isl_multi_aff and
+ * the strides into the scaling function A[i] -> A[G i].
+ * Then add the shifts to the original access and
+ * take the preimage over the scaling.
+ */
+static __isl_give isl_map *remove_strides(__isl_take isl_map *access,
+	struct gpu_array_tile *tile)
+{
+	int i;
+	isl_space *space;
+	isl_multi_aff *shift, *scale;
+	isl_multi_val *stride;
+
+	space = isl_map_get_space(access);
+	shift = isl_multi_aff_zero(isl_space_copy(space));
+	space = isl_space_range(space);
+	stride = isl_multi_val_zero(isl_space_copy(space));
+	scale = isl_multi_aff_identity(isl_space_map_from_set(space));
+	for (i = 0; i < tile->n; ++i) {
+		struct gpu_array_bound *bound = &tile->bound[i];
+		isl_aff *shift_i;
+		isl_val *stride_i;
+
+		shift_i = isl_aff_copy(bound->shift);
+		stride_i = isl_val_copy(bound->stride);
+		shift = isl_multi_aff_set_aff(shift, i, shift_i);
+		stride = isl_multi_val_set_val(stride, i, stride_i);
+	}
+	scale = isl_multi_aff_scale_multi_val(scale, stride);
+
+	access = isl_map_sum(access, isl_map_from_multi_aff(shift));
+	access = isl_map_preimage_range_multi_aff(access, scale);
+
+	return access;
+}
+
+/* Check if we can find a memory tile for the given array
+ * based on the given accesses, and if so, put the results in "tile".
+ *
+ * We project the accesses on each index in turn and look for a parametric
+ * offset such that the size is constant, after removing
+ * any stride that may appear in the accesses.
+ *
+ * tile->depth is initialized to the input dimension of the computed bounds.
+ */
+isl_bool gpu_array_tile_can_tile(__isl_keep isl_map *access,
+	struct gpu_array_tile *tile)
+{
+	int i;
+	isl_bool has_strides, valid;
+	isl_fixed_box *box;
+	isl_multi_aff *offset;
+	isl_multi_val *size;
+
+	if (!tile)
+		return isl_bool_error;
+
+	isl_map_free(isl_map_detect_equalities(isl_map_copy(access)));
+
+	has_strides = detect_strides(tile, access);
+	if (has_strides < 0)
+		return isl_bool_error;
+
+	tile->depth = isl_map_dim(access, isl_dim_in);
+
+	access = isl_map_copy(access);
+	if (has_strides)
+		access = remove_strides(access, tile);
+
+	box = isl_map_get_range_simple_fixed_box_hull(access);
+	isl_map_free(access);
+
+	valid = isl_fixed_box_is_valid(box);
+	if (valid >= 0 && valid) {
+		offset = isl_fixed_box_get_offset(box);
+		size = isl_fixed_box_get_size(box);
+		for (i = 0; i < tile->n; ++i) {
+			tile->bound[i].size = isl_multi_val_get_val(size, i);
+			tile->bound[i].lb = isl_multi_aff_get_aff(offset, i);
+		}
+		isl_multi_aff_free(offset);
+		isl_multi_val_free(size);
+	}
+	isl_fixed_box_free(box);
+
+	return valid;
+}
+
+/* Given a description of an array tile "tile" and the "space"
+ *
+ *	{ D -> A }
+ *
+ * where D represents the first tile->depth schedule dimensions
+ * and A represents the array, construct an isl_multi_aff
+ *
+ *	{ [D[i] -> A[a]] -> A'[a'] }
+ *
+ * with A' a scaled down copy of A according to the shifts and strides
+ * in "tile".  In particular,
+ *
+ *	a' = (a + shift(i))/stride
+ *
+ * "insert_array" represents
+ *
+ *	{ [D -> A] -> D }
+ *
+ * and is used to insert A into the domain of functions that only
+ * reference D.
+ */
+static __isl_give isl_multi_aff *strided_tile(
+	struct gpu_array_tile *tile, __isl_keep isl_space *space,
+	__isl_keep isl_multi_aff *insert_array)
+{
+	int i;
+	isl_ctx *ctx;
+	isl_multi_aff *shift;
+	isl_multi_val *stride;
+	isl_space *space2;
+	isl_local_space *ls;
+	isl_multi_aff *tiling;
+
+	ctx = isl_space_get_ctx(space);
+	space2 = isl_space_domain(isl_space_copy(space));
+	ls = isl_local_space_from_space(space2);
+	space2 = isl_space_range(isl_space_copy(space));
+	stride = isl_multi_val_zero(space2);
+	shift = isl_multi_aff_zero(isl_space_copy(space));
+
+	for (i = 0; i < tile->n; ++i) {
+		struct gpu_array_bound *bound = &tile->bound[i];
+		isl_val *stride_i;
+		isl_aff *shift_i;
+
+		stride_i = isl_val_copy(bound->stride);
+		shift_i = isl_aff_copy(bound->shift);
+
+		stride = isl_multi_val_set_val(stride, i, stride_i);
+		shift = isl_multi_aff_set_aff(shift, i, shift_i);
+	}
+	isl_local_space_free(ls);
+
+	shift = isl_multi_aff_pullback_multi_aff(shift,
+				    isl_multi_aff_copy(insert_array));
+
+	tiling = isl_multi_aff_range_map(isl_space_copy(space));
+	tiling = isl_multi_aff_add(tiling, shift);
+	tiling = isl_multi_aff_scale_down_multi_val(tiling, stride);
+
+	return tiling;
+}
+
+/* Compute a tiling for the array tile "tile" of an array
+ * living in "array_space", with "name" the name of the local array.
+ * The result is stored in tile->tiling.
+ *
+ * The tiling is of the form
+ *
+ *	{ [D[i] -> A[a]] -> T[t] }
+ *
+ * where D represents the first tile->depth schedule dimensions,
+ * A represents the global array and T represents the local tile.
+ *
+ * If there is any stride in the accesses, then the mapping is
+ *
+ *	t = (a + shift(i))/stride - lb(i)
+ *
+ * otherwise, it is simply
+ *
+ *	t = a - lb(i)
+ */
+void gpu_array_tile_compute_tiling(struct gpu_array_tile *tile,
+	__isl_take isl_space *array_space, const char *name)
+{
+	int i;
+	isl_space *space;
+	isl_multi_aff *tiling, *lb, *insert_array;
+
+	if (!tile) {
+		isl_space_free(array_space);
+		return;
+	}
+
+	space = isl_space_from_range(array_space);
+	space = isl_space_add_dims(space, isl_dim_in, tile->depth);
+	insert_array = isl_multi_aff_domain_map(isl_space_copy(space));
+
+	for (i = 0; i < tile->n; ++i)
+		if (tile->bound[i].shift)
+			break;
+
+	if (i < tile->n)
+		tiling = strided_tile(tile, space, insert_array);
+	else
+		tiling = isl_multi_aff_range_map(isl_space_copy(space));
+
+	lb = isl_multi_aff_zero(space);
+	for (i = 0; i < tile->n; ++i) {
+		isl_aff *lb_i = isl_aff_copy(tile->bound[i].lb);
+		lb = isl_multi_aff_set_aff(lb, i, lb_i);
+	}
+	lb = isl_multi_aff_pullback_multi_aff(lb, insert_array);
+
+	tiling = isl_multi_aff_sub(tiling, lb);
+	tiling = isl_multi_aff_set_tuple_name(tiling, isl_dim_out, name);
+
+	tile->tiling = tiling;
+}
@@ -3,6 +3,7 @@
 
 #include <isl/aff_type.h>
 #include <isl/map_type.h>
+#include <isl/space.h>
 #include <isl/val.h>
 
 /* The current index is such that if you add "shift",
@@ -55,4 +56,9 @@ struct gpu_array_tile *gpu_array_tile_free(struct gpu_array_tile *tile);
 
 __isl_give isl_val *gpu_array_tile_size(struct gpu_array_tile *tile);
 
+isl_bool gpu_array_tile_can_tile(__isl_keep isl_map *access,
+	struct gpu_array_tile *tile);
+void gpu_array_tile_compute_tiling(struct gpu_array_tile *tile,
+	__isl_take isl_space *array_space, const char *name);
+
 #endif
@@ -0,0 +1,206 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "machine.h"
+#include "util.h"
+
+/* The directory containing the description of the caches
+ * of the first CPU on Linux systems.
+ */
+static const char *sysfs_cache_dir = "/sys/devices/system/cpu/cpu0/cache";
+
+/* Only caches up to this level are read from sysfs_cache_dir.
+ * Higher levels are typically shared among the cores.
+ */
+#define MAX_SYSFS_CACHE_LEVEL	2
+
+/* Parse a cache size at "s", consisting of a number of bytes,
+ * optionally followed by a "K", "M" or "G" suffix, and
+ * store a pointer to the first character after the size in *end.
+ * Return -1 if "s" does not start with a valid size.
+ */
+static long parse_size(const char *s, char **end)
+{
+	long size;
+
+	size = strtol(s, end, 10);
+	if (*end == s || size <= 0)
+		return -1;
+	switch (**end) {
+	case 'G':
+	case 'g':
+		size *= 1024;
+		/* fall through */
+	case 'M':
+	case 'm':
+		size *= 1024;
+		/* fall through */
+	case 'K':
+	case 'k':
+		size *= 1024;
+		++*end;
+		break;
+	}
+
+	return size;
+}
+
+/* Add the cache size "size" to the "n" sizes in "sizes",
+ * unless there is no more room.
+ */
+static void add_size(int *sizes, int *n, long size)
+{
+	if (*n >= PPCG_MAX_CACHE_LEVELS)
+		return;
+	sizes[(*n)++] = size < INT_MAX ? size : INT_MAX;
+}
+
+/* Parse a list of cache sizes, separated by commas or white space,
+ * from "s" and add them to "sizes".
+ * Anything following a "#" on a line is ignored.
+ * Return 0 on success and -1 if "s" contains anything else.
+ */
+static int parse_sizes(const char *s, int *sizes, int *n)
+{
+	while (*s) {
+		char *end;
+		long size;
+
+		if (isspace((unsigned char) *s) || *s == ',') {
+			++s;
+			continue;
+		}
+		if (*s == '#') {
+			s += strcspn(s, "\n");
+			continue;
+		}
+		size = parse_size(s, &end);
+		if (size < 0)
+			return -1;
+		add_size(sizes, n, size);
+		s = end;
+	}
+
+	return 0;
+}
+
+/* Read the contents of the file called "name" into "buffer"
+ * of size "len", terminating it by a null character.
+ * Return 0 on success and -1 if the file cannot be read.
+ */
+static int read_file(const char *name, char *buffer, size_t len)
+{
+	FILE *file;
+	size_t n;
+
+	file = fopen(name, "r");
+	if (!file)
+		return -1;
+	n = fread(buffer, 1, len - 1, file);
+	buffer[n] = '\0';
+	fclose(file);
+
+	return 0;
+}
+
+/* Read the sizes of the data (or unified) caches of the first CPU
+ * up to level MAX_SYSFS_CACHE_LEVEL from sysfs_cache_dir and
+ * add them to "sizes".
+ */
+static void read_sysfs_sizes(int *sizes, int *n)
+{
+	int i;
+
+	for (i = 0; i < 16; ++i) {
+		char name[256];
+		char buffer[64];
+		char *end;
+		long size;
+
+		snprintf(name, sizeof(name), "%s/index%d/type",
+			sysfs_cache_dir, i);
+		if (read_file(name, buffer, sizeof(buffer)) < 0)
+			break;
+		if (prefixcmp(buffer, "Data") && prefixcmp(buffer, "Unified"))
+			continue;
+		snprintf(name, sizeof(name), "%s/index%d/level",
+			sysfs_cache_dir, i);
+		if (read_file(name, buffer, sizeof(buffer)) < 0 ||
+		    atoi(buffer) > MAX_SYSFS_CACHE_LEVEL)
+			continue;
+		snprintf(name, sizeof(name), "%s/index%d/size",
+			sysfs_cache_dir, i);
+		if (read_file(name, buffer, sizeof(buffer)) < 0)
+			continue;
+		size = parse_size(buffer, &end);
+		if (size > 0)
+			add_size(sizes, n, size);
+	}
+}
+
+/* Compare two cache sizes for sorting them in increasing order.
+ */
+static int cmp_size(const void *a, const void *b)
+{
+	const int *size_a = a;
+	const int *size_b = b;
+
+	return *size_a - *size_b;
+}
+
+/* Return the sizes in bytes of the data caches of the target machine,
+ * ordered from the smallest (innermost) to the largest (outermost) cache,
+ * and store the number of caches in *n.
+ *
+ * If "spec" is NULL, then the sizes are read from the description
+ * of the caches of the machine on which PPCG runs,
+ * if it is available.
+ * If "spec" starts with a digit, then it is a list of cache sizes,
+ * each optionally followed by a "K", "M" or "G" suffix.
+ * Otherwise, it is the name of a machine description file
+ * that contains such a list.
+ *
+ * Return NULL with *n set to zero if no sizes could be determined.
+ */
+int *ppcg_machine_cache_sizes(const char *spec, int *n)
+{
+	int *sizes;
+
+	*n = 0;
+	sizes = malloc(PPCG_MAX_CACHE_LEVELS * sizeof(int));
+	if (!sizes)
+		return NULL;
+
+	if (!spec) {
+		read_sysfs_sizes(sizes, n);
+	} else if (isdigit((unsigned char) *spec)) {
+		if (parse_sizes(spec, sizes, n) < 0) {
+			fprintf(stderr, "invalid cache sizes '%s'\n", spec);
+			*n = 0;
+		}
+	} else {
+		char buffer[4096];
+
+		if (read_file(spec, buffer, sizeof(buffer)) < 0)
+			fprintf(stderr, "unable to read '%s'\n", spec);
+		else if (parse_sizes(buffer, sizes, n) < 0) {
+			fprintf(stderr, "invalid cache sizes in '%s'\n", spec);
+			*n = 0;
+		}
+	}
+
+	if (*n == 0) {
+		free(sizes);
+		return NULL;
+	}
+	qsort(sizes, *n, sizeof(int), &cmp_size);
+
+	return sizes;
+}
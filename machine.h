@@ -0,0 +1,10 @@
+#ifndef PPCG_MACHINE_H
+#define PPCG_MACHINE_H
+
+/* The maximal number of cache levels that are taken into account.
+ */
+#define PPCG_MAX_CACHE_LEVELS	8
+
+int *ppcg_machine_cache_sizes(const char *spec, int *n);
+
+#endif
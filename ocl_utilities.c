@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "ocl_utilities.h"
 
 /* Return the OpenCL error string for a given error number.
@@ -139,12 +141,11 @@ cl_program opencl_build_program_from_string(cl_context ctx, cl_device_id dev,
 	return program;
 }
 
-/* Create an OpenCL program from a source file and compile it.
+/* Read the contents of the file called "filename" into a newly allocated,
+ * NULL terminated string and store its length in "size".
  */
-cl_program opencl_build_program_from_file(cl_context ctx, cl_device_id dev,
-	const char* filename, const char* opencl_options)
+static char *opencl_read_source_file(const char *filename, size_t *size)
 {
-	cl_program program;
 	FILE *program_file;
 	char *program_source;
 	size_t program_size, read;
@@ -166,9 +167,419 @@ cl_program opencl_build_program_from_file(cl_context ctx, cl_device_id dev,
 	}
 	fclose(program_file);
 
+	*size = program_size;
+	return program_source;
+}
+
+/* Create an OpenCL program from a source file and compile it.
+ */
+cl_program opencl_build_program_from_file(cl_context ctx, cl_device_id dev,
+	const char* filename, const char* opencl_options)
+{
+	cl_program program;
+	char *program_source;
+	size_t program_size;
+
+	program_source = opencl_read_source_file(filename, &program_size);
 	program = opencl_build_program_from_string(ctx, dev, program_source,
 						program_size, opencl_options);
 	free(program_source);
 
 	return program;
 }
+
+/* Update the 64-bit FNV-1a hash "hash" with the "size" bytes at "data".
+ */
+static unsigned long long fnv1a_update(unsigned long long hash,
+	const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	size_t i;
+
+	for (i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/* Update "hash" with the string value of the device information
+ * "param" of "dev".
+ */
+static unsigned long long hash_device_info(unsigned long long hash,
+	cl_device_id dev, cl_device_info param)
+{
+	char *info;
+	size_t size;
+
+	if (clGetDeviceInfo(dev, param, 0, NULL, &size) != CL_SUCCESS)
+		return hash;
+	info = (char *) malloc(size);
+	if (info && clGetDeviceInfo(dev, param, size, info, NULL) == CL_SUCCESS)
+		hash = fnv1a_update(hash, info, size);
+	free(info);
+
+	return hash;
+}
+
+/* Maximal nesting depth of included headers that is taken into account
+ * in the hash of a program.
+ */
+#define MAX_INCLUDE_DEPTH	8
+
+static unsigned long long hash_includes(unsigned long long hash,
+	const char *source, size_t size, const char *opencl_options,
+	int depth);
+
+/* Read the contents of the file called "filename" into a newly allocated
+ * string and store its length in "size".
+ * Return NULL if the file cannot be read.
+ */
+static char *read_header_file(const char *filename, size_t *size)
+{
+	FILE *file;
+	char *contents;
+	long len;
+
+	file = fopen(filename, "r");
+	if (!file)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	len = ftell(file);
+	rewind(file);
+	contents = len < 0 ? NULL : (char *) malloc(len + 1);
+	if (contents && fread(contents, 1, len, file) != (size_t) len) {
+		free(contents);
+		contents = NULL;
+	}
+	fclose(file);
+	if (!contents)
+		return NULL;
+	contents[len] = '\0';
+
+	*size = len;
+	return contents;
+}
+
+/* Return a pointer to the directory of the first "-I" option
+ * in the OpenCL compiler options "opt" and store its length in *len,
+ * or return NULL if there is no such option.
+ * Only entire options are considered, i.e., "-I" needs to appear
+ * at the start of an option.  The directory is either attached
+ * to the "-I" or it is the next option.
+ */
+static const char *next_include_dir(const char *opt, size_t *len)
+{
+	while (opt && *opt) {
+		size_t n;
+
+		opt += strspn(opt, " \t");
+		n = strcspn(opt, " \t");
+		if (n >= 2 && opt[0] == '-' && opt[1] == 'I') {
+			opt += 2;
+			if (n == 2)
+				opt += strspn(opt, " \t");
+			*len = strcspn(opt, " \t");
+			return *len > 0 ? opt : NULL;
+		}
+		opt += n;
+	}
+
+	return NULL;
+}
+
+/* Update "hash" with the contents of the header "header" of length "len",
+ * looked up in the current directory and in the directories specified
+ * through "-I" in "opencl_options", and, recursively, with the headers
+ * included by that header.
+ * If the header cannot be found, then only its name is taken into account.
+ */
+static unsigned long long hash_header(unsigned long long hash,
+	const char *header, size_t len, const char *opencl_options, int depth)
+{
+	const char *dir = ".";
+	size_t dir_len = 1;
+	const char *opt = opencl_options;
+	char *source = NULL;
+	size_t size;
+
+	hash = fnv1a_update(hash, header, len);
+	while (!source) {
+		char *path;
+
+		path = (char *) malloc(dir_len + 1 + len + 1);
+		if (!path)
+			return hash;
+		memcpy(path, dir, dir_len);
+		path[dir_len] = '/';
+		memcpy(path + dir_len + 1, header, len);
+		path[dir_len + 1 + len] = '\0';
+		source = read_header_file(path, &size);
+		free(path);
+		if (source)
+			break;
+
+		dir = next_include_dir(opt, &dir_len);
+		if (!dir)
+			return hash;
+		opt = dir + dir_len;
+	}
+
+	hash = fnv1a_update(hash, source, size);
+	hash = hash_includes(hash, source, size, opencl_options, depth + 1);
+	free(source);
+
+	return hash;
+}
+
+/* Update "hash" with the contents of the headers included
+ * by the source "source" of size "size".
+ * Only lines of the form
+ *
+ *	#include "header"
+ *	#include <header>
+ *
+ * are taken into account.
+ */
+static unsigned long long hash_includes(unsigned long long hash,
+	const char *source, size_t size, const char *opencl_options,
+	int depth)
+{
+	const char *p = source;
+	const char *end = source + size;
+
+	if (depth >= MAX_INCLUDE_DEPTH)
+		return hash;
+
+	while (p < end) {
+		const char *eol, *name;
+		char close;
+
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		while (p < eol && (*p == ' ' || *p == '\t'))
+			++p;
+		if (p < eol && *p == '#') {
+			++p;
+			while (p < eol && (*p == ' ' || *p == '\t'))
+				++p;
+			if (eol - p > 7 && !strncmp(p, "include", 7)) {
+				p += 7;
+				while (p < eol && (*p == ' ' || *p == '\t'))
+					++p;
+				close = p < eol && *p == '<' ? '>' : '"';
+				if (p < eol && (*p == '<' || *p == '"')) {
+					name = ++p;
+					while (p < eol && *p != close)
+						++p;
+					if (p < eol)
+						hash = hash_header(hash, name,
+							p - name,
+							opencl_options, depth);
+				}
+			}
+		}
+		p = eol + 1;
+	}
+
+	return hash;
+}
+
+/* Construct the name of the file in "cache_dir" that holds the binary
+ * of the program with source "program_source" of size "program_size"
+ * compiled for "dev" with options "opencl_options".
+ * The name is derived from a hash of the source, the contents
+ * of the headers it includes, the name and versions
+ * of the device and its driver and the compiler options.
+ * Return NULL if the name is too long.
+ */
+static char *opencl_binary_cache_file(const char *cache_dir, cl_device_id dev,
+	const char *program_source, size_t program_size,
+	const char *opencl_options)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	char *name;
+	size_t len;
+
+	hash = fnv1a_update(hash, program_source, program_size);
+	hash = hash_includes(hash, program_source, program_size,
+				opencl_options, 0);
+	hash = hash_device_info(hash, dev, CL_DEVICE_NAME);
+	hash = hash_device_info(hash, dev, CL_DEVICE_VERSION);
+	hash = hash_device_info(hash, dev, CL_DRIVER_VERSION);
+	if (opencl_options)
+		hash = fnv1a_update(hash, opencl_options,
+					strlen(opencl_options) + 1);
+
+	len = strlen(cache_dir) + sizeof("/ppcg-0123456789abcdef.bin");
+	name = (char *) malloc(len);
+	if (!name)
+		return NULL;
+	snprintf(name, len, "%s/ppcg-%016llx.bin", cache_dir, hash);
+
+	return name;
+}
+
+/* Try and create a program for "dev" from the binary stored
+ * in the file called "filename".
+ * Return NULL if there is no such file or if the binary cannot be used.
+ */
+static cl_program opencl_load_program_binary(cl_context ctx,
+	cl_device_id dev, const char *filename, const char *opencl_options)
+{
+	FILE *file;
+	unsigned char *binary;
+	const unsigned char *binaries[1];
+	long size;
+	size_t binary_size;
+	cl_int status, err;
+	cl_program program;
+
+	file = fopen(filename, "rb");
+	if (!file)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	if (size <= 0) {
+		fclose(file);
+		return NULL;
+	}
+	binary_size = size;
+	binary = (unsigned char *) malloc(binary_size);
+	if (!binary || fread(binary, 1, binary_size, file) != binary_size) {
+		free(binary);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+
+	binaries[0] = binary;
+	program = clCreateProgramWithBinary(ctx, 1, &dev, &binary_size,
+					binaries, &status, &err);
+	free(binary);
+	if (err != CL_SUCCESS)
+		return NULL;
+	if (status != CL_SUCCESS) {
+		clReleaseProgram(program);
+		return NULL;
+	}
+	if (clBuildProgram(program, 0, NULL, opencl_options,
+				NULL, NULL) != CL_SUCCESS) {
+		clReleaseProgram(program);
+		return NULL;
+	}
+
+	return program;
+}
+
+/* Store the binary of "program" in the file called "filename".
+ * The binary is first written to a temporary file, which is then
+ * renamed, such that concurrently running programs never see
+ * a partially written binary.
+ * Failure to store the binary is silently ignored.
+ */
+static void opencl_save_program_binary(cl_program program,
+	const char *filename)
+{
+	FILE *file;
+	size_t binary_size;
+	unsigned char *binary;
+	unsigned char *binaries[1];
+	char *tmp;
+	size_t len;
+	int ok;
+
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES,
+			sizeof(binary_size), &binary_size, NULL) != CL_SUCCESS)
+		return;
+	if (binary_size == 0)
+		return;
+	binary = (unsigned char *) malloc(binary_size);
+	if (!binary)
+		return;
+	binaries[0] = binary;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES,
+			sizeof(binaries), binaries, NULL) != CL_SUCCESS) {
+		free(binary);
+		return;
+	}
+
+	len = strlen(filename) + 32;
+	tmp = (char *) malloc(len);
+	if (!tmp) {
+		free(binary);
+		return;
+	}
+	snprintf(tmp, len, "%s.%ld.tmp", filename, (long) getpid());
+	file = fopen(tmp, "wb");
+	ok = file != NULL;
+	if (file) {
+		ok = fwrite(binary, 1, binary_size, file) == binary_size;
+		ok = fclose(file) == 0 && ok;
+	}
+	if (ok)
+		ok = rename(tmp, filename) == 0;
+	if (!ok)
+		remove(tmp);
+
+	free(tmp);
+	free(binary);
+}
+
+/* Create an OpenCL program from a string and compile it,
+ * reusing a previously compiled binary from the directory "cache_dir"
+ * if available.
+ * If no such binary is available, then the program is compiled
+ * from source and the resulting binary is stored in "cache_dir".
+ * If "cache_dir" is NULL, then no cache is used.
+ */
+cl_program opencl_build_program_from_string_with_cache(cl_context ctx,
+	cl_device_id dev, const char *program_source, size_t program_size,
+	const char *opencl_options, const char *cache_dir)
+{
+	cl_program program;
+	char *cache_file;
+
+	if (!cache_dir)
+		return opencl_build_program_from_string(ctx, dev,
+				program_source, program_size, opencl_options);
+
+	cache_file = opencl_binary_cache_file(cache_dir, dev, program_source,
+					program_size, opencl_options);
+	program = NULL;
+	if (cache_file)
+		program = opencl_load_program_binary(ctx, dev, cache_file,
+							opencl_options);
+	if (!program) {
+		program = opencl_build_program_from_string(ctx, dev,
+				program_source, program_size, opencl_options);
+		if (cache_file)
+			opencl_save_program_binary(program, cache_file);
+	}
+	free(cache_file);
+
+	return program;
+}
+
+/* Create an OpenCL program from a source file and compile it,
+ * reusing a previously compiled binary from the directory "cache_dir"
+ * if available.
+ */
+cl_program opencl_build_program_from_file_with_cache(cl_context ctx,
+	cl_device_id dev, const char *filename, const char *opencl_options,
+	const char *cache_dir)
+{
+	cl_program program;
+	char *program_source;
+	size_t program_size;
+
+	program_source = opencl_read_source_file(filename, &program_size);
+	program = opencl_build_program_from_string_with_cache(ctx, dev,
+			program_source, program_size, opencl_options, cache_dir);
+	free(program_source);
+
+	return program;
+}
@@ -29,4 +29,20 @@ cl_program opencl_build_program_from_string(cl_context ctx, cl_device_id dev,
 cl_program opencl_build_program_from_file(cl_context ctx, cl_device_id dev,
 	const char* filename, const char* opencl_options);
 
+/* Create an OpenCL program from a string and compile it, reusing
+ * a binary cached in "cache_dir" for the same source, device and options
+ * and storing the binary in "cache_dir" otherwise.
+ */
+cl_program opencl_build_program_from_string_with_cache(cl_context ctx,
+	cl_device_id dev, const char *program_source, size_t program_size,
+	const char *opencl_options, const char *cache_dir);
+
+/* Create an OpenCL program from a source file and compile it, reusing
+ * a binary cached in "cache_dir" for the same source, device and options
+ * and storing the binary in "cache_dir" otherwise.
+ */
+cl_program opencl_build_program_from_file_with_cache(cl_context ctx,
+	cl_device_id dev, const char *filename, const char *opencl_options,
+	const char *cache_dir);
+
 #endif
@@ -33,6 +33,8 @@
  * kprinter is an isl_printer for the kernel file.
  * host_c is the generated source file for the host code.  kernel_c is
  * the generated source file for the kernel.
+ * n_kernel is the number of kernels launched from the scop
+ * that is currently being printed and kernels contains those kernels.
  */
 struct opencl_info {
 	struct ppcg_options *options;
@@ -44,6 +46,9 @@ struct opencl_info {
 
 	FILE *host_c;
 	FILE *kernel_c;
+
+	int n_kernel;
+	struct ppcg_kernel **kernels;
 };
 
 /* Open the file called "name" for writing or print an error message.
@@ -130,6 +135,27 @@ static void opencl_print_escaped(const char *str, const char *end, FILE *file)
 		fwrite(prev, 1, end - prev, file);
 }
 
+/* Print "str" to "p" and escape the characters that would break
+ * a C string, as in opencl_print_escaped.
+ */
+static __isl_give isl_printer *opencl_print_escaped_str(
+	__isl_take isl_printer *p, const char *str)
+{
+	char buf[3];
+
+	for (; *str; ++str) {
+		int n = 0;
+
+		if (*str == '"' || *str == '\\')
+			buf[n++] = '\\';
+		buf[n++] = *str;
+		buf[n] = '\0';
+		p = isl_printer_print_str(p, buf);
+	}
+
+	return p;
+}
+
 /* Write text to a file as a C string literal.
  *
  * This function also prints any characters after the last newline, although
@@ -219,8 +245,14 @@ static __isl_give isl_printer *opencl_print_host_macros(
 	return p;
 }
 
+/* Declare the device arrays.
+ * If the opencl_use_events option is set, then also declare
+ * an event for each device array that keeps track of the last
+ * command that accessed the device array.
+ */
 static __isl_give isl_printer *opencl_declare_device_arrays(
-	__isl_take isl_printer *p, struct gpu_prog *prog)
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct opencl_info *info)
 {
 	int i;
 
@@ -232,6 +264,13 @@ static __isl_give isl_printer *opencl_declare_device_arrays(
 		p = isl_printer_print_str(p, prog->array[i].name);
 		p = isl_printer_print_str(p, ";");
 		p = isl_printer_end_line(p);
+		if (!info->options->opencl_use_events)
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cl_event dev_");
+		p = isl_printer_print_str(p, prog->array[i].name);
+		p = isl_printer_print_str(p, "_event = NULL;");
+		p = isl_printer_end_line(p);
 	}
 	p = isl_printer_start_line(p);
 	p = isl_printer_end_line(p);
@@ -331,29 +370,120 @@ static __isl_give isl_printer *release_device_array(__isl_take isl_printer *p,
 	return p;
 }
 
+/* Release the event associated to the device array "array",
+ * if it has been set.
+ */
+static __isl_give isl_printer *release_device_array_event(
+	__isl_take isl_printer *p, struct gpu_array_info *array)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "if (dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, "_event)");
+	p = isl_printer_end_line(p);
+	p = isl_printer_indent(p, 2);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "openclCheckReturn(clReleaseEvent(dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, "_event));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_indent(p, -2);
+
+	return p;
+}
+
 /* Free the accessed device arrays.
+ *
+ * If the opencl_use_events option is set, then the kernels
+ * may still be running, so we first wait for all commands
+ * to finish and then release the events associated to the device arrays.
  */
 static __isl_give isl_printer *opencl_release_device_arrays(
-	__isl_take isl_printer *p, struct gpu_prog *prog)
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct opencl_info *info)
 {
 	int i;
 
+	if (info->options->opencl_use_events) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "openclCheckReturn("
+						"clFinish(queue));");
+		p = isl_printer_end_line(p);
+	}
+
 	for (i = 0; i < prog->n_array; ++i) {
 		struct gpu_array_info *array = &prog->array[i];
 		if (!gpu_array_requires_device_allocation(array))
 			continue;
 
+		if (info->options->opencl_use_events)
+			p = release_device_array_event(p, array);
 		p = release_device_array(p, array);
 	}
 	return p;
 }
 
+/* Declare and create the OpenCL kernel object for each kernel
+ * launched from the current scop.
+ * The kernel objects are only created once and then reused
+ * by every launch of the corresponding kernel.
+ */
+static __isl_give isl_printer *opencl_create_kernels(__isl_take isl_printer *p,
+	struct opencl_info *info)
+{
+	int i;
+
+	for (i = 0; i < info->n_kernel; ++i) {
+		int id = info->kernels[i]->id;
+
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cl_kernel kernel");
+		p = isl_printer_print_int(p, id);
+		p = isl_printer_print_str(p, " = clCreateKernel(program, \"kernel");
+		p = isl_printer_print_int(p, id);
+		p = isl_printer_print_str(p, "\", &err);");
+		p = isl_printer_end_line(p);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "openclCheckReturn(err);");
+		p = isl_printer_end_line(p);
+	}
+
+	return p;
+}
+
+/* Release the OpenCL kernel objects created by opencl_create_kernels.
+ */
+static __isl_give isl_printer *opencl_release_kernels(
+	__isl_take isl_printer *p, struct opencl_info *info)
+{
+	int i;
+
+	for (i = 0; i < info->n_kernel; ++i) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "openclCheckReturn("
+						"clReleaseKernel(kernel");
+		p = isl_printer_print_int(p, info->kernels[i]->id);
+		p = isl_printer_print_str(p, "));");
+		p = isl_printer_end_line(p);
+	}
+
+	return p;
+}
+
 /* Create an OpenCL device, context, command queue and build the kernel.
+ * If the opencl_use_events option is set, then the command queue
+ * is an out-of-order queue.
+ * If the opencl_binary_cache option is set, then the program
+ * is built through a binary cache in the specified directory.
+ * Also create the kernel objects of all kernels launched from
+ * the current scop.
  * input is the name of the input file provided to ppcg.
  */
 static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 	const char *input, struct opencl_info *info)
 {
+	const char *cache = info->options->opencl_binary_cache;
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "cl_device_id device;");
 	p = isl_printer_end_line(p);
@@ -383,7 +513,13 @@ static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 	p = isl_printer_end_line(p);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "queue = clCreateCommandQueue"
-					"(context, device, 0, &err);");
+					"(context, device, ");
+	if (info->options->opencl_use_events)
+		p = isl_printer_print_str(p,
+				"CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE");
+	else
+		p = isl_printer_print_str(p, "0");
+	p = isl_printer_print_str(p, ", &err);");
 	p = isl_printer_end_line(p);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(err);");
@@ -393,12 +529,16 @@ static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 	p = isl_printer_print_str(p, "program = ");
 
 	if (info->options->opencl_embed_kernel_code) {
-		p = isl_printer_print_str(p, "opencl_build_program_from_string("
-						"context, device, kernel_code, "
+		p = isl_printer_print_str(p, "opencl_build_program_from_string");
+		if (cache)
+			p = isl_printer_print_str(p, "_with_cache");
+		p = isl_printer_print_str(p, "(context, device, kernel_code, "
 						"sizeof(kernel_code), \"");
 	} else {
-		p = isl_printer_print_str(p, "opencl_build_program_from_file("
-						"context, device, \"");
+		p = isl_printer_print_str(p, "opencl_build_program_from_file");
+		if (cache)
+			p = isl_printer_print_str(p, "_with_cache");
+		p = isl_printer_print_str(p, "(context, device, \"");
 		p = isl_printer_print_str(p, info->kernel_c_name);
 		p = isl_printer_print_str(p, "\", \"");
 	}
@@ -407,8 +547,15 @@ static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 		p = isl_printer_print_str(p,
 					info->options->opencl_compiler_options);
 
-	p = isl_printer_print_str(p, "\");");
+	p = isl_printer_print_str(p, "\"");
+	if (cache) {
+		p = isl_printer_print_str(p, ", \"");
+		p = opencl_print_escaped_str(p, cache);
+		p = isl_printer_print_str(p, "\"");
+	}
+	p = isl_printer_print_str(p, ");");
 	p = isl_printer_end_line(p);
+	p = opencl_create_kernels(p, info);
 	p = isl_printer_start_line(p);
 	p = isl_printer_end_line(p);
 
@@ -418,6 +565,7 @@ static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 static __isl_give isl_printer *opencl_release_cl_objects(
 	__isl_take isl_printer *p, struct opencl_info *info)
 {
+	p = opencl_release_kernels(p, info);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(clReleaseCommandQueue"
 					"(queue));");
@@ -489,10 +637,15 @@ static __isl_give isl_printer *opencl_print_block_sizes(
 
 /* Set the arguments of the OpenCL kernel by printing a call to the OpenCL
  * clSetKernelArg() function for each kernel argument.
+ *
+ * If "invariant" is set, then only the arguments that remain the same
+ * for every launch of the kernel within the scop are set,
+ * i.e., the arrays accessed by the kernel and the parameters.
+ * Otherwise, only the host loop iterators are set.
  */
 static __isl_give isl_printer *opencl_set_kernel_arguments(
 	__isl_take isl_printer *p, struct gpu_prog *prog,
-	struct ppcg_kernel *kernel)
+	struct ppcg_kernel *kernel, int invariant)
 {
 	int i, n, ro;
 	unsigned nparam;
@@ -508,8 +661,9 @@ static __isl_give isl_printer *opencl_set_kernel_arguments(
 		if (!required)
 			continue;
 		ro = gpu_array_is_read_only_scalar(&prog->array[i]);
-		opencl_set_kernel_argument(p, kernel->id, prog->array[i].name,
-			arg_index, ro);
+		if (invariant)
+			p = opencl_set_kernel_argument(p, kernel->id,
+				prog->array[i].name, arg_index, ro);
 		arg_index++;
 	}
 
@@ -519,23 +673,49 @@ static __isl_give isl_printer *opencl_set_kernel_arguments(
 		const char *name;
 
 		name = isl_space_get_dim_name(space, isl_dim_param, i);
-		opencl_set_kernel_argument(p, kernel->id, name, arg_index, 1);
+		if (invariant)
+			p = opencl_set_kernel_argument(p, kernel->id, name,
+							arg_index, 1);
 		arg_index++;
 	}
 	isl_space_free(space);
 
+	if (invariant)
+		return p;
+
 	n = isl_space_dim(kernel->space, isl_dim_set);
 	for (i = 0; i < n; ++i) {
 		const char *name;
 
 		name = isl_space_get_dim_name(kernel->space, isl_dim_set, i);
-		opencl_set_kernel_argument(p, kernel->id, name, arg_index, 1);
+		p = opencl_set_kernel_argument(p, kernel->id, name,
+						arg_index, 1);
 		arg_index++;
 	}
 
 	return p;
 }
 
+/* Set the arguments of all kernels launched from the current scop
+ * that do not change from one launch to the next.
+ * This needs to be done after the device arrays have been allocated.
+ */
+static __isl_give isl_printer *opencl_set_invariant_kernel_arguments(
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct opencl_info *info)
+{
+	int i;
+
+	for (i = 0; i < info->n_kernel; ++i)
+		p = opencl_set_kernel_arguments(p, prog, info->kernels[i], 1);
+	if (info->n_kernel > 0) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_end_line(p);
+	}
+
+	return p;
+}
+
 /* Print the arguments to a kernel declaration or call.  If "types" is set,
  * then print a declaration (including the types of the arguments).
  *
@@ -981,6 +1161,124 @@ static __isl_give isl_printer *opencl_print_total_number_of_work_items_for_dim(
 	return p;
 }
 
+/* Is array "i" of "prog" a device array that is accessed by "kernel"?
+ * That is, is it passed to the kernel as a cl_mem argument?
+ */
+static int kernel_accesses_device_array(struct gpu_prog *prog,
+	struct ppcg_kernel *kernel, int i)
+{
+	int required;
+
+	required = ppcg_kernel_requires_array_argument(kernel, i);
+	if (required <= 0)
+		return required;
+	return !gpu_array_is_read_only_scalar(&prog->array[i]);
+}
+
+/* Return the number of device arrays accessed by "kernel".
+ */
+static int n_kernel_device_arrays(struct gpu_prog *prog,
+	struct ppcg_kernel *kernel)
+{
+	int i, n = 0;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		int accessed;
+
+		accessed = kernel_accesses_device_array(prog, kernel, i);
+		if (accessed < 0)
+			return -1;
+		if (accessed)
+			n++;
+	}
+
+	return n;
+}
+
+/* Print code that collects the events of the device arrays accessed
+ * by "kernel" in a wait list for the launch of the kernel.
+ * "n" is the number of device arrays accessed by "kernel",
+ * which is assumed to be positive.
+ * The number of events in the wait list is stored in "n_wait" and
+ * "event" is declared to receive the event of the launch.
+ *
+ * Each kernel waits for all previous commands that accessed any
+ * of the device arrays that it accesses.  This is slightly
+ * more conservative than needed since it also orders kernels
+ * that only read from the same array.
+ */
+static __isl_give isl_printer *opencl_collect_kernel_wait_list(
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct ppcg_kernel *kernel, int n)
+{
+	int i;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cl_event event, wait_list[");
+	p = isl_printer_print_int(p, n);
+	p = isl_printer_print_str(p, "];");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cl_uint n_wait = 0;");
+	p = isl_printer_end_line(p);
+
+	for (i = 0; i < prog->n_array; ++i) {
+		const char *name = prog->array[i].name;
+
+		if (!kernel_accesses_device_array(prog, kernel, i))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "if (dev_");
+		p = isl_printer_print_str(p, name);
+		p = isl_printer_print_str(p, "_event)");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, 2);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "wait_list[n_wait++] = dev_");
+		p = isl_printer_print_str(p, name);
+		p = isl_printer_print_str(p, "_event;");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, -2);
+	}
+
+	return p;
+}
+
+/* Print code that makes the event of the launch of "kernel"
+ * the event of each of the device arrays accessed by "kernel",
+ * releasing the previous events.
+ * Each device array holds its own reference to the event.
+ */
+static __isl_give isl_printer *opencl_update_kernel_events(
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct ppcg_kernel *kernel)
+{
+	int i;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!kernel_accesses_device_array(prog, kernel, i))
+			continue;
+		p = release_device_array_event(p, array);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p,
+				"openclCheckReturn(clRetainEvent(event));");
+		p = isl_printer_end_line(p);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "dev_");
+		p = isl_printer_print_str(p, array->name);
+		p = isl_printer_print_str(p, "_event = event;");
+		p = isl_printer_end_line(p);
+	}
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+				"openclCheckReturn(clReleaseEvent(event));");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
 /* Print a list that represents the total number of work items.  The list is
  * constructed by performing an element-wise multiplication of the block sizes
  * and the grid sizes.  To explain how the list is constructed, suppose that:
@@ -1024,11 +1322,33 @@ static __isl_give isl_printer *opencl_print_total_number_of_work_items_as_list(
 	return p;
 }
 
+/* Print the event wait list arguments of a command that only
+ * needs to wait for the last command accessing "array".
+ */
+static __isl_give isl_printer *print_array_event_wait_list(
+	__isl_take isl_printer *p, struct gpu_array_info *array)
+{
+	p = isl_printer_print_str(p, "dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, "_event ? 1 : 0, dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, "_event ? &dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, "_event : NULL");
+
+	return p;
+}
+
 /* Copy "array" from the host to the device (to_host = 0) or
  * back from the device to the host (to_host = 1).
+ *
+ * The copies are blocking, so they are complete by the time
+ * the host continues.  If the opencl_use_events option is set,
+ * then they still need to wait for the last command that accessed
+ * the device array on the out-of-order queue.
  */
 static __isl_give isl_printer *copy_array(__isl_take isl_printer *p,
-	struct gpu_array_info *array, int to_host)
+	struct gpu_array_info *array, int to_host, struct opencl_info *info)
 {
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(");
@@ -1046,7 +1366,12 @@ static __isl_give isl_printer *copy_array(__isl_take isl_printer *p,
 	else
 		p = isl_printer_print_str(p, ", ");
 	p = isl_printer_print_str(p, array->name);
-	p = isl_printer_print_str(p, ", 0, NULL, NULL));");
+	p = isl_printer_print_str(p, ", ");
+	if (info->options->opencl_use_events)
+		p = print_array_event_wait_list(p, array);
+	else
+		p = isl_printer_print_str(p, "0, NULL");
+	p = isl_printer_print_str(p, ", NULL));");
 	p = isl_printer_end_line(p);
 
 	return p;
@@ -1055,6 +1380,8 @@ static __isl_give isl_printer *copy_array(__isl_take isl_printer *p,
 /* Print code for initializing the device for execution of the transformed
  * code.  This includes declaring locally defined variables as well as
  * declaring and allocating the required copies of arrays on the device.
+ * The kernel objects are also created here and all their arguments
+ * that are the same for every launch are set.
  */
 static __isl_give isl_printer *init_device(__isl_take isl_printer *p,
 	struct gpu_prog *prog, struct opencl_info *opencl)
@@ -1062,9 +1389,10 @@ static __isl_give isl_printer *init_device(__isl_take isl_printer *p,
 	p = opencl_print_host_macros(p);
 
 	p = gpu_print_local_declarations(p, prog);
-	p = opencl_declare_device_arrays(p, prog);
+	p = opencl_declare_device_arrays(p, prog, opencl);
 	p = opencl_setup(p, opencl->input, opencl);
 	p = opencl_allocate_device_arrays(p, prog);
+	p = opencl_set_invariant_kernel_arguments(p, prog, opencl);
 
 	return p;
 }
@@ -1075,7 +1403,7 @@ static __isl_give isl_printer *init_device(__isl_take isl_printer *p,
 static __isl_give isl_printer *clear_device(__isl_take isl_printer *p,
 	struct gpu_prog *prog, struct opencl_info *opencl)
 {
-	p = opencl_release_device_arrays(p, prog);
+	p = opencl_release_device_arrays(p, prog, opencl);
 	p = opencl_release_cl_objects(p, opencl);
 
 	return p;
@@ -1121,9 +1449,9 @@ static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
 		return isl_printer_free(p);
 
 	if (!prefixcmp(name, "to_device"))
-		return copy_array(p, array, 0);
+		return copy_array(p, array, 0, opencl);
 	else
-		return copy_array(p, array, 1);
+		return copy_array(p, array, 1, opencl);
 }
 
 /* Print the user statement of the host code to "p".
@@ -1137,7 +1465,9 @@ static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
  * The annotation on the user statements is called "user".
  *
  * In case of a kernel launch, print a block of statements that
- * defines the grid and the work group and then launches the kernel.
+ * defines the grid and the work group, sets the kernel arguments
+ * that may differ between launches and then launches the kernel.
+ * The kernel object itself has been created by init_device.
  *
  * A grid is composed of many work groups (blocks), each work group holds
  * many work-items (threads).
@@ -1153,6 +1483,15 @@ static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
  * number of work-items in a block (work-group) is computed as:
  * block_size[0] *... * block_size[kernel->n_block - 1].
  *
+ * If the opencl_use_events option is set, then the kernel is not
+ * waited for after the launch.  Instead, the launch waits for
+ * the events of the device arrays accessed by the kernel and
+ * the event of the launch replaces those events.
+ * If the kernel does not access any device arrays, then
+ * the launch neither waits for nor produces any event,
+ * such that no unused event variables are declared.
+ * Otherwise, the host waits for the kernel to finish.
+ *
  * For more information check:
  * http://www.khronos.org/registry/cl/sdk/1.0/docs/man/xhtml/clEnqueueNDRangeKernel.html
  */
@@ -1166,6 +1505,7 @@ static __isl_give isl_printer *opencl_print_host_user(
 	struct ppcg_kernel *kernel;
 	struct ppcg_kernel_stmt *stmt;
 	struct print_host_user_data_opencl *data;
+	int n_event;
 
 	isl_ast_print_options_free(print_options);
 
@@ -1214,18 +1554,15 @@ static __isl_give isl_printer *opencl_print_host_user(
 	p = isl_printer_print_str(p, "};");
 	p = isl_printer_end_line(p);
 
-	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "cl_kernel kernel");
-	p = isl_printer_print_int(p, kernel->id);
-	p = isl_printer_print_str(p, " = clCreateKernel(program, \"kernel");
-	p = isl_printer_print_int(p, kernel->id);
-	p = isl_printer_print_str(p, "\", &err);");
-	p = isl_printer_end_line(p);
-	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "openclCheckReturn(err);");
-	p = isl_printer_end_line(p);
-
-	opencl_set_kernel_arguments(p, data->prog, kernel);
+	p = opencl_set_kernel_arguments(p, data->prog, kernel, 0);
+	n_event = 0;
+	if (data->opencl->options->opencl_use_events)
+		n_event = n_kernel_device_arrays(data->prog, kernel);
+	if (n_event < 0)
+		return isl_printer_free(p);
+	if (n_event > 0)
+		p = opencl_collect_kernel_wait_list(p, data->prog, kernel,
+						    n_event);
 
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(clEnqueueNDRangeKernel"
@@ -1238,18 +1575,20 @@ static __isl_give isl_printer *opencl_print_host_user(
 		p = isl_printer_print_int(p, 1);
 
 	p = isl_printer_print_str(p, ", NULL, global_work_size, "
-					"block_size, "
-					"0, NULL, NULL));");
-	p = isl_printer_end_line(p);
-	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "openclCheckReturn("
-					"clReleaseKernel(kernel");
-	p = isl_printer_print_int(p, kernel->id);
-	p = isl_printer_print_str(p, "));");
-	p = isl_printer_end_line(p);
-	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "clFinish(queue);");
+					"block_size, ");
+	if (n_event > 0)
+		p = isl_printer_print_str(p, "n_wait, "
+					"n_wait ? wait_list : NULL, &event));");
+	else
+		p = isl_printer_print_str(p, "0, NULL, NULL));");
 	p = isl_printer_end_line(p);
+	if (n_event > 0) {
+		p = opencl_update_kernel_events(p, data->prog, kernel);
+	} else if (!data->opencl->options->opencl_use_events) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "clFinish(queue);");
+		p = isl_printer_end_line(p);
+	}
 	p = isl_printer_indent(p, -2);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "}");
@@ -1282,6 +1621,60 @@ static __isl_give isl_printer *opencl_print_host_code(
 	return p;
 }
 
+/* This function is called for each node in the host AST.
+ * If "node" is a kernel launch, then add the corresponding kernel
+ * to the list of kernels in the opencl_info "user".
+ * Kernel launches are user nodes with an annotation called "kernel".
+ */
+static isl_bool collect_kernel(__isl_keep isl_ast_node *node, void *user)
+{
+	struct opencl_info *opencl = user;
+	struct ppcg_kernel **kernels;
+	isl_ctx *ctx;
+	isl_id *id;
+	int is_kernel;
+
+	if (isl_ast_node_get_type(node) != isl_ast_node_user)
+		return isl_bool_true;
+
+	id = isl_ast_node_get_annotation(node);
+	if (!id)
+		return isl_bool_false;
+	is_kernel = !strcmp(isl_id_get_name(id), "kernel");
+	if (!is_kernel) {
+		isl_id_free(id);
+		return isl_bool_false;
+	}
+
+	ctx = isl_ast_node_get_ctx(node);
+	kernels = isl_realloc_array(ctx, opencl->kernels,
+				struct ppcg_kernel *, opencl->n_kernel + 1);
+	if (!kernels) {
+		isl_id_free(id);
+		return isl_bool_error;
+	}
+	opencl->kernels = kernels;
+	opencl->kernels[opencl->n_kernel++] = isl_id_get_user(id);
+	isl_id_free(id);
+
+	return isl_bool_false;
+}
+
+/* Collect the kernels launched from "tree" in opencl->kernels
+ * such that the corresponding kernel objects can be created
+ * once during the initialization of the device.
+ */
+static isl_stat collect_kernels(__isl_keep isl_ast_node *tree,
+	struct opencl_info *opencl)
+{
+	free(opencl->kernels);
+	opencl->kernels = NULL;
+	opencl->n_kernel = 0;
+
+	return isl_ast_node_foreach_descendant_top_down(tree,
+						&collect_kernel, opencl);
+}
+
 /* Given a gpu_prog "prog" and the corresponding transformed AST
  * "tree", print the entire OpenCL code to "p".
  */
@@ -1291,6 +1684,9 @@ static __isl_give isl_printer *print_opencl(__isl_take isl_printer *p,
 {
 	struct opencl_info *opencl = user;
 
+	if (collect_kernels(tree, opencl) < 0)
+		return isl_printer_free(p);
+
 	opencl->kprinter = isl_printer_set_output_format(opencl->kprinter,
 							ISL_FORMAT_C);
 	if (any_double_elements(prog))
@@ -1337,6 +1733,7 @@ int generate_opencl(isl_ctx *ctx, struct ppcg_options *options,
 	if (opencl_close_files(&opencl) < 0)
 		r = -1;
 	isl_printer_free(opencl.kprinter);
+	free(opencl.kernels);
 
 	return r;
 }
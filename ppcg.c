@@ -12,9 +12,13 @@
  */
 
 #include <assert.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <isl/ctx.h>
 #include <isl/id.h>
 #include <isl/val.h>
@@ -35,12 +39,17 @@
 #include "cuda.h"
 #include "opencl.h"
 #include "cpu.h"
+#include "extract_cache.h"
+#include "profile.h"
+#include "server.h"
 
 struct options {
 	struct pet_options *pet;
 	struct ppcg_options *ppcg;
 	char *input;
 	char *output;
+	int n_extra_input;
+	const char **extra_inputs;
 };
 
 const char *ppcg_version(void);
@@ -54,6 +63,8 @@ ISL_ARG_CHILD(struct options, pet, "pet", &pet_options_args, "pet options")
 ISL_ARG_CHILD(struct options, ppcg, NULL, &ppcg_options_args, "ppcg options")
 ISL_ARG_STR(struct options, output, 'o', NULL,
 	"filename", NULL, "output filename (c and opencl targets)")
+ISL_ARG_STR_LIST(struct options, n_extra_input, extra_inputs, 0,
+	"additional-input", "filename", "additional input file")
 ISL_ARG_ARG(struct options, input, "input", NULL)
 ISL_ARG_VERSION(print_version)
 ISL_ARGS_END
@@ -947,9 +958,15 @@ static struct ppcg_scop *ppcg_scop_from_pet_scop(struct pet_scop *scop,
 		ps->independence = isl_union_map_union(ps->independence,
 			isl_union_map_copy(scop->independences[i]->filter));
 
+	ppcg_profile_start(options->profile, "compute_tagger");
 	compute_tagger(ps);
+	ppcg_profile_end(options->profile);
+	ppcg_profile_start(options->profile, "compute_dependences");
 	compute_dependences(ps);
+	ppcg_profile_end(options->profile);
+	ppcg_profile_start(options->profile, "eliminate_dead_code");
 	eliminate_dead_code(ps);
+	ppcg_profile_end(options->profile);
 
 	if (!ps->context || !ps->domain || !ps->call || !ps->reads ||
 	    !ps->may_writes || !ps->must_writes || !ps->tagged_must_kills ||
@@ -959,13 +976,137 @@ static struct ppcg_scop *ppcg_scop_from_pet_scop(struct pet_scop *scop,
 	return ps;
 }
 
+/* The per-scop compile budget of a call to ppcg_transform.
+ *
+ * "line" is the line number of the scop that is currently being processed.
+ * "active" is set while the budget is being enforced.
+ * The budget is only enforced during the dependence analysis
+ * and the scheduling, such that an exhausted budget cannot
+ * affect any of the other computations.
+ * "ctx" is the isl_ctx on which the time limit is enforced or NULL
+ * if no time limit is being enforced.
+ * "handler" is the SIGALRM handler that was installed before
+ * the time limit started being enforced.
+ */
+struct ppcg_budget {
+	int line;
+	int active;
+	isl_ctx *ctx;
+	void (*handler)(int);
+};
+
+/* The isl_ctx on which a time limit is currently being enforced, if any.
+ * A signal handler cannot be passed any state, so this is the only
+ * part of the budget that is kept outside of struct ppcg_budget.
+ * It is only set while an alarm is pending.
+ */
+static isl_ctx *volatile alarm_ctx;
+
+/* SIGALRM handler that interrupts the computation on alarm_ctx
+ * when the time limit of the current phase has been reached.
+ */
+static void budget_timeout(int sig)
+{
+	isl_ctx *ctx = alarm_ctx;
+
+	if (ctx)
+		isl_ctx_abort(ctx);
+}
+
+/* Start enforcing the per-scop compile budget specified by "options"
+ * on "ctx" for the current phase of the scop that is being processed
+ * by the call to ppcg_transform that set options->budget.
+ * The operation limit is enforced by isl itself, while
+ * the time limit is enforced by aborting the isl computation
+ * when an alarm goes off.
+ * Each phase gets the full budget.
+ */
+void ppcg_budget_start(isl_ctx *ctx, struct ppcg_options *options)
+{
+	struct ppcg_budget *budget = options->budget;
+
+	if (!budget || budget->active)
+		return;
+	if (!options->scop_max_operations && options->scop_timeout <= 0)
+		return;
+
+	budget->active = 1;
+	isl_ctx_reset_error(ctx);
+	isl_ctx_reset_operations(ctx);
+	isl_ctx_set_max_operations(ctx, options->scop_max_operations);
+	if (options->scop_timeout > 0 && !alarm_ctx) {
+		budget->ctx = ctx;
+		alarm_ctx = ctx;
+		budget->handler = signal(SIGALRM, &budget_timeout);
+		alarm(options->scop_timeout);
+	}
+}
+
+/* Has the computation on "ctx" been interrupted because
+ * the compile budget specified by "options" was exceeded?
+ */
+int ppcg_budget_exceeded(isl_ctx *ctx, struct ppcg_options *options)
+{
+	enum isl_error error;
+
+	if (!options->budget || !options->budget->active)
+		return 0;
+
+	error = isl_ctx_last_error(ctx);
+	return error == isl_error_quota || error == isl_error_abort;
+}
+
+/* Report that the compile budget specified by "options" was exceeded
+ * during "phase" and that PPCG will perform "action" instead.
+ */
+void ppcg_budget_report(struct ppcg_options *options, const char *phase,
+	const char *action)
+{
+	int line = options->budget ? options->budget->line : -1;
+
+	fprintf(stderr, "scop at line %d exceeded its compile budget "
+		"during %s; %s\n", line, phase, action);
+}
+
+/* Stop enforcing the per-scop compile budget specified by "options"
+ * on "ctx", if any, such that the remaining computations on "ctx"
+ * can complete.
+ * If the budget was exceeded, then the corresponding error
+ * is cleared as well.
+ */
+void ppcg_budget_stop(isl_ctx *ctx, struct ppcg_options *options)
+{
+	struct ppcg_budget *budget = options->budget;
+
+	if (!budget || !budget->active)
+		return;
+
+	if (budget->ctx) {
+		alarm(0);
+		alarm_ctx = NULL;
+		signal(SIGALRM, budget->handler);
+		budget->ctx = NULL;
+	}
+	isl_ctx_set_max_operations(ctx, 0);
+	if (ppcg_budget_exceeded(ctx, options))
+		isl_ctx_reset_error(ctx);
+	isl_ctx_resume(ctx);
+	budget->active = 0;
+}
+
 /* Internal data structure for ppcg_transform.
+ *
+ * "budget" is the per-scop compile budget of this call.
+ * "original" is the contents of the input file if the scops
+ * are being loaded from the extraction cache and NULL otherwise.
  */
 struct ppcg_transform_data {
 	struct ppcg_options *options;
 	__isl_give isl_printer *(*transform)(__isl_take isl_printer *p,
 		struct ppcg_scop *scop, void *user);
 	void *user;
+	struct ppcg_budget budget;
+	const char *original;
 };
 
 /* Should we print the original code?
@@ -992,6 +1133,36 @@ static int print_original(struct pet_scop *scop, struct ppcg_options *options)
 	return 0;
 }
 
+/* Print the original code of "scop" to "p".
+ *
+ * A scop that was loaded from the extraction cache is not attached
+ * to the input file, so pet_scop_print_original cannot be used
+ * on such a scop.  Copy the code from data->original instead.
+ */
+static __isl_give isl_printer *print_original_code(__isl_take isl_printer *p,
+	struct pet_scop *scop, struct ppcg_transform_data *data)
+{
+	unsigned start, end;
+	char *code;
+
+	if (!data->original)
+		return pet_scop_print_original(scop, p);
+	if (!scop)
+		return isl_printer_free(p);
+
+	start = pet_loc_get_start(scop->loc);
+	end = pet_loc_get_end(scop->loc);
+	code = malloc(end - start + 1);
+	if (!code)
+		return isl_printer_free(p);
+	memcpy(code, data->original + start, end - start);
+	code[end - start] = '\0';
+	p = isl_printer_print_str(p, code);
+	free(code);
+
+	return p;
+}
+
 /* Callback for pet_transform_C_source that transforms
  * the given pet_scop to a ppcg_scop before calling the
  * ppcg_transform callback.
@@ -999,26 +1170,58 @@ static int print_original(struct pet_scop *scop, struct ppcg_options *options)
  * If "scop" contains any data dependent conditions or if we may
  * not be able to print the transformed program, then just print
  * the original code.
+ *
+ * The dependence analysis and the scheduling are subject to
+ * the per-scop compile budget specified by the user.
+ * If the budget is exceeded during the dependence analysis,
+ * then the original code is printed.
+ * The budget is no longer enforced after the dependence analysis.
+ * ppcg_get_schedule enforces it again during the scheduling and
+ * falls back to the input schedule if it is exceeded.
+ *
+ * The extraction of "scop" has been timed since the end of
+ * the previous call (or the start of ppcg_transform).
+ * Stop this timing and start timing the extraction of the next scop
+ * when we are done with "scop".
  */
 static __isl_give isl_printer *transform(__isl_take isl_printer *p,
 	struct pet_scop *scop, void *user)
 {
 	struct ppcg_transform_data *data = user;
+	struct ppcg_profile *profile = data->options->profile;
 	struct ppcg_scop *ps;
 
+	ppcg_profile_end(profile);
+
 	if (print_original(scop, data->options)) {
-		p = pet_scop_print_original(scop, p);
+		p = print_original_code(p, scop, data);
 		pet_scop_free(scop);
-		return p;
-	}
-
-	scop = pet_scop_align_params(scop);
-	ps = ppcg_scop_from_pet_scop(scop, data->options);
+	} else {
+		isl_ctx *ctx = isl_printer_get_ctx(p);
+		int exceeded;
+
+		scop = pet_scop_align_params(scop);
+		data->budget.line = scop ? pet_loc_get_line(scop->loc) : -1;
+		ppcg_budget_start(ctx, data->options);
+		ps = ppcg_scop_from_pet_scop(scop, data->options);
+		exceeded = ppcg_budget_exceeded(ctx, data->options);
+		ppcg_budget_stop(ctx, data->options);
+
+		if (exceeded) {
+			ppcg_budget_report(data->options, "dependence analysis",
+					    "printing original code");
+			ps = ppcg_scop_free(ps);
+			p = print_original_code(p, scop, data);
+		} else {
+			p = data->transform(p, ps, data->user);
+		}
 
-	p = data->transform(p, ps, data->user);
+		ppcg_scop_free(ps);
+		pet_scop_free(scop);
+	}
 
-	ppcg_scop_free(ps);
-	pet_scop_free(scop);
+	ppcg_profile_next_scop(profile);
+	ppcg_profile_start(profile, "pet_extraction");
 
 	return p;
 }
@@ -1029,6 +1232,8 @@ static __isl_give isl_printer *transform(__isl_take isl_printer *p,
  *
  * This is a wrapper around pet_transform_C_source that transforms
  * the pet_scop to a ppcg_scop before calling "fn".
+ * If an extraction cache directory has been specified,
+ * then the scops are obtained from this cache if possible.
  */
 int ppcg_transform(isl_ctx *ctx, const char *input, FILE *out,
 	struct ppcg_options *options,
@@ -1036,7 +1241,21 @@ int ppcg_transform(isl_ctx *ctx, const char *input, FILE *out,
 		struct ppcg_scop *scop, void *user), void *user)
 {
 	struct ppcg_transform_data data = { options, fn, user };
-	return pet_transform_C_source(ctx, input, out, &transform, &data);
+	struct ppcg_budget *budget = options->budget;
+	int r;
+
+	options->budget = &data.budget;
+	ppcg_profile_start(options->profile, "pet_extraction");
+	if (options->extraction_cache)
+		r = ppcg_extract_cache_transform(ctx, input, out,
+				options->extraction_cache, options->command_line,
+				&data.original, &transform, &data);
+	else
+		r = pet_transform_C_source(ctx, input, out, &transform, &data);
+	ppcg_profile_end(options->profile);
+	options->budget = budget;
+
+	return r;
 }
 
 /* Check consistency of options.
@@ -1060,14 +1279,198 @@ static int check_options(isl_ctx *ctx)
 	return 0;
 }
 
-int main(int argc, char **argv)
+/* Construct a string that describes the version of PPCG and
+ * the command line "argv" of length "argc",
+ * for use in the key of the extraction cache.
+ */
+static char *command_line(int argc, char **argv)
 {
-	int r;
+	int i;
+	size_t len;
+	char *str;
+	const char *version = ppcg_version();
+
+	len = strlen(version) + 1;
+	for (i = 0; i < argc; ++i)
+		len += strlen(argv[i]) + 1;
+	str = malloc(len);
+	if (!str)
+		return NULL;
+	strcpy(str, version);
+	for (i = 0; i < argc; ++i) {
+		strcat(str, argv[i]);
+		strcat(str, "\n");
+	}
+
+	return str;
+}
+
+/* Generate code for the input file "input" and write it to "output",
+ * or to a file derived from "input" if "output" is NULL.
+ */
+static int process(isl_ctx *ctx, struct ppcg_options *options,
+	const char *input, const char *output)
+{
+	if (options->target == PPCG_TARGET_CUDA)
+		return generate_cuda(ctx, options, input);
+	else if (options->target == PPCG_TARGET_OPENCL)
+		return generate_opencl(ctx, options, input, output);
+	else
+		return generate_cpu(ctx, options, input, output);
+}
+
+/* Check that the "n" input files "inputs" can be processed together.
+ * In particular, the name of the output file cannot be specified and
+ * the phases cannot be timed when there is more than one input file.
+ * Moreover, since the output file names are derived from the base names
+ * of the input files, these base names need to be distinct.
+ *
+ * Return -1 on error.
+ */
+static int check_inputs(isl_ctx *ctx, struct options *options,
+	int n, const char **inputs)
+{
+	int i, j;
+
+	if (n <= 1)
+		return 0;
+
+	if (options->output || options->ppcg->time_phases)
+		isl_die(ctx, isl_error_invalid,
+			"output file and phase timing can only be specified "
+			"for a single input file", return -1);
+
+	for (i = 0; i < n; ++i) {
+		for (j = 0; j < i; ++j)
+			if (!strcmp(ppcg_base_name(inputs[i]),
+				    ppcg_base_name(inputs[j]))) {
+				fprintf(stderr, "input files %s and %s have "
+					"the same base name\n",
+					inputs[j], inputs[i]);
+				return -1;
+			}
+	}
+
+	return 0;
+}
+
+/* Process the "n" input files "inputs" using at most "jobs"
+ * worker processes.
+ *
+ * isl contexts cannot be shared between threads, so each input file
+ * is processed in a separate process that is forked off from the main
+ * process and that therefore works on its own copy of "ctx".
+ * The workers only share the file system and each of them writes
+ * to its own output files, so the generated code does not depend
+ * on the number of workers or on the order in which they finish.
+ *
+ * If "jobs" is at most one, then the input files are processed
+ * in order in the main process.
+ *
+ * Return 0 if all input files were processed successfully.
+ */
+static int process_inputs(isl_ctx *ctx, struct ppcg_options *options,
+	int n, const char **inputs, int jobs)
+{
+	int i, next, running, failed = 0;
+	pid_t *pids;
+
+	if (jobs <= 1 || n <= 1) {
+		for (i = 0; i < n; ++i)
+			if (process(ctx, options, inputs[i], NULL) != 0)
+				failed = 1;
+		return failed ? -1 : 0;
+	}
+
+	pids = isl_calloc_array(ctx, pid_t, n);
+	if (!pids)
+		return -1;
+
+	fflush(NULL);
+	next = running = 0;
+	while (next < n || running > 0) {
+		int status;
+		pid_t pid;
+
+		if (next < n && running < jobs) {
+			pid = fork();
+			if (pid == 0) {
+				int r = process(ctx, options, inputs[next],
+						NULL);
+				fflush(NULL);
+				_exit(r == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+			if (pid < 0) {
+				fprintf(stderr, "unable to start worker "
+					"for %s\n", inputs[next]);
+				failed = 1;
+				n = next;
+				continue;
+			}
+			pids[next++] = pid;
+			running++;
+			continue;
+		}
+
+		pid = wait(&status);
+		if (pid < 0)
+			break;
+		running--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			continue;
+		failed = 1;
+		for (i = 0; i < next; ++i)
+			if (pids[i] == pid)
+				fprintf(stderr, "failed to process %s\n",
+					inputs[i]);
+	}
+
+	free(pids);
+
+	return failed ? -1 : 0;
+}
+
+/* Return an array containing the main input file of "options",
+ * followed by the additional input files.
+ */
+static const char **collect_inputs(isl_ctx *ctx, struct options *options)
+{
+	int i;
+	const char **inputs;
+
+	inputs = isl_alloc_array(ctx, const char *,
+				1 + options->n_extra_input);
+	if (!inputs)
+		return NULL;
+	inputs[0] = options->input;
+	for (i = 0; i < options->n_extra_input; ++i)
+		inputs[1 + i] = options->extra_inputs[i];
+
+	return inputs;
+}
+
+/* Parse the command line "argv" of length "argc" and
+ * process the input files.
+ *
+ * The first input file is parsed as part of the options.
+ * Any additional input files are specified through
+ * the --additional-input option, such that all command line
+ * arguments can still be checked by options_parse.
+ *
+ * If the --server option is specified, then start serving
+ * requests for running this function on other command lines instead.
+ */
+static int run(int argc, char **argv)
+{
+	int r, n;
 	isl_ctx *ctx;
 	struct options *options;
+	const char **inputs;
+	char *cmd;
 
 	options = options_new_with_defaults();
 	assert(options);
+	cmd = command_line(argc, argv);
 
 	ctx = isl_ctx_alloc_with_options(&options_args, options);
 	ppcg_options_set_target_defaults(options->ppcg);
@@ -1078,19 +1481,39 @@ int main(int argc, char **argv)
 	isl_options_set_schedule_maximize_coincidence(ctx, 1);
 	pet_options_set_encapsulate_dynamic_control(ctx, 1);
 	argc = options_parse(options, argc, argv, ISL_ARG_ALL);
+	options->ppcg->command_line = cmd;
+	inputs = collect_inputs(ctx, options);
+	n = 1 + options->n_extra_input;
 
-	if (check_options(ctx) < 0)
+	if (options->ppcg->time_phases)
+		options->ppcg->profile = ppcg_profile_alloc();
+
+	if (!inputs || check_options(ctx) < 0 ||
+	    check_inputs(ctx, options, n, inputs) < 0)
 		r = EXIT_FAILURE;
-	else if (options->ppcg->target == PPCG_TARGET_CUDA)
-		r = generate_cuda(ctx, options->ppcg, options->input);
-	else if (options->ppcg->target == PPCG_TARGET_OPENCL)
-		r = generate_opencl(ctx, options->ppcg, options->input,
-				options->output);
+	else if (options->ppcg->server)
+		r = ppcg_server(options->ppcg->server, &run);
+	else if (n > 1)
+		r = process_inputs(ctx, options->ppcg, n, inputs,
+				options->ppcg->jobs);
 	else
-		r = generate_cpu(ctx, options->ppcg, options->input,
+		r = process(ctx, options->ppcg, options->input,
 				options->output);
 
+	if (options->ppcg->profile &&
+	    ppcg_profile_write(options->ppcg->profile,
+				options->ppcg->time_phases, options->input) < 0)
+		r = EXIT_FAILURE;
+	ppcg_profile_free(options->ppcg->profile);
+	free(inputs);
+	free(cmd);
+
 	isl_ctx_free(ctx);
 
 	return r;
 }
+
+int main(int argc, char **argv)
+{
+	return run(argc, argv);
+}
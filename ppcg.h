@@ -10,6 +10,12 @@
 
 #include "ppcg_options.h"
 
+void ppcg_budget_start(isl_ctx *ctx, struct ppcg_options *options);
+int ppcg_budget_exceeded(isl_ctx *ctx, struct ppcg_options *options);
+void ppcg_budget_report(struct ppcg_options *options, const char *phase,
+	const char *action);
+void ppcg_budget_stop(isl_ctx *ctx, struct ppcg_options *options);
+
 const char *ppcg_base_name(const char *filename);
 int ppcg_extract_base_name(char *name, const char *input);
 
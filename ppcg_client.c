@@ -0,0 +1,39 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "server.h"
+
+/* Run ppcg with the given command line arguments.
+ *
+ * If the environment variable PPCG_SERVER is set to the name
+ * of a Unix domain socket on which a ppcg server is listening
+ * (see the --server option of ppcg), then the request is forwarded
+ * to this server.  Otherwise, or if the server cannot be reached,
+ * ppcg is executed directly, in which case the program called "ppcg"
+ * is looked up in the PATH, unless the environment variable PPCG
+ * specifies a different program.
+ */
+int main(int argc, char **argv)
+{
+	const char *server;
+	const char *ppcg;
+	int status;
+
+	server = getenv("PPCG_SERVER");
+	if (server && ppcg_server_request(server, argc, argv, &status) >= 0)
+		return status;
+
+	ppcg = getenv("PPCG");
+	if (!ppcg)
+		ppcg = "ppcg";
+	argv[0] = (char *) ppcg;
+	execvp(ppcg, argv);
+	fprintf(stderr, "unable to run %s\n", ppcg);
+
+	return EXIT_FAILURE;
+}
@@ -56,7 +56,8 @@ ISL_ARG_BOOL(struct ppcg_debug_options, dump_final_schedule, 0,
 	"dump-final-schedule", 0, "dump PPCG computed schedule")
 ISL_ARG_BOOL(struct ppcg_debug_options, dump_sizes, 0,
 	"dump-sizes", 0,
-	"dump effectively used per kernel tile, grid and block sizes")
+	"dump effectively used per kernel tile, grid and block sizes "
+	"or per band tile sizes (C target)")
 ISL_ARG_BOOL(struct ppcg_debug_options, verbose, 'v', "verbose", 0, NULL)
 ISL_ARGS_END
 
@@ -73,6 +74,12 @@ ISL_ARG_BOOL(struct ppcg_options, opencl_print_kernel_types, 0,
 	"print definitions of types in the kernel file")
 ISL_ARG_BOOL(struct ppcg_options, opencl_embed_kernel_code, 0,
 	"embed-kernel-code", 0, "embed kernel code into host code")
+ISL_ARG_BOOL(struct ppcg_options, opencl_use_events, 0, "use-events", 0,
+	"order commands through events on an out-of-order command queue "
+	"instead of waiting for each kernel to finish")
+ISL_ARG_STR(struct ppcg_options, opencl_binary_cache, 0, "binary-cache",
+	"dir", NULL, "let the generated host code cache compiled "
+	"OpenCL programs in <dir>")
 ISL_ARGS_END
 
 ISL_ARGS_START(struct ppcg_options, ppcg_options_args)
@@ -99,14 +106,58 @@ ISL_ARG_BOOL(struct ppcg_options, non_negative_parameters, 0,
 ISL_ARG_BOOL(struct ppcg_options, tile, 0, "tile", 0,
 	"perform tiling (C target)")
 ISL_ARG_INT(struct ppcg_options, tile_size, 'S', "tile-size", "size", 32, NULL)
+ISL_ARG_BOOL(struct ppcg_options, wavefront, 0, "wavefront", 0,
+	"skew the tile loops of bands without parallel tile loops "
+	"into a wavefront (C target with --openmp)")
+ISL_ARG_BOOL(struct ppcg_options, permute_point_loops, 0,
+	"permute-point-loops", 0,
+	"move the point loop with the most unit stride accesses "
+	"innermost (C target)")
+ISL_ARG_BOOL(struct ppcg_options, unroll_jam, 0, "unroll-jam", 0,
+	"unroll and jam the point loops of tiled bands with unroll factors "
+	"derived from the number of references (C target)")
+ISL_ARG_BOOL(struct ppcg_options, pack_arrays, 0, "pack-arrays", 0,
+	"copy the elements of read-only arrays that are reused inside a tile "
+	"into contiguous local buffers (C target with --tile)")
+ISL_ARG_INT(struct ppcg_options, pack_max_bytes, 0, "pack-max-bytes", "size",
+	16384, "maximal total size in bytes of the local buffers "
+	"of a tile for --pack-arrays")
+ISL_ARG_BOOL(struct ppcg_options, scalar_replacement, 0,
+	"scalar-replacement", 0,
+	"keep array elements that are reused in the innermost loops "
+	"in local variables (C target)")
+ISL_ARG_BOOL(struct ppcg_options, auto_tile_sizes, 0, "auto-tile-sizes", 0,
+	"select tile sizes such that the data accessed by a tile "
+	"fits in the data caches (C target)")
+ISL_ARG_STR(struct ppcg_options, cache_sizes, 0, "cache-sizes", "sizes",
+	NULL, "comma separated list of data cache sizes or name of "
+	"file containing such a list for --auto-tile-sizes "
+	"(default: caches of host machine)")
 ISL_ARG_BOOL(struct ppcg_options, isolate_full_tiles, 0, "isolate-full-tiles",
-	0, "isolate full tiles from partial tiles (hybrid tiling)")
+	0, "isolate full tiles from partial tiles "
+	"(hybrid tiling and C target with --tile)")
 ISL_ARG_STR(struct ppcg_options, sizes, 0, "sizes", "sizes", NULL,
-	"Per kernel tile, grid and block sizes")
+	"Per kernel tile, grid and block sizes or per band tile sizes "
+	"(C target)")
 ISL_ARG_INT(struct ppcg_options, max_shared_memory, 0,
 	"max-shared-memory", "size", 8192, "maximal amount of shared memory")
 ISL_ARG_BOOL(struct ppcg_options, openmp, 0, "openmp", 0,
 	"Generate OpenMP macros (only for C target)")
+ISL_ARG_BOOL(struct ppcg_options, openmp_reductions, 0, "openmp-reductions",
+	0, "parallelize loops that only carry reductions using "
+	"OpenMP reduction clauses (only for C target)")
+ISL_ARG_BOOL(struct ppcg_options, openmp_schedule, 0, "openmp-schedule", 0,
+	"select the schedule kind of OpenMP parallel loops based on "
+	"the load balance between their iterations (only for C target)")
+ISL_ARG_BOOL(struct ppcg_options, openmp_regions, 0, "openmp-regions", 0,
+	"execute consecutive OpenMP parallel loops and sequential loops "
+	"around them inside a single parallel region (only for C target)")
+ISL_ARG_BOOL(struct ppcg_options, openmp_tasks, 0, "openmp-tasks", 0,
+	"execute tiles as OpenMP tasks with dependences between them "
+	"(only for C target with --tile)")
+ISL_ARG_BOOL(struct ppcg_options, openmp_simd, 0, "openmp-simd", 0,
+	"mark innermost loops with unit stride writes that can be "
+	"vectorized as OpenMP simd loops (only for C target)")
 ISL_ARG_USER_OPT_CHOICE(struct ppcg_options, target, 0, "target", target,
 	&set_target, PPCG_TARGET_CUDA, PPCG_TARGET_CUDA,
 	"the target to generate code for")
@@ -122,7 +173,7 @@ ISL_ARG_BOOL(struct ppcg_options, live_range_reordering, 0,
 	"to be reordered")
 ISL_ARG_BOOL(struct ppcg_options, hybrid, 0, "hybrid", 0,
 	"apply hybrid tiling whenever a suitable input pattern is found "
-	"(GPU targets)")
+	"(GPU targets and C target with --openmp)")
 ISL_ARG_BOOL(struct ppcg_options, unroll_copy_shared, 0, "unroll-copy-shared",
 	0, "unroll code for copying to/from shared memory")
 ISL_ARG_BOOL(struct ppcg_options, unroll_gpu_tile, 0, "unroll-gpu-tile", 0,
@@ -133,4 +184,24 @@ ISL_ARG_STR(struct ppcg_options, save_schedule_file, 0, "save-schedule",
 ISL_ARG_STR(struct ppcg_options, load_schedule_file, 0, "load-schedule",
 	"file", NULL, "load schedule from <file>, "
 	"using it instead of an isl computed schedule")
+ISL_ARG_STR(struct ppcg_options, extraction_cache, 0, "extraction-cache",
+	"dir", NULL, "cache the scops extracted from unchanged input files "
+	"in <dir>")
+ISL_ARG_STR(struct ppcg_options, schedule_cache, 0, "schedule-cache",
+	"dir", NULL, "cache isl computed schedules in <dir> and reuse them "
+	"for identical schedule constraints")
+ISL_ARG_ULONG(struct ppcg_options, scop_max_operations, 0,
+	"scop-max-operations", 0,
+	"maximal number of isl operations spent on dependence analysis "
+	"and scheduling of a scop (0 for no limit)")
+ISL_ARG_INT(struct ppcg_options, scop_timeout, 0, "scop-timeout", "seconds",
+	0, "maximal number of seconds spent on dependence analysis "
+	"and scheduling of a scop (0 for no limit)")
+ISL_ARG_STR(struct ppcg_options, server, 0, "server", "socket", NULL,
+	"serve requests from ppcg_client on the Unix domain socket <socket>")
+ISL_ARG_INT(struct ppcg_options, jobs, 'j', "jobs", "n", 1,
+	"maximal number of input files processed in parallel")
+ISL_ARG_STR(struct ppcg_options, time_phases, 0, "time-phases", "file", NULL,
+	"write the time spent in each phase of each scop to <file> "
+	"in JSON format (\"-\" for standard output)")
 ISL_ARGS_END
@@ -4,6 +4,9 @@
 #include <isl/arg.h>
 #include <isl/options.h>
 
+struct ppcg_profile;
+struct ppcg_budget;
+
 struct ppcg_debug_options {
 	int dump_schedule_constraints;
 	int dump_schedule;
@@ -32,6 +35,22 @@ struct ppcg_options {
 	/* Perform tiling (C target). */
 	int tile;
 	int tile_size;
+	/* Skew tile loops without parallelism into a wavefront. */
+	int wavefront;
+	/* Move the point loop with most unit stride accesses innermost. */
+	int permute_point_loops;
+	/* Unroll and jam the innermost point loops (C target). */
+	int unroll_jam;
+	/* Pack reused read-only array tiles into local buffers (C target). */
+	int pack_arrays;
+	/* Maximal total size in bytes of the local buffers of a tile. */
+	int pack_max_bytes;
+	/* Keep reused array elements in local variables (C target). */
+	int scalar_replacement;
+	/* Select tile sizes that fit the data caches (C target). */
+	int auto_tile_sizes;
+	/* Cache sizes or machine description file for auto_tile_sizes. */
+	char *cache_sizes;
 
 	/* Isolate full tiles from partial tiles. */
 	int isolate_full_tiles;
@@ -50,6 +69,16 @@ struct ppcg_options {
 
 	/* Generate OpenMP macros (C target only). */
 	int openmp;
+	/* Use OpenMP reduction clauses (C target only). */
+	int openmp_reductions;
+	/* Select OpenMP schedule kinds (C target only). */
+	int openmp_schedule;
+	/* Share OpenMP parallel regions between loops (C target only). */
+	int openmp_regions;
+	/* Execute tiles as OpenMP tasks (C target only). */
+	int openmp_tasks;
+	/* Mark vectorizable innermost loops as simd loops (C target only). */
+	int openmp_simd;
 
 	/* Linearize all device arrays. */
 	int linearize_device_arrays;
@@ -80,11 +109,46 @@ struct ppcg_options {
 	int opencl_print_kernel_types;
 	/* Embed OpenCL kernel code in host code. */
 	int opencl_embed_kernel_code;
+	/* Order OpenCL commands through events on an out-of-order queue. */
+	int opencl_use_events;
+	/* Directory for caching compiled OpenCL programs or NULL. */
+	char *opencl_binary_cache;
 
 	/* Name of file for saving isl computed schedule or NULL. */
 	char *save_schedule_file;
 	/* Name of file for loading schedule or NULL. */
 	char *load_schedule_file;
+
+	/* Directory for caching extracted scops or NULL. */
+	char *extraction_cache;
+	/* Description of the version and command line of PPCG.
+	 * This field is not set from the command line.
+	 */
+	const char *command_line;
+
+	/* Directory for caching computed schedules or NULL. */
+	char *schedule_cache;
+
+	/* Maximal number of isl operations per scop (0 for no limit). */
+	unsigned long scop_max_operations;
+	/* Maximal number of seconds per scop (0 for no limit). */
+	int scop_timeout;
+	/* Per-scop compile budget of the current call to ppcg_transform.
+	 * This field is not set from the command line.
+	 */
+	struct ppcg_budget *budget;
+
+	/* Unix domain socket on which to serve requests or NULL. */
+	char *server;
+	/* Maximal number of input files processed in parallel. */
+	int jobs;
+
+	/* Name of file for writing per-phase timings or NULL. */
+	char *time_phases;
+	/* Per-phase timings, if time_phases is set.
+	 * This field is not set from the command line.
+	 */
+	struct ppcg_profile *profile;
 };
 
 ISL_ARG_DECL(ppcg_debug_options, struct ppcg_debug_options,
@@ -0,0 +1,276 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+/* The maximal nesting depth of phases.
+ */
+#define PPCG_PROFILE_MAX_DEPTH	16
+
+/* The time spent in a single phase.
+ *
+ * "phase" is the name of the phase.
+ * "scop" is the sequence number of the scop to which the phase belongs.
+ * "kernel" is the sequence number of the kernel to which the phase
+ * belongs or -1 if the phase does not belong to a specific kernel.
+ * "wall" and "cpu" are the wall clock time and the processor time
+ * spent in the phase, excluding any nested phases.
+ */
+struct ppcg_profile_record {
+	const char *phase;
+	int scop;
+	int kernel;
+	double wall;
+	double cpu;
+};
+
+/* Timing information about the phases of ppcg.
+ *
+ * "n_scop" is the number of scops that have been completely processed.
+ * The phases that are currently being timed are kept on a stack.
+ * "active" contains the indices in "record" of the elements
+ * on this stack and "depth" is the number of elements on the stack.
+ * "wall" and "cpu" are the wall clock time and processor time
+ * at the moment the time of the phase on top of the stack
+ * started accumulating.
+ * "n_dropped" is the number of phases that were started
+ * on top of this stack, but that could not be recorded,
+ * either because the stack was full or because memory ran out.
+ * These phases are not timed separately, but their ends
+ * still need to be matched to their starts.
+ */
+struct ppcg_profile {
+	int n_scop;
+
+	int n_record;
+	int size;
+	struct ppcg_profile_record *record;
+
+	int depth;
+	int active[PPCG_PROFILE_MAX_DEPTH];
+	double wall;
+	double cpu;
+
+	int n_dropped;
+};
+
+/* Return the current wall clock time in seconds.
+ */
+static double wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Return the processor time used so far in seconds.
+ */
+static double cpu_time(void)
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+struct ppcg_profile *ppcg_profile_alloc(void)
+{
+	return calloc(1, sizeof(struct ppcg_profile));
+}
+
+void ppcg_profile_free(struct ppcg_profile *profile)
+{
+	if (!profile)
+		return;
+	free(profile->record);
+	free(profile);
+}
+
+/* Add the time spent since the last update to the phase
+ * on top of the stack, if any, and reset the start time.
+ */
+static void update_top(struct ppcg_profile *profile)
+{
+	double wall = wall_time();
+	double cpu = cpu_time();
+
+	if (profile->depth > 0) {
+		struct ppcg_profile_record *record;
+
+		record = &profile->record[profile->active[profile->depth - 1]];
+		record->wall += wall - profile->wall;
+		record->cpu += cpu - profile->cpu;
+	}
+	profile->wall = wall;
+	profile->cpu = cpu;
+}
+
+/* Start timing the phase called "phase" of kernel "kernel"
+ * in the current scop.
+ * If another phase is already being timed, then that phase is
+ * suspended until the new phase ends.
+ * If the phase cannot be recorded, then the time spent in the phase
+ * is attributed to the enclosing phase, if any.
+ * "profile" may be NULL, in which case nothing happens.
+ */
+void ppcg_profile_start_kernel(struct ppcg_profile *profile,
+	const char *phase, int kernel)
+{
+	struct ppcg_profile_record *record;
+
+	if (!profile)
+		return;
+	if (profile->n_dropped > 0 ||
+	    profile->depth >= PPCG_PROFILE_MAX_DEPTH) {
+		profile->n_dropped++;
+		return;
+	}
+
+	if (profile->n_record >= profile->size) {
+		int size = 2 * profile->size + 16;
+
+		record = realloc(profile->record, size * sizeof(*record));
+		if (!record) {
+			profile->n_dropped++;
+			return;
+		}
+		profile->record = record;
+		profile->size = size;
+	}
+
+	update_top(profile);
+
+	record = &profile->record[profile->n_record];
+	record->phase = phase;
+	record->scop = profile->n_scop;
+	record->kernel = kernel;
+	record->wall = 0;
+	record->cpu = 0;
+	profile->active[profile->depth++] = profile->n_record++;
+}
+
+/* Start timing the phase called "phase" of the current scop.
+ */
+void ppcg_profile_start(struct ppcg_profile *profile, const char *phase)
+{
+	ppcg_profile_start_kernel(profile, phase, -1);
+}
+
+/* Stop timing the phase that was started last and
+ * resume timing the enclosing phase, if any.
+ * If the phase that was started last could not be recorded,
+ * then the enclosing phase simply continues.
+ */
+void ppcg_profile_end(struct ppcg_profile *profile)
+{
+	if (!profile)
+		return;
+	if (profile->n_dropped > 0) {
+		profile->n_dropped--;
+		return;
+	}
+	if (profile->depth == 0)
+		return;
+
+	update_top(profile);
+	profile->depth--;
+}
+
+/* Mark the end of the processing of the current scop.
+ * Subsequent phases are attributed to the next scop.
+ */
+void ppcg_profile_next_scop(struct ppcg_profile *profile)
+{
+	if (!profile)
+		return;
+	profile->n_scop++;
+}
+
+/* Print "str" to "out" as a JSON string.
+ */
+static void print_json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char) *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+/* Print the timing information in "profile" about the processing of
+ * the file "input" to "out" in JSON format.
+ *
+ * Each phase is printed as a separate element of the "phases" list,
+ * in the order in which the phases were started.
+ * Phases that do not belong to any scop, e.g., the parsing
+ * of the part of the input file after the final scop,
+ * have a null "scop" field.
+ *
+ * Return 0 on success and -1 on failure.
+ */
+int ppcg_profile_print_json(struct ppcg_profile *profile, FILE *out,
+	const char *input)
+{
+	int i;
+
+	if (!profile)
+		return -1;
+
+	fprintf(out, "{\n  \"input\": ");
+	print_json_string(out, input ? input : "");
+	fprintf(out, ",\n  \"scops\": %d,\n  \"phases\": [", profile->n_scop);
+	for (i = 0; i < profile->n_record; ++i) {
+		struct ppcg_profile_record *record = &profile->record[i];
+
+		fprintf(out, "%s\n    { \"phase\": ", i ? "," : "");
+		print_json_string(out, record->phase);
+		if (record->scop < profile->n_scop)
+			fprintf(out, ", \"scop\": %d", record->scop);
+		else
+			fprintf(out, ", \"scop\": null");
+		if (record->kernel >= 0)
+			fprintf(out, ", \"kernel\": %d", record->kernel);
+		fprintf(out, ", \"wall\": %.6f, \"cpu\": %.6f }",
+			record->wall, record->cpu);
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	return ferror(out) ? -1 : 0;
+}
+
+/* Write the timing information in "profile" about the processing of
+ * the file "input" to the file called "filename" in JSON format.
+ * If "filename" is "-", then the information is written
+ * to the standard output.
+ *
+ * Return 0 on success and -1 on failure.
+ */
+int ppcg_profile_write(struct ppcg_profile *profile, const char *filename,
+	const char *input)
+{
+	FILE *file;
+	int r;
+
+	if (!strcmp(filename, "-"))
+		return ppcg_profile_print_json(profile, stdout, input);
+
+	file = fopen(filename, "w");
+	if (!file) {
+		fprintf(stderr, "Unable to open '%s' for writing\n", filename);
+		return -1;
+	}
+	r = ppcg_profile_print_json(profile, file, input);
+	if (fclose(file) != 0)
+		r = -1;
+
+	return r;
+}
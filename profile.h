@@ -0,0 +1,22 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+struct ppcg_profile;
+
+struct ppcg_profile *ppcg_profile_alloc(void);
+void ppcg_profile_free(struct ppcg_profile *profile);
+
+void ppcg_profile_start(struct ppcg_profile *profile, const char *phase);
+void ppcg_profile_start_kernel(struct ppcg_profile *profile,
+	const char *phase, int kernel);
+void ppcg_profile_end(struct ppcg_profile *profile);
+void ppcg_profile_next_scop(struct ppcg_profile *profile);
+
+int ppcg_profile_print_json(struct ppcg_profile *profile, FILE *out,
+	const char *input);
+int ppcg_profile_write(struct ppcg_profile *profile, const char *filename,
+	const char *input);
+
+#endif
@@ -0,0 +1,682 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <isl/ctx.h>
+#include <isl/id.h>
+#include <isl/val.h>
+#include <isl/aff.h>
+#include <isl/set.h>
+#include <isl/union_set.h>
+#include <isl/union_map.h>
+#include <isl/ast.h>
+#include <isl/ast_build.h>
+#include <pet.h>
+
+#include "reduction.h"
+#include "util.h"
+
+/* Do "expr1" and "expr2" access the same array element?
+ * That is, are they both access expressions to the same array
+ * with the same index expression?
+ * Accesses with arguments, i.e., with a data-dependent index,
+ * are never considered to access the same element.
+ */
+static isl_bool is_same_element(__isl_keep pet_expr *expr1,
+	__isl_keep pet_expr *expr2)
+{
+	isl_id *id1, *id2;
+	isl_multi_pw_aff *index1, *index2;
+	isl_bool equal;
+
+	if (pet_expr_get_type(expr1) != pet_expr_access ||
+	    pet_expr_get_type(expr2) != pet_expr_access)
+		return isl_bool_false;
+	if (pet_expr_get_n_arg(expr1) != 0 || pet_expr_get_n_arg(expr2) != 0)
+		return isl_bool_false;
+
+	id1 = pet_expr_access_get_id(expr1);
+	id2 = pet_expr_access_get_id(expr2);
+	equal = id1 && id1 == id2;
+	isl_id_free(id1);
+	isl_id_free(id2);
+	if (!equal)
+		return isl_bool_false;
+
+	index1 = pet_expr_access_get_index(expr1);
+	index2 = pet_expr_access_get_index(expr2);
+	equal = isl_multi_pw_aff_plain_is_equal(index1, index2);
+	isl_multi_pw_aff_free(index1);
+	isl_multi_pw_aff_free(index2);
+
+	return equal;
+}
+
+/* Are "expr1" and "expr2" obviously equal?
+ * Only accesses to the same element and equal integer constants
+ * are detected.
+ */
+static isl_bool is_same_expr(__isl_keep pet_expr *expr1,
+	__isl_keep pet_expr *expr2)
+{
+	isl_val *v1, *v2;
+	isl_bool equal;
+
+	if (pet_expr_get_type(expr1) == pet_expr_access)
+		return is_same_element(expr1, expr2);
+	if (pet_expr_get_type(expr1) != pet_expr_int ||
+	    pet_expr_get_type(expr2) != pet_expr_int)
+		return isl_bool_false;
+
+	v1 = pet_expr_int_get_val(expr1);
+	v2 = pet_expr_int_get_val(expr2);
+	equal = isl_val_eq(v1, v2);
+	isl_val_free(v1);
+	isl_val_free(v2);
+
+	return equal;
+}
+
+/* Return the OpenMP reduction operator corresponding to
+ * the compound assignment operator "type", or NULL if there is none.
+ * As in OpenMP, a subtraction is treated as an addition.
+ */
+static const char *compound_op(enum pet_op_type type)
+{
+	switch (type) {
+	case pet_op_add_assign:
+	case pet_op_sub_assign:
+		return "+";
+	case pet_op_mul_assign:
+		return "*";
+	case pet_op_and_assign:
+		return "&";
+	case pet_op_or_assign:
+		return "|";
+	case pet_op_xor_assign:
+		return "^";
+	default:
+		return NULL;
+	}
+}
+
+/* Return the OpenMP reduction operator corresponding to
+ * the commutative binary operator "type", or NULL if there is none.
+ */
+static const char *binary_op(enum pet_op_type type)
+{
+	switch (type) {
+	case pet_op_add:
+		return "+";
+	case pet_op_mul:
+		return "*";
+	case pet_op_and:
+		return "&";
+	case pet_op_or:
+		return "|";
+	case pet_op_xor:
+		return "^";
+	default:
+		return NULL;
+	}
+}
+
+/* Return "min" or "max" if "name" is the name of a function
+ * that computes the minimum or maximum of its two arguments.
+ * Return NULL otherwise.
+ */
+static const char *min_max_op(const char *name)
+{
+	if (!name)
+		return NULL;
+	if (!strcmp(name, "min") || !strcmp(name, "fmin") ||
+	    !strcmp(name, "fminf") || !strcmp(name, "fminl"))
+		return "min";
+	if (!strcmp(name, "max") || !strcmp(name, "fmax") ||
+	    !strcmp(name, "fmaxf") || !strcmp(name, "fmaxl"))
+		return "max";
+	return NULL;
+}
+
+/* Given that "rhs" is of the form "x op e" or "e op x", with "x"
+ * an access to the same element as "lhs", return the reduction operator
+ * and store "e" in *operand.
+ * Return NULL if "rhs" is not of this form.
+ * Subtraction is only allowed in the form "x - e".
+ */
+static const char *binary_update_op(__isl_keep pet_expr *lhs,
+	__isl_keep pet_expr *rhs, __isl_give pet_expr **operand)
+{
+	enum pet_op_type type;
+	pet_expr *arg;
+	const char *op;
+	int i;
+
+	type = pet_expr_op_get_type(rhs);
+	op = binary_op(type);
+	if (type == pet_op_sub)
+		op = "+";
+	if (!op || pet_expr_get_n_arg(rhs) != 2)
+		return NULL;
+
+	for (i = 0; i < 2; ++i) {
+		isl_bool same;
+
+		if (i == 1 && type == pet_op_sub)
+			break;
+		arg = pet_expr_get_arg(rhs, i);
+		same = is_same_element(lhs, arg);
+		pet_expr_free(arg);
+		if (same < 0)
+			return NULL;
+		if (same) {
+			*operand = pet_expr_get_arg(rhs, 1 - i);
+			return op;
+		}
+	}
+
+	return NULL;
+}
+
+/* Given that "rhs" is a call to a minimum or maximum function
+ * with "x" and "e" as arguments, where "x" is an access
+ * to the same element as "lhs", return the reduction operator
+ * and store "e" in *operand.
+ * Return NULL if "rhs" is not of this form.
+ */
+static const char *call_update_op(__isl_keep pet_expr *lhs,
+	__isl_keep pet_expr *rhs, __isl_give pet_expr **operand)
+{
+	const char *op;
+	pet_expr *arg;
+	int i;
+
+	op = min_max_op(pet_expr_call_get_name(rhs));
+	if (!op || pet_expr_get_n_arg(rhs) != 2)
+		return NULL;
+
+	for (i = 0; i < 2; ++i) {
+		isl_bool same;
+
+		arg = pet_expr_get_arg(rhs, i);
+		same = is_same_element(lhs, arg);
+		pet_expr_free(arg);
+		if (same < 0)
+			return NULL;
+		if (same) {
+			*operand = pet_expr_get_arg(rhs, 1 - i);
+			return op;
+		}
+	}
+
+	return NULL;
+}
+
+/* Given that "rhs" is a conditional expression "c0 < c1 ? t : f"
+ * (or with any other strict or non-strict inequality), where
+ * one of "c0" and "c1" is an access "x" to the same element as "lhs",
+ * the other, "e", is obviously equal to one of "t" and "f" and
+ * the remaining one of "t" and "f" is also an access to "x",
+ * return "min" or "max" depending on which of the two
+ * the conditional expression computes and store "e" in *operand.
+ * Return NULL if "rhs" is not of this form.
+ */
+static const char *cond_update_op(__isl_keep pet_expr *lhs,
+	__isl_keep pet_expr *rhs, __isl_give pet_expr **operand)
+{
+	pet_expr *cond, *c[2], *branch[2];
+	enum pet_op_type type;
+	isl_bool same;
+	int less, x, t_is_x, t_is_c0;
+	const char *op = NULL;
+	int i;
+
+	cond = pet_expr_get_arg(rhs, 0);
+	if (pet_expr_get_type(cond) != pet_expr_op) {
+		pet_expr_free(cond);
+		return NULL;
+	}
+	type = pet_expr_op_get_type(cond);
+	if (type != pet_op_lt && type != pet_op_le &&
+	    type != pet_op_gt && type != pet_op_ge) {
+		pet_expr_free(cond);
+		return NULL;
+	}
+	less = type == pet_op_lt || type == pet_op_le;
+	for (i = 0; i < 2; ++i) {
+		c[i] = pet_expr_get_arg(cond, i);
+		branch[i] = pet_expr_get_arg(rhs, 1 + i);
+	}
+	pet_expr_free(cond);
+
+	same = is_same_element(lhs, c[0]);
+	x = same ? 0 : 1;
+	if (same == isl_bool_false)
+		same = is_same_element(lhs, c[1]);
+	if (same != isl_bool_true)
+		goto done;
+
+	same = is_same_element(lhs, branch[0]);
+	t_is_x = same == isl_bool_true;
+	if (same == isl_bool_true)
+		same = is_same_expr(c[1 - x], branch[1]);
+	else if (same == isl_bool_false)
+		same = is_same_element(lhs, branch[1]);
+	if (same == isl_bool_true && !t_is_x)
+		same = is_same_expr(c[1 - x], branch[0]);
+	if (same != isl_bool_true)
+		goto done;
+
+	t_is_c0 = t_is_x == (x == 0);
+	op = t_is_c0 == less ? "min" : "max";
+	*operand = pet_expr_copy(c[1 - x]);
+done:
+	for (i = 0; i < 2; ++i) {
+		pet_expr_free(c[i]);
+		pet_expr_free(branch[i]);
+	}
+	return op;
+}
+
+/* Is "expr" an update of an array element by an associative and
+ * commutative operator?  If so, return the operator as it should
+ * appear in an OpenMP reduction clause, store the access
+ * to the updated element in *update and the other operand in *operand.
+ * Otherwise, return NULL.
+ *
+ * The following forms are recognized, with "x" an access
+ * to the updated element and "e" an arbitrary expression,
+ *
+ *	x op= e
+ *	x++
+ *	x = x op e
+ *	x = e op x
+ *	x = min(x, e)
+ *	x = x < e ? x : e
+ *
+ * along with some obvious variations.
+ * Only the forms "x op= e" and "x++" (along with the other increments
+ * and decrements) allow "x" to have a data-dependent index.
+ * An increment or decrement does not have another operand, so *operand
+ * is left untouched in this case.
+ */
+static const char *update_op(__isl_keep pet_expr *expr,
+	__isl_give pet_expr **update, __isl_give pet_expr **operand)
+{
+	enum pet_op_type type;
+	pet_expr *lhs, *rhs;
+	const char *op = NULL;
+
+	if (pet_expr_get_type(expr) != pet_expr_op)
+		return NULL;
+	type = pet_expr_op_get_type(expr);
+	if (pet_expr_get_n_arg(expr) == 1) {
+		if (type != pet_op_post_inc && type != pet_op_post_dec &&
+		    type != pet_op_pre_inc && type != pet_op_pre_dec)
+			return NULL;
+		*update = pet_expr_get_arg(expr, 0);
+		return "+";
+	}
+	if (pet_expr_get_n_arg(expr) != 2)
+		return NULL;
+	lhs = pet_expr_get_arg(expr, 0);
+	if (type != pet_op_assign) {
+		op = compound_op(type);
+		if (op)
+			*operand = pet_expr_get_arg(expr, 1);
+	} else {
+		rhs = pet_expr_get_arg(expr, 1);
+		if (pet_expr_get_type(rhs) == pet_expr_call)
+			op = call_update_op(lhs, rhs, operand);
+		else if (pet_expr_get_type(rhs) != pet_expr_op)
+			op = NULL;
+		else if (pet_expr_op_get_type(rhs) == pet_op_cond)
+			op = cond_update_op(lhs, rhs, operand);
+		else
+			op = binary_update_op(lhs, rhs, operand);
+		pet_expr_free(rhs);
+	}
+
+	if (op)
+		*update = lhs;
+	else
+		pet_expr_free(lhs);
+	return op;
+}
+
+/* Data used in check_access.
+ *
+ * "id" identifies the updated array.
+ * "conflict" is set if an access writes to any array or
+ * accesses the updated array.
+ */
+struct ppcg_reduction_check_data {
+	isl_id *id;
+	int conflict;
+};
+
+/* Check whether the access expression "expr" writes to any array
+ * or accesses data->id.
+ * If so, set data->conflict and abort the search.
+ */
+static int check_access(__isl_keep pet_expr *expr, void *user)
+{
+	struct ppcg_reduction_check_data *data = user;
+	isl_id *id;
+
+	id = pet_expr_access_get_id(expr);
+	if (id == data->id || pet_expr_access_is_write(expr))
+		data->conflict = 1;
+	isl_id_free(id);
+
+	return data->conflict ? -1 : 0;
+}
+
+/* Does "expr" write to any array or access the array identified by "id"?
+ * "expr" may be NULL, in which case there is no conflict.
+ */
+static int has_conflict(__isl_keep pet_expr *expr, __isl_keep isl_id *id)
+{
+	struct ppcg_reduction_check_data data = { id, 0 };
+
+	if (!expr)
+		return 0;
+	if (pet_expr_foreach_access_expr(expr, &check_access, &data) < 0 &&
+	    !data.conflict)
+		return -1;
+	return data.conflict;
+}
+
+/* Return the array in "scop" that is identified by "id",
+ * or NULL if there is no such array.
+ */
+static struct pet_array *find_array(struct pet_scop *scop,
+	__isl_keep isl_id *id)
+{
+	int i;
+
+	for (i = 0; i < scop->n_array; ++i) {
+		isl_id *array_id;
+		int match;
+
+		array_id = isl_set_get_tuple_id(scop->arrays[i]->extent);
+		match = array_id == id;
+		isl_id_free(array_id);
+		if (match)
+			return scop->arrays[i];
+	}
+
+	return NULL;
+}
+
+/* Is every dimension of "array" bounded from above?
+ * This is needed for expressing the updated elements
+ * in an array section in the reduction clause.
+ */
+static int is_bounded(struct pet_array *array)
+{
+	int i, n;
+
+	n = isl_set_dim(array->extent, isl_dim_set);
+	for (i = 0; i < n; ++i) {
+		isl_bool bounded;
+
+		bounded = isl_set_dim_has_upper_bound(array->extent,
+							isl_dim_set, i);
+		if (bounded != isl_bool_true)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Is the string "type" of length "len" the name of one of the
+ * fixed width integer types intN_t or uintN_t?
+ */
+static int is_fixed_width_integer_type(const char *type, size_t len)
+{
+	if (len > 0 && type[0] == 'u') {
+		type++;
+		len--;
+	}
+	if (len < 6 || strncmp(type, "int", 3) ||
+	    strncmp(type + len - 2, "_t", 2))
+		return 0;
+	return strspn(type + 3, "0123456789") == len - 5;
+}
+
+/* Is "type" the name of an integer type?
+ * That is, does it only consist of integer type specifiers and
+ * qualifiers or is it one of the standard integer typedefs?
+ */
+static int is_integer_type(const char *type)
+{
+	static const char *words[] = { "signed", "unsigned", "char", "short",
+		"int", "long", "_Bool", "const", "volatile", "size_t",
+		"ptrdiff_t", "intptr_t", "uintptr_t" };
+	int n = sizeof(words) / sizeof(words[0]);
+
+	if (!type)
+		return 0;
+	while (*type) {
+		size_t len;
+		int i;
+
+		type += strspn(type, " ");
+		len = strcspn(type, " ");
+		if (len == 0)
+			break;
+		for (i = 0; i < n; ++i)
+			if (strlen(words[i]) == len &&
+			    !strncmp(type, words[i], len))
+				break;
+		if (i >= n && !is_fixed_width_integer_type(type, len))
+			return 0;
+		type += len;
+	}
+
+	return 1;
+}
+
+/* If "stmt" is a reduction statement, then return the updated array
+ * and the reduction operator in *op.  Otherwise, return NULL.
+ *
+ * A reduction statement is an expression statement that updates
+ * an array element using one of the forms recognized by update_op,
+ * such that the array is not accessed in any other way and
+ * such that no other array is written.
+ * In particular, neither the other operand nor the index expression
+ * of a data-dependent access to the updated element may write
+ * to any array or access the updated array.
+ * Statements with arguments, i.e., with data-dependent control,
+ * are not considered.
+ * The array should also be of a bounded size and should not
+ * be a structure.
+ * The OpenMP min and max reductions do not follow the semantics
+ * of fmin and fmax, nor of comparisons, in the presence of NaNs,
+ * so they are only used on arrays of integer type.
+ */
+static struct pet_array *reduction_stmt(struct pet_scop *scop,
+	struct pet_stmt *stmt, const char **op)
+{
+	pet_expr *expr, *update = NULL, *operand = NULL;
+	struct pet_array *array = NULL;
+	isl_id *id;
+	int i, n, conflict;
+
+	if (pet_stmt_is_kill(stmt) || stmt->n_arg > 0)
+		return NULL;
+	if (pet_tree_get_type(stmt->body) != pet_tree_expr)
+		return NULL;
+
+	expr = pet_tree_expr_get_expr(stmt->body);
+	*op = update_op(expr, &update, &operand);
+	pet_expr_free(expr);
+	if (!*op)
+		return NULL;
+
+	id = pet_expr_access_get_id(update);
+	conflict = !id || has_conflict(operand, id);
+	n = pet_expr_get_n_arg(update);
+	for (i = 0; !conflict && i < n; ++i) {
+		pet_expr *arg = pet_expr_get_arg(update, i);
+		conflict = has_conflict(arg, id);
+		pet_expr_free(arg);
+	}
+	if (!conflict)
+		array = find_array(scop, id);
+	if (array && (array->element_is_record || !is_bounded(array)))
+		array = NULL;
+	if (array && (!strcmp(*op, "min") || !strcmp(*op, "max")) &&
+	    !is_integer_type(array->element_type))
+		array = NULL;
+	isl_id_free(id);
+	pet_expr_free(update);
+	pet_expr_free(operand);
+
+	return array;
+}
+
+/* Add the instances of "stmt", which updates "array" using "op",
+ * to the matching reduction group in "reductions",
+ * creating a new group if there is no such group yet.
+ */
+static int add_reduction_stmt(isl_ctx *ctx,
+	struct ppcg_reductions *reductions, struct pet_stmt *stmt,
+	struct pet_array *array, const char *op)
+{
+	int i;
+	isl_union_set *domain;
+	struct ppcg_reduction *group;
+
+	domain = isl_union_set_from_set(isl_set_copy(stmt->domain));
+	for (i = 0; i < reductions->n; ++i) {
+		group = &reductions->group[i];
+		if (group->array != array || strcmp(group->op, op))
+			continue;
+		group->domain = isl_union_set_union(group->domain, domain);
+		return group->domain ? 0 : -1;
+	}
+
+	group = isl_realloc_array(ctx, reductions->group,
+				struct ppcg_reduction, reductions->n + 1);
+	if (!group) {
+		isl_union_set_free(domain);
+		return -1;
+	}
+	reductions->group = group;
+	group = &reductions->group[reductions->n++];
+	group->op = op;
+	group->array = array;
+	group->domain = domain;
+	group->deps = NULL;
+
+	return domain ? 0 : -1;
+}
+
+/* Extract the reduction groups from "scop" and compute
+ * for each of them the dependences in "deps" between
+ * the instances of the statements in the group.
+ */
+struct ppcg_reductions *ppcg_scop_extract_reductions(struct ppcg_scop *scop,
+	__isl_keep isl_union_map *deps)
+{
+	isl_ctx *ctx;
+	struct ppcg_reductions *reductions;
+	int i;
+
+	if (!scop || !deps)
+		return NULL;
+
+	ctx = isl_union_map_get_ctx(deps);
+	reductions = isl_calloc_type(ctx, struct ppcg_reductions);
+	if (!reductions)
+		return NULL;
+
+	for (i = 0; i < scop->pet->n_stmt; ++i) {
+		struct pet_stmt *stmt = scop->pet->stmts[i];
+		struct pet_array *array;
+		const char *op;
+
+		array = reduction_stmt(scop->pet, stmt, &op);
+		if (!array)
+			continue;
+		if (add_reduction_stmt(ctx, reductions, stmt, array, op) < 0)
+			return ppcg_reductions_free(reductions);
+	}
+
+	for (i = 0; i < reductions->n; ++i) {
+		struct ppcg_reduction *group = &reductions->group[i];
+
+		group->deps = isl_union_map_copy(deps);
+		group->deps = isl_union_map_intersect_domain(group->deps,
+					isl_union_set_copy(group->domain));
+		group->deps = isl_union_map_intersect_range(group->deps,
+					isl_union_set_copy(group->domain));
+		if (!group->deps)
+			return ppcg_reductions_free(reductions);
+	}
+
+	return reductions;
+}
+
+/* Free "reductions" and return NULL.
+ */
+void *ppcg_reductions_free(struct ppcg_reductions *reductions)
+{
+	int i;
+
+	if (!reductions)
+		return NULL;
+
+	for (i = 0; i < reductions->n; ++i) {
+		isl_union_set_free(reductions->group[i].domain);
+		isl_union_map_free(reductions->group[i].deps);
+	}
+	free(reductions->group);
+	free(reductions);
+
+	return NULL;
+}
+
+/* Print an OpenMP reduction clause for "reduction" to "p".
+ * If the updated array is not a scalar, then the clause
+ * refers to an array section that covers the entire array,
+ * with the size of the array expressed in terms of the parameters
+ * through "build".
+ */
+__isl_give isl_printer *ppcg_print_reduction_clause(__isl_take isl_printer *p,
+	struct ppcg_reduction *reduction, __isl_keep isl_ast_build *build)
+{
+	struct pet_array *array = reduction->array;
+	isl_multi_pw_aff *size;
+	int i, n;
+
+	p = isl_printer_print_str(p, " reduction(");
+	p = isl_printer_print_str(p, reduction->op);
+	p = isl_printer_print_str(p, ":");
+	p = isl_printer_print_str(p, isl_set_get_tuple_name(array->extent));
+
+	n = isl_set_dim(array->extent, isl_dim_set);
+	size = n > 0 ? ppcg_size_from_extent(isl_set_copy(array->extent))
+		     : NULL;
+	for (i = 0; i < n; ++i) {
+		isl_pw_aff *bound;
+		isl_ast_expr *expr;
+
+		bound = isl_multi_pw_aff_get_pw_aff(size, i);
+		expr = isl_ast_build_expr_from_pw_aff(build, bound);
+		p = isl_printer_print_str(p, "[0:");
+		p = isl_printer_print_ast_expr(p, expr);
+		p = isl_printer_print_str(p, "]");
+		isl_ast_expr_free(expr);
+	}
+	isl_multi_pw_aff_free(size);
+
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
@@ -0,0 +1,46 @@
+#ifndef PPCG_REDUCTION_H
+#define PPCG_REDUCTION_H
+
+#include <isl/id.h>
+#include <isl/union_set.h>
+#include <isl/union_map.h>
+#include <isl/printer.h>
+#include <isl/ast_build.h>
+
+#include "ppcg.h"
+
+/* A group of reduction statements that update the same array
+ * with the same associative and commutative operator.
+ *
+ * "op" is the operator, as it appears in an OpenMP reduction clause.
+ * "array" is the array that is being updated.
+ * "domain" contains the instances of the statements in the group.
+ * "deps" contains the dependences between these instances.
+ * Since the statements do not access the array in any other way and
+ * since they do not write to any other array, these are all due to
+ * the updates of the array.
+ */
+struct ppcg_reduction {
+	const char *op;
+	struct pet_array *array;
+	isl_union_set *domain;
+	isl_union_map *deps;
+};
+
+/* The reduction groups of a scop.
+ *
+ * "n" is the number of groups in "group".
+ */
+struct ppcg_reductions {
+	int n;
+	struct ppcg_reduction *group;
+};
+
+struct ppcg_reductions *ppcg_scop_extract_reductions(struct ppcg_scop *scop,
+	__isl_keep isl_union_map *deps);
+void *ppcg_reductions_free(struct ppcg_reductions *reductions);
+
+__isl_give isl_printer *ppcg_print_reduction_clause(__isl_take isl_printer *p,
+	struct ppcg_reduction *reduction, __isl_keep isl_ast_build *build);
+
+#endif
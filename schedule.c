@@ -10,13 +10,19 @@
 
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <isl/set.h>
 #include <isl/map.h>
 #include <isl/constraint.h>
+#include <isl/options.h>
+#include <isl/version.h>
 
 #include "grouping.h"
+#include "ppcg.h"
+#include "profile.h"
 #include "schedule.h"
 
 /* Add parameters with identifiers "ids" to "set".
@@ -99,6 +105,25 @@ static __isl_give isl_schedule *load_schedule(isl_ctx *ctx,
 	return schedule;
 }
 
+/* Print the schedule "schedule" to "file" in block style.
+ */
+static isl_stat print_schedule_to_file(__isl_keep isl_schedule *schedule,
+	FILE *file)
+{
+	isl_ctx *ctx;
+	isl_printer *p;
+
+	ctx = isl_schedule_get_ctx(schedule);
+	p = isl_printer_to_file(ctx, file);
+	p = isl_printer_set_yaml_style(p, ISL_YAML_STYLE_BLOCK);
+	p = isl_printer_print_schedule(p, schedule);
+	if (!p)
+		return isl_stat_error;
+	isl_printer_free(p);
+
+	return ferror(file) ? isl_stat_error : isl_stat_ok;
+}
+
 /* Save the schedule "schedule" to a file called "filename".
  * The schedule is printed in block style.
  */
@@ -106,8 +131,6 @@ static void save_schedule(__isl_keep isl_schedule *schedule,
 	const char *filename)
 {
 	FILE *file;
-	isl_ctx *ctx;
-	isl_printer *p;
 
 	if (!schedule)
 		return;
@@ -117,11 +140,7 @@ static void save_schedule(__isl_keep isl_schedule *schedule,
 		fprintf(stderr, "Unable to open '%s' for writing\n", filename);
 		return;
 	}
-	ctx = isl_schedule_get_ctx(schedule);
-	p = isl_printer_to_file(ctx, file);
-	p = isl_printer_set_yaml_style(p, ISL_YAML_STYLE_BLOCK);
-	p = isl_printer_print_schedule(p, schedule);
-	isl_printer_free(p);
+	print_schedule_to_file(schedule, file);
 	fclose(file);
 }
 
@@ -131,9 +150,268 @@ static void save_schedule(__isl_keep isl_schedule *schedule,
 __isl_give isl_schedule *ppcg_compute_non_grouping_schedule(
 	__isl_take isl_schedule_constraints *sc, struct ppcg_options *options)
 {
+	isl_schedule *schedule;
+
 	if (options->debug->dump_schedule_constraints)
 		isl_schedule_constraints_dump(sc);
-	return isl_schedule_constraints_compute_schedule(sc);
+	ppcg_profile_start(options->profile, "compute_schedule");
+	schedule = isl_schedule_constraints_compute_schedule(sc);
+	ppcg_profile_end(options->profile);
+
+	return schedule;
+}
+
+/* Compute a schedule on the domain of "sc" that respects the schedule
+ * constraints in "sc".
+ *
+ * "schedule" is a known correct schedule that is used to combine
+ * groups of statements if options->group_chains is set.
+ * The time spent on grouping is timed separately from the time
+ * spent in the actual scheduler.
+ */
+static __isl_give isl_schedule *compute_schedule(
+	__isl_take isl_schedule_constraints *sc,
+	__isl_keep isl_schedule *schedule, struct ppcg_options *options)
+{
+	isl_schedule *res;
+
+	if (!options->group_chains)
+		return ppcg_compute_non_grouping_schedule(sc, options);
+
+	ppcg_profile_start(options->profile, "grouping");
+	res = ppcg_compute_grouping_schedule(sc, schedule, options);
+	ppcg_profile_end(options->profile);
+
+	return res;
+}
+
+/* Update the 64-bit FNV-1a hash "hash" with the characters of "str".
+ */
+static unsigned long long hash_str(unsigned long long hash, const char *str)
+{
+	for (; *str; ++str) {
+		hash ^= (unsigned char) *str;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/* Print "name" and the value "value" of the option called "name" to "p".
+ */
+static __isl_give isl_printer *print_option(__isl_take isl_printer *p,
+	const char *name, int value)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, name);
+	p = isl_printer_print_str(p, ": ");
+	p = isl_printer_print_int(p, value);
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print all information that affects the result of compute_schedule
+ * on "sc" and "schedule" to "p".
+ * This includes the isl version and the isl scheduling options.
+ * The known correct schedule "schedule" is only used
+ * if options->group_chains is set.
+ */
+static __isl_give isl_printer *print_schedule_cache_key(
+	__isl_take isl_printer *p, __isl_keep isl_schedule_constraints *sc,
+	__isl_keep isl_schedule *schedule, struct ppcg_options *options)
+{
+	isl_ctx *ctx = isl_printer_get_ctx(p);
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, isl_version());
+	p = isl_printer_end_line(p);
+	p = print_option(p, "algorithm",
+			isl_options_get_schedule_algorithm(ctx));
+	p = print_option(p, "max_coefficient",
+			isl_options_get_schedule_max_coefficient(ctx));
+	p = print_option(p, "max_constant_term",
+			isl_options_get_schedule_max_constant_term(ctx));
+	p = print_option(p, "maximize_band_depth",
+			isl_options_get_schedule_maximize_band_depth(ctx));
+	p = print_option(p, "maximize_coincidence",
+			isl_options_get_schedule_maximize_coincidence(ctx));
+	p = print_option(p, "outer_coincidence",
+			isl_options_get_schedule_outer_coincidence(ctx));
+	p = print_option(p, "split_scaled",
+			isl_options_get_schedule_split_scaled(ctx));
+	p = print_option(p, "separate_components",
+			isl_options_get_schedule_separate_components(ctx));
+	p = print_option(p, "serialize_sccs",
+			isl_options_get_schedule_serialize_sccs(ctx));
+	p = print_option(p, "whole_component",
+			isl_options_get_schedule_whole_component(ctx));
+	p = print_option(p, "treat_coalescing",
+			isl_options_get_schedule_treat_coalescing(ctx));
+	p = print_option(p, "carry_self_first",
+			isl_options_get_schedule_carry_self_first(ctx));
+	p = print_option(p, "nonneg_var_coefficient",
+			isl_options_get_schedule_nonneg_var_coefficient(ctx));
+	p = print_option(p, "group_chains", options->group_chains);
+	p = isl_printer_print_schedule_constraints(p, sc);
+	if (options->group_chains) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_end_line(p);
+		p = isl_printer_print_schedule(p, schedule);
+	}
+
+	return p;
+}
+
+/* Return the printed representation of all information that affects
+ * the result of compute_schedule on "sc" and "schedule".
+ */
+static char *schedule_cache_key(__isl_keep isl_schedule_constraints *sc,
+	__isl_keep isl_schedule *schedule, struct ppcg_options *options)
+{
+	isl_printer *p;
+	char *key;
+
+	if (!sc)
+		return NULL;
+
+	p = isl_printer_to_str(isl_schedule_constraints_get_ctx(sc));
+	p = print_schedule_cache_key(p, sc, schedule, options);
+	key = isl_printer_get_str(p);
+	isl_printer_free(p);
+
+	return key;
+}
+
+/* Return the name of the file in the schedule cache directory
+ * that holds the schedule corresponding to the cache key "key".
+ * The name is derived from a hash of "key".
+ */
+static char *schedule_cache_file(isl_ctx *ctx, const char *key,
+	struct ppcg_options *options)
+{
+	char *name;
+	size_t len;
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+
+	hash = hash_str(hash, key);
+
+	len = strlen(options->schedule_cache) + 40;
+	name = isl_alloc_array(ctx, char, len);
+	if (!name)
+		return NULL;
+	snprintf(name, len, "%s/ppcg-schedule-%016llx.yaml",
+		options->schedule_cache, hash);
+
+	return name;
+}
+
+/* Does the schedule cache file "file" start with the cache key "key"?
+ *
+ * The key is stored as its length on a line of its own,
+ * followed by the key itself.
+ */
+static int cached_key_matches(FILE *file, const char *key)
+{
+	unsigned long stored_len;
+	size_t len;
+	char *stored;
+	int match;
+
+	len = strlen(key);
+	if (fscanf(file, "%lu", &stored_len) != 1 || fgetc(file) != '\n')
+		return 0;
+	if (stored_len != len)
+		return 0;
+	stored = malloc(len + 1);
+	if (!stored)
+		return 0;
+	match = fread(stored, 1, len, file) == len &&
+		memcmp(stored, key, len) == 0;
+	free(stored);
+
+	return match;
+}
+
+/* Load a schedule from the schedule cache file called "filename",
+ * if it exists and if it was stored for the cache key "key".
+ * Since the file name only depends on a hash of the key,
+ * a different key may have been stored in the same file.
+ * As an extra precaution against foreign or corrupted files,
+ * the schedule is only used if it is defined over the domain of "sc".
+ */
+static __isl_give isl_schedule *load_cached_schedule(isl_ctx *ctx,
+	const char *filename, const char *key,
+	__isl_keep isl_schedule_constraints *sc)
+{
+	FILE *file;
+	isl_schedule *schedule = NULL;
+	isl_union_set *domain, *sc_domain;
+	isl_bool equal;
+
+	file = fopen(filename, "r");
+	if (!file)
+		return NULL;
+	if (cached_key_matches(file, key))
+		schedule = isl_schedule_read_from_file(ctx, file);
+	fclose(file);
+	if (!schedule)
+		return NULL;
+
+	domain = isl_schedule_get_domain(schedule);
+	sc_domain = isl_schedule_constraints_get_domain(sc);
+	equal = isl_union_set_is_equal(domain, sc_domain);
+	isl_union_set_free(domain);
+	isl_union_set_free(sc_domain);
+	if (equal != isl_bool_true)
+		return isl_schedule_free(schedule);
+
+	return schedule;
+}
+
+/* Store "schedule" in the schedule cache file called "filename",
+ * preceded by the cache key "key" in the format expected
+ * by cached_key_matches.
+ *
+ * The schedule is first written to a temporary file that is specific
+ * to this process and then moved into place, such that concurrent
+ * ppcg processes never see a partially written cache file.
+ * The temporary file is only moved into place if it was written
+ * successfully.  Otherwise, it is removed.
+ * Failure to store the schedule is silently ignored.
+ */
+static void save_cached_schedule(__isl_keep isl_schedule *schedule,
+	const char *filename, const char *key)
+{
+	isl_ctx *ctx;
+	FILE *file;
+	char *tmp;
+	size_t len;
+	int ok;
+
+	if (!schedule)
+		return;
+
+	ctx = isl_schedule_get_ctx(schedule);
+	len = strlen(filename) + 32;
+	tmp = isl_alloc_array(ctx, char, len);
+	if (!tmp)
+		return;
+	snprintf(tmp, len, "%s.%ld.tmp", filename, (long) getpid());
+	file = fopen(tmp, "w");
+	if (!file) {
+		free(tmp);
+		return;
+	}
+	ok = fprintf(file, "%lu\n", (unsigned long) strlen(key)) >= 0 &&
+	    fputs(key, file) >= 0 && fputc('\n', file) != EOF;
+	ok = ok && print_schedule_to_file(schedule, file) >= 0;
+	ok = fclose(file) == 0 && ok;
+	if (ok)
+		ok = rename(tmp, filename) == 0;
+	if (!ok)
+		remove(tmp);
+	free(tmp);
 }
 
 /* Compute a schedule on the domain of "sc" that respects the schedule
@@ -141,20 +419,59 @@ __isl_give isl_schedule *ppcg_compute_non_grouping_schedule(
  *
  * "schedule" is a known correct schedule that is used to combine
  * groups of statements if options->group_chains is set.
+ *
+ * If a schedule cache directory has been specified, then first
+ * look for a schedule computed by an earlier run on the same input
+ * and store the computed schedule in the cache if there is none.
+ * The cached schedule is stored together with the full cache key
+ * such that a collision of the hashes in the file names
+ * does not result in a schedule for a different input.
+ * A schedule that was computed under a per-scop compile budget
+ * that was exceeded is not stored.
  */
 __isl_give isl_schedule *ppcg_compute_schedule(
 	__isl_take isl_schedule_constraints *sc,
 	__isl_keep isl_schedule *schedule, struct ppcg_options *options)
 {
-	if (options->group_chains)
-		return ppcg_compute_grouping_schedule(sc, schedule, options);
-	return ppcg_compute_non_grouping_schedule(sc, options);
+	isl_ctx *ctx;
+	isl_schedule *res;
+	char *key;
+	char *file;
+
+	if (!options->schedule_cache || !sc)
+		return compute_schedule(sc, schedule, options);
+
+	ctx = isl_schedule_constraints_get_ctx(sc);
+	key = schedule_cache_key(sc, schedule, options);
+	file = key ? schedule_cache_file(ctx, key, options) : NULL;
+	if (!file) {
+		free(key);
+		return compute_schedule(sc, schedule, options);
+	}
+
+	res = load_cached_schedule(ctx, file, key, sc);
+	if (res) {
+		isl_schedule_constraints_free(sc);
+	} else {
+		res = compute_schedule(sc, schedule, options);
+		if (!ppcg_budget_exceeded(ctx, options))
+			save_cached_schedule(res, file, key);
+	}
+	free(file);
+	free(key);
+
+	return res;
 }
 
 /* Obtain a schedule, either by reading it form a file
  * or by computing it using "compute".
  * Also take care of saving the computed schedule and/or
  * dumping the obtained schedule if requested by the user.
+ *
+ * The per-scop compile budget is only enforced while computing
+ * the schedule.  If it is exceeded, then call "compute" again
+ * with rescheduling turned off such that the input schedule
+ * is used instead.
  */
 __isl_give isl_schedule *ppcg_get_schedule(isl_ctx *ctx,
 	struct ppcg_options *options,
@@ -165,7 +482,22 @@ __isl_give isl_schedule *ppcg_get_schedule(isl_ctx *ctx,
 	if (options->load_schedule_file) {
 		schedule = load_schedule(ctx, options->load_schedule_file);
 	} else {
+		int exceeded;
+
+		ppcg_budget_start(ctx, options);
 		schedule = compute(user);
+		exceeded = ppcg_budget_exceeded(ctx, options);
+		ppcg_budget_stop(ctx, options);
+		if (exceeded) {
+			int reschedule = options->reschedule;
+
+			isl_schedule_free(schedule);
+			ppcg_budget_report(options, "scheduling",
+					    "using input schedule");
+			options->reschedule = 0;
+			schedule = compute(user);
+			options->reschedule = reschedule;
+		}
 		if (options->save_schedule_file)
 			save_schedule(schedule, options->save_schedule_file);
 	}
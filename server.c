@@ -0,0 +1,391 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/* The protocol between ppcg_server_request and ppcg_server.
+ *
+ * A request consists of a header containing the length of the payload
+ * that is sent together with the client's standard output and
+ * standard error file descriptors, followed by the payload itself.
+ * The payload consists of the current working directory of the client,
+ * followed by the command line arguments, each terminated by a null byte.
+ * The server runs ppcg in the client's working directory,
+ * with the output of ppcg directly going to the client's
+ * standard output and standard error.
+ * The generated files are written directly in the file system.
+ * When ppcg has finished, the server replies with its exit status.
+ */
+struct ppcg_server_header {
+	uint32_t len;
+};
+
+/* Write the "len" bytes in "data" to "fd".
+ * Return 0 on success and -1 on failure.
+ */
+static int write_full(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Read "len" bytes from "fd" into "data".
+ * Return 0 on success and -1 on failure.
+ */
+static int read_full(int fd, void *data, size_t len)
+{
+	char *p = data;
+
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Fill in "addr" with the address of the Unix domain socket "path".
+ * Return 0 on success and -1 if "path" is too long.
+ */
+static int set_address(struct sockaddr_un *addr, const char *path)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+
+	return 0;
+}
+
+/* Send the header "header" to "fd", together with the file descriptors
+ * "fds" of length 2.
+ * Return 0 on success and -1 on failure.
+ */
+static int send_header(int fd, struct ppcg_server_header *header, int *fds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	iov.iov_base = header;
+	iov.iov_len = sizeof(*header);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, 2 * sizeof(int));
+
+	return sendmsg(fd, &msg, 0) == sizeof(*header) ? 0 : -1;
+}
+
+/* Receive a header from "fd" and store it in "header", storing
+ * the accompanying file descriptors in "fds" of length 2.
+ * Return 0 on success and -1 on failure.
+ */
+static int receive_header(int fd, struct ppcg_server_header *header,
+	int *fds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = header;
+	iov.iov_len = sizeof(*header);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if (recvmsg(fd, &msg, 0) != sizeof(*header))
+		return -1;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+	    cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+		return -1;
+	memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+
+	return 0;
+}
+
+/* Handle a single request on the connection "conn" by calling "run"
+ * on the command line arguments in the request, after having moved
+ * to the working directory of the client and after having redirected
+ * the standard output and standard error to those of the client.
+ * The working directory takes the place of argv[0] in the request.
+ * Store the exit status that should be reported to the client in *status.
+ * Return 0 on success and -1 if the request is invalid.
+ */
+static int serve(int conn, int (*run)(int argc, char **argv),
+	int32_t *status)
+{
+	struct ppcg_server_header header;
+	int fds[2];
+	char *payload, *p, *end;
+	char **argv;
+	int argc, i;
+
+	if (receive_header(conn, &header, fds) < 0)
+		return -1;
+	payload = malloc(header.len + 1);
+	if (!payload || read_full(conn, payload, header.len) < 0)
+		return -1;
+	payload[header.len] = '\0';
+	end = payload + header.len;
+
+	argc = 0;
+	for (p = payload; p < end; p += strlen(p) + 1)
+		argc++;
+	if (argc < 1)
+		return -1;
+	argv = malloc((argc + 1) * sizeof(char *));
+	if (!argv)
+		return -1;
+	for (i = 0, p = payload; p < end; p += strlen(p) + 1)
+		argv[i++] = p;
+	argv[argc] = NULL;
+
+	if (dup2(fds[0], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0)
+		return -1;
+	close(fds[0]);
+	close(fds[1]);
+
+	if (chdir(argv[0]) < 0) {
+		fprintf(stderr, "unable to change to directory %s\n", argv[0]);
+		*status = EXIT_FAILURE;
+	} else {
+		argv[0] = "ppcg";
+		*status = run(argc, argv);
+	}
+	fflush(NULL);
+
+	return 0;
+}
+
+/* Remove a stale socket called "path" with address "addr"
+ * left behind by an earlier server.
+ * Refuse to remove "path" if it is anything other than a socket or
+ * if a server is still listening on the socket.
+ * Return 0 on success and -1 on failure.
+ */
+static int remove_stale_socket(const char *path, struct sockaddr_un *addr)
+{
+	struct stat st;
+	int fd, live;
+
+	if (lstat(path, &st) < 0)
+		return errno == ENOENT ? 0 : -1;
+	if (!S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "%s exists and is not a socket\n", path);
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	live = connect(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0;
+	close(fd);
+	if (live) {
+		fprintf(stderr, "a server is already listening on %s\n", path);
+		return -1;
+	}
+	return unlink(path);
+}
+
+/* Is the peer of the connection "conn" running as the same user
+ * as the server?
+ * Any other user could otherwise make the server run ppcg
+ * with the privileges of the server in a directory of their choice.
+ */
+static int same_user(int conn)
+{
+	uid_t uid;
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+		return 0;
+	uid = cred.uid;
+#else
+	gid_t gid;
+
+	if (getpeereid(conn, &uid, &gid) < 0)
+		return 0;
+#endif
+
+	return uid == geteuid();
+}
+
+/* Listen on the Unix domain socket "path" for requests sent
+ * by ppcg_server_request and handle each of them by calling "run"
+ * on the command line arguments in the request.
+ *
+ * The socket is only accessible to the user running the server and
+ * requests from peers running as a different user are rejected.
+ *
+ * Each request is handled in a separate process that is forked off
+ * from the server process, such that every request starts out from
+ * the same fully initialized state and such that requests can be
+ * handled concurrently.
+ * The server process does not wait for these processes.
+ * The handlers themselves may need to wait for their own child processes,
+ * so they restore the default handling of SIGCHLD.
+ *
+ * This function only returns on error.
+ */
+int ppcg_server(const char *path, int (*run)(int argc, char **argv))
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd, r;
+
+	if (set_address(&addr, path) < 0)
+		return -1;
+	if (remove_stale_socket(path, &addr) < 0)
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	mask = umask(S_IRWXG | S_IRWXO);
+	r = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+	if (r < 0 || chmod(path, S_IRUSR | S_IWUSR) < 0 ||
+	    listen(fd, SOMAXCONN) < 0) {
+		fprintf(stderr, "unable to listen on %s\n", path);
+		close(fd);
+		return -1;
+	}
+	signal(SIGCHLD, SIG_IGN);
+
+	for (;;) {
+		int conn;
+		pid_t pid;
+
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0 && errno == EINTR)
+			continue;
+		if (conn < 0)
+			break;
+		if (!same_user(conn)) {
+			close(conn);
+			continue;
+		}
+		pid = fork();
+		if (pid == 0) {
+			int32_t status;
+
+			close(fd);
+			signal(SIGCHLD, SIG_DFL);
+			if (serve(conn, run, &status) >= 0)
+				write_full(conn, &status, sizeof(status));
+			_exit(EXIT_SUCCESS);
+		}
+		close(conn);
+	}
+
+	close(fd);
+	return -1;
+}
+
+/* Ask the ppcg server listening on the Unix domain socket "path"
+ * to run ppcg with command line "argv" of length "argc"
+ * in the current working directory and store the exit status in *status.
+ * argv[0] itself is not sent to the server.
+ *
+ * Return 0 on success and -1 if the request could not be handled
+ * by the server.
+ */
+int ppcg_server_request(const char *path, int argc, char **argv,
+	int *status)
+{
+	struct sockaddr_un addr;
+	struct ppcg_server_header header;
+	char cwd[PATH_MAX];
+	int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+	int32_t reply;
+	size_t len;
+	int i, fd;
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		return -1;
+	if (set_address(&addr, path) < 0)
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	len = strlen(cwd) + 1;
+	for (i = 1; i < argc; ++i)
+		len += strlen(argv[i]) + 1;
+	header.len = len;
+	fflush(NULL);
+	if (send_header(fd, &header, fds) < 0 ||
+	    write_full(fd, cwd, strlen(cwd) + 1) < 0)
+		goto error;
+	for (i = 1; i < argc; ++i)
+		if (write_full(fd, argv[i], strlen(argv[i]) + 1) < 0)
+			goto error;
+	if (read_full(fd, &reply, sizeof(reply)) < 0)
+		goto error;
+
+	close(fd);
+	*status = reply;
+	return 0;
+error:
+	close(fd);
+	return -1;
+}
@@ -0,0 +1,8 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+int ppcg_server(const char *path, int (*run)(int argc, char **argv));
+int ppcg_server_request(const char *path, int argc, char **argv,
+	int *status);
+
+#endif
@@ -0,0 +1,18 @@
+#include <stdlib.h>
+
+int main()
+{
+	int A[100][100];
+
+#pragma scop
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j)
+			A[i][j] = i + 2 * j;
+#pragma endscop
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j)
+			if (A[i][j] != i + 2 * j)
+				return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
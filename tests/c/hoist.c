@@ -0,0 +1,28 @@
+#include <stdlib.h>
+
+int main()
+{
+	int A[102], B[102], R[102];
+
+	for (int i = 0; i < 102; ++i)
+		A[i] = R[i] = i % 7;
+#pragma scop
+	for (int t = 0; t < 10; ++t) {
+		for (int i = 1; i < 101; ++i)
+			B[i] = A[i - 1] + A[i] + A[i + 1];
+		for (int i = 1; i < 101; ++i)
+			A[i] = B[i] % 11;
+	}
+#pragma endscop
+	for (int t = 0; t < 10; ++t) {
+		for (int i = 1; i < 101; ++i)
+			B[i] = R[i - 1] + R[i] + R[i + 1];
+		for (int i = 1; i < 101; ++i)
+			R[i] = B[i] % 11;
+	}
+	for (int i = 0; i < 102; ++i)
+		if (A[i] != R[i])
+			return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
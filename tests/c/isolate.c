@@ -0,0 +1,24 @@
+#include <stdlib.h>
+
+int main()
+{
+	int A[100][100], B[100][100], C[100][100];
+
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j)
+			A[i][j] = i - j;
+#pragma scop
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j) {
+			B[i][j] = 2 * A[i][j];
+			C[i][j] = B[i][j] + 1;
+		}
+#pragma endscop
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j)
+			if (B[i][j] != 2 * (i - j) ||
+			    C[i][j] != 2 * (i - j) + 1)
+				return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+#include <stdlib.h>
+
+int main()
+{
+	int A[100], T[10];
+
+	for (int i = 0; i < 100; ++i)
+		A[i] = i;
+#pragma scop
+	for (int t = 0; t < 10; ++t) {
+		for (int i = 0; i < 100; ++i)
+			A[i] = A[i] + t;
+		T[t] = A[t];
+	}
+#pragma endscop
+	for (int t = 0; t < 10; ++t)
+		if (T[t] != t + t * (t + 1) / 2)
+			return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#include <stdlib.h>
+
+int main()
+{
+	int A[100], B[100], C[100];
+
+	for (int i = 0; i < 100; ++i)
+		A[i] = B[i] = C[i] = i;
+#pragma scop
+	for (int t = 0; t < 10; ++t) {
+		for (int i = 0; i < 100; ++i)
+			A[i] = A[i] + t;
+		for (int i = 0; i < 100; ++i)
+			B[i] = B[i] + 2 * t;
+		for (int i = 0; i < 100; ++i)
+			C[i] = C[i] - t;
+	}
+#pragma endscop
+	for (int i = 0; i < 100; ++i)
+		if (A[i] != i + 45 || B[i] != i + 90 || C[i] != i - 45)
+			return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
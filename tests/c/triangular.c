@@ -0,0 +1,21 @@
+#include <stdlib.h>
+
+int main()
+{
+	int A[100][100];
+
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j)
+			A[i][j] = 0;
+#pragma scop
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j <= i; ++j)
+			A[i][j] = i * j + 1;
+#pragma endscop
+	for (int i = 0; i < 100; ++i)
+		for (int j = 0; j < 100; ++j)
+			if (A[i][j] != (j <= i ? i * j + 1 : 0))
+				return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -5,6 +5,8 @@
 
 #include <isl/space.h>
 #include <isl/val.h>
+#include <isl/set.h>
+#include <isl/union_map.h>
 
 /* Compare the prefix of "s" to "prefix" up to the length of "prefix".
  */
@@ -19,4 +21,12 @@ __isl_give isl_multi_val *ppcg_multi_val_from_int_list(
 	__isl_take isl_space *space, int *list);
 __isl_give isl_multi_pw_aff *ppcg_size_from_extent(__isl_take isl_set *set);
 
+__isl_give isl_set *ppcg_extract_sizes(__isl_keep isl_union_map *sizes,
+	const char *domain, const char *type, int id);
+isl_stat ppcg_read_sizes_from_set(__isl_take isl_set *set, int *sizes,
+	int *len);
+__isl_give isl_union_map *ppcg_add_used_sizes(
+	__isl_take isl_union_map *used_sizes, const char *domain,
+	const char *type, int id, int *sizes, int len);
+
 #endif